@@ -0,0 +1,156 @@
+#include "bench_target.h"
+#include "../fuse/vfs_ops.h"
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#include <mutex>
+#include <unordered_map>
+
+using namespace std;
+
+// The state the FUSE loop keeps for an open file: the path and the
+// fuse_file_info handed to every operation on it
+struct DirectHandle {
+    string path;
+    struct fuse_file_info fi;
+};
+
+class DirectTarget : public BenchTarget {
+public:
+    const char* name() const override { return "direct"; }
+
+    int open(const string& path, int flags, mode_t mode) override {
+        DirectHandle h;
+        h.path = path;
+        memset(&h.fi, 0, sizeof(h.fi));
+        h.fi.flags = flags;
+
+        int res = (flags & O_CREAT) ? vfs_create(path.c_str(), mode, &h.fi)
+                                    : vfs_open(path.c_str(), &h.fi);
+        if (res != 0) return res;
+
+        int handle = (int)h.fi.fh;
+        lock_guard<mutex> lock(handles_mutex);
+        handles[handle] = h;
+        return handle;
+    }
+
+    ssize_t pread(int handle, char* buf, size_t size, off_t offset) override {
+        DirectHandle h;
+        if (!find(handle, h)) return -EBADF;
+        return vfs_read(h.path.c_str(), buf, size, offset, &h.fi);
+    }
+
+    ssize_t pwrite(int handle, const char* buf, size_t size, off_t offset) override {
+        DirectHandle h;
+        if (!find(handle, h)) return -EBADF;
+        return vfs_write(h.path.c_str(), buf, size, offset, &h.fi);
+    }
+
+    int fsync(int handle) override {
+        DirectHandle h;
+        if (!find(handle, h)) return -EBADF;
+        return vfs_fsync(h.path.c_str(), 0, &h.fi);
+    }
+
+    int close(int handle) override {
+        DirectHandle h;
+        {
+            lock_guard<mutex> lock(handles_mutex);
+            auto it = handles.find(handle);
+            if (it == handles.end()) return -EBADF;
+            h = it->second;
+            handles.erase(it);
+        }
+        vfs_flush(h.path.c_str(), &h.fi);
+        return vfs_release(h.path.c_str(), &h.fi);
+    }
+
+    int stat(const string& path, struct stat& st) override {
+        return vfs_getattr(path.c_str(), &st, nullptr);
+    }
+
+    int mkdir(const string& path) override {
+        return vfs_mkdir(path.c_str(), 0755);
+    }
+
+    int unlink(const string& path) override {
+        return vfs_unlink(path.c_str());
+    }
+
+    int rmdir(const string& path) override {
+        return vfs_rmdir(path.c_str());
+    }
+
+private:
+    mutex handles_mutex;
+    unordered_map<int, DirectHandle> handles;
+
+    bool find(int handle, DirectHandle& h) {
+        lock_guard<mutex> lock(handles_mutex);
+        auto it = handles.find(handle);
+        if (it == handles.end()) return false;
+        h = it->second;
+        return true;
+    }
+};
+
+class MountTarget : public BenchTarget {
+public:
+    explicit MountTarget(const string& mountpoint) : root(mountpoint) {
+        while (!root.empty() && root.back() == '/') root.pop_back();
+    }
+
+    const char* name() const override { return "mount"; }
+
+    int open(const string& path, int flags, mode_t mode) override {
+        int fd = ::open((root + path).c_str(), flags, mode);
+        return fd == -1 ? -errno : fd;
+    }
+
+    ssize_t pread(int handle, char* buf, size_t size, off_t offset) override {
+        ssize_t n = ::pread(handle, buf, size, offset);
+        return n == -1 ? -errno : n;
+    }
+
+    ssize_t pwrite(int handle, const char* buf, size_t size, off_t offset) override {
+        ssize_t n = ::pwrite(handle, buf, size, offset);
+        return n == -1 ? -errno : n;
+    }
+
+    int fsync(int handle) override {
+        return ::fsync(handle) == -1 ? -errno : 0;
+    }
+
+    int close(int handle) override {
+        return ::close(handle) == -1 ? -errno : 0;
+    }
+
+    int stat(const string& path, struct stat& st) override {
+        return ::stat((root + path).c_str(), &st) == -1 ? -errno : 0;
+    }
+
+    int mkdir(const string& path) override {
+        return ::mkdir((root + path).c_str(), 0755) == -1 ? -errno : 0;
+    }
+
+    int unlink(const string& path) override {
+        return ::unlink((root + path).c_str()) == -1 ? -errno : 0;
+    }
+
+    int rmdir(const string& path) override {
+        return ::rmdir((root + path).c_str()) == -1 ? -errno : 0;
+    }
+
+private:
+    string root;
+};
+
+unique_ptr<BenchTarget> make_direct_target() {
+    return make_unique<DirectTarget>();
+}
+
+unique_ptr<BenchTarget> make_mount_target(const string& mountpoint) {
+    return make_unique<MountTarget>(mountpoint);
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <memory>
+#include <string>
+
+using namespace std;
+
+// Where a benchmark's file operations go. Paths are relative to the
+// filesystem root ("/dir/file"); handles are small non-negative integers
+// and errors come back as -errno, like the vfs_* operations.
+class BenchTarget {
+public:
+    virtual ~BenchTarget() = default;
+
+    virtual const char* name() const = 0;
+
+    virtual int open(const string& path, int flags, mode_t mode = 0644) = 0;
+    virtual ssize_t pread(int handle, char* buf, size_t size, off_t offset) = 0;
+    virtual ssize_t pwrite(int handle, const char* buf, size_t size, off_t offset) = 0;
+    virtual int fsync(int handle) = 0;
+    virtual int close(int handle) = 0;
+
+    virtual int stat(const string& path, struct stat& st) = 0;
+    virtual int mkdir(const string& path) = 0;
+    virtual int unlink(const string& path) = 0;
+    virtual int rmdir(const string& path) = 0;
+};
+
+// Calls the path-based vfs_* operations in-process, as the FUSE loop would,
+// against a backend started with vfs_start_backend()
+unique_ptr<BenchTarget> make_direct_target();
+
+// Plain syscalls under the mount point of a running vfs_mount
+unique_ptr<BenchTarget> make_mount_target(const string& mountpoint);
@@ -0,0 +1,608 @@
+// vfs_bench: measures the version store and the vfs_* operations.
+//
+// By default the operations are called in-process against a scratch backend
+// (no kernel, no FUSE), so results isolate the daemon's own cost. With
+// --mount the same file workloads go through a running vfs_mount instead;
+// the difference between the two is the FUSE/kernel overhead.
+//
+// Every measurement is printed to stdout as one JSON object per line.
+// The version store is configured from the same VFS_* environment as the mount.
+
+#include "bench_target.h"
+#include "../common/paths.h"
+#include "../common/file_copy.h"
+#include "../fuse/vfs_ops.h"
+#include "../fuse/version_manager.h"
+#include "../fuse/version_cache.h"
+#include "../fuse/meta_log.h"
+#include "../fuse/object_store.h"
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <ftw.h>
+#include <getopt.h>
+#include <unistd.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <set>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+using Clock = chrono::steady_clock;
+
+struct BenchOptions {
+    string mountpoint;                 // Empty: call the operations directly
+    string scratch;                    // Backend for direct mode (default: a new /tmp dir)
+    set<string> scenarios;             // Empty: all
+    vector<uint64_t> sizes = {1 << 10, 64 << 10, 1 << 20, 16 << 20};
+    vector<uint64_t> meta_versions = {1, 100, 10000, 100000};
+    vector<uint64_t> history_versions = {1, 100, 1000};
+    vector<uint64_t> threads = {1, 4, 16};
+    uint64_t files = 10000;            // Small-file scenario
+    uint64_t iterations = 20;          // Repetitions of per-size measurements
+    uint64_t ops_per_thread = 200;     // Concurrent-writer scenario
+    bool keep = false;
+    bool verbose = false;
+};
+
+// One measurement: `ops` operations moving `bytes` in `seconds` (wall clock),
+// with the latency of each operation
+struct BenchResult {
+    string scenario;
+    string param;
+    uint64_t bytes = 0;
+    double seconds = 0;
+    vector<uint64_t> latencies_ns;
+
+    BenchResult(const string& scenario, const string& param) : scenario(scenario), param(param) {}
+};
+
+static FILE *results;   // The real stdout (the store's logging is silenced)
+static FILE *notes;  // The real stderr
+static BenchOptions opt;
+static string bench_dir;  // Virtual directory the workloads run in
+static const size_t FILE_CHUNK = 1 << 20;
+
+static uint64_t elapsed_ns(Clock::time_point start) {
+    return chrono::duration_cast<chrono::nanoseconds>(Clock::now() - start).count();
+}
+
+static double percentile_us(const vector<uint64_t>& sorted, double p) {
+    if (sorted.empty()) return 0;
+    size_t index = min(sorted.size() - 1, (size_t)(p * sorted.size()));
+    return sorted[index] / 1000.0;
+}
+
+static void emit(const char *mode, BenchResult& r) {
+    sort(r.latencies_ns.begin(), r.latencies_ns.end());
+    size_t ops = r.latencies_ns.size();
+    double secs = r.seconds > 0 ? r.seconds : 1e-9;
+
+    fprintf(results,
+            "{\"scenario\":\"%s\",\"mode\":\"%s\",\"param\":\"%s\",\"ops\":%zu,\"seconds\":%.6f,"
+            "\"ops_per_sec\":%.1f,\"bytes\":%llu,\"mb_per_sec\":%.2f,"
+            "\"latency_us\":{\"p50\":%.1f,\"p90\":%.1f,\"p99\":%.1f,\"p999\":%.1f,\"max\":%.1f}}\n",
+            r.scenario.c_str(), mode, r.param.c_str(), ops, r.seconds,
+            ops / secs, (unsigned long long)r.bytes, r.bytes / secs / (1 << 20),
+            percentile_us(r.latencies_ns, 0.50), percentile_us(r.latencies_ns, 0.90),
+            percentile_us(r.latencies_ns, 0.99), percentile_us(r.latencies_ns, 0.999),
+            ops ? r.latencies_ns.back() / 1000.0 : 0.0);
+    fflush(results);
+}
+
+static bool selected(const string& scenario) {
+    return opt.scenarios.empty() || opt.scenarios.count(scenario);
+}
+
+static bool direct_only(BenchTarget& target, const string& scenario) {
+    if (string(target.name()) == "direct") return true;
+    fprintf(notes, "vfs_bench: skipping %s (needs direct mode)\n", scenario.c_str());
+    return false;
+}
+
+static string size_label(uint64_t size) {
+    static const char *units[] = {"", "K", "M", "G", "T"};
+    int u = 0;
+    while (u < 4 && size >= 1024 && size % 1024 == 0) {
+        size /= 1024;
+        u++;
+    }
+    return to_string(size) + units[u];
+}
+
+// Write `size` bytes of filler through the target, creating the file
+static bool fill_file(BenchTarget& target, const string& path, uint64_t size) {
+    int h = target.open(path, O_CREAT | O_WRONLY | O_TRUNC);
+    if (h < 0) return false;
+
+    string chunk(min<uint64_t>(size, FILE_CHUNK), 'v');
+    bool ok = true;
+    for (uint64_t done = 0; ok && done < size;) {
+        size_t n = min<uint64_t>(chunk.size(), size - done);
+        ok = target.pwrite(h, chunk.data(), n, done) == (ssize_t)n;
+        done += n;
+    }
+    return target.close(h) == 0 && ok;
+}
+
+// Wait until the versions of `path` are stored (fsync is the barrier)
+static void drain(BenchTarget& target, const string& path) {
+    int h = target.open(path, O_RDONLY);
+    if (h < 0) return;
+    target.fsync(h);
+    target.close(h);
+}
+
+// Overwrite one byte of a file per iteration: every cycle versions the file
+static void run_write_cycle(BenchTarget& target) {
+    mt19937_64 rng(1);
+    for (uint64_t size : opt.sizes) {
+        string path = bench_dir + "/version_" + size_label(size) + ".bin";
+        if (!fill_file(target, path, size)) {
+            fprintf(notes, "vfs_bench: cannot create %s\n", path.c_str());
+            continue;
+        }
+        drain(target, path);
+
+        BenchResult r{"write_cycle", "size=" + size_label(size)};
+        Clock::time_point start = Clock::now();
+        for (uint64_t i = 0; i < opt.iterations; i++) {
+            Clock::time_point op = Clock::now();
+            int h = target.open(path, O_WRONLY);
+            if (h < 0) break;
+            char byte = 'a' + i % 26;
+            target.pwrite(h, &byte, 1, rng() % size);
+            target.close(h);
+            r.latencies_ns.push_back(elapsed_ns(op));
+        }
+        // Background snapshot work is part of the cost
+        drain(target, path);
+        r.seconds = elapsed_ns(start) / 1e9;
+        r.bytes = size * r.latencies_ns.size();
+        emit(target.name(), r);
+    }
+}
+
+// VersionManager::create_version on its own (synchronous, no hooks)
+static void run_create_version(BenchTarget& target) {
+    mt19937_64 rng(2);
+    for (uint64_t size : opt.sizes) {
+        string path = bench_dir + "/create_" + size_label(size) + ".bin";
+        if (!fill_file(target, path, size)) continue;
+        string backend = vfs_backend_path(path.c_str());
+
+        int fd = open(backend.c_str(), O_WRONLY);
+        if (fd == -1) continue;
+
+        BenchResult r{"create_version", "size=" + size_label(size)};
+        Clock::time_point start = Clock::now();
+        for (uint64_t i = 0; i < opt.iterations; i++) {
+            char byte = 'a' + i % 26;
+            if (pwrite(fd, &byte, 1, rng() % size) != 1) break;
+
+            Clock::time_point op = Clock::now();
+            if (!VersionManager::create_version(backend)) break;
+            r.latencies_ns.push_back(elapsed_ns(op));
+        }
+        r.seconds = elapsed_ns(start) / 1e9;
+        r.bytes = size * r.latencies_ns.size();
+        close(fd);
+        emit(target.name(), r);
+    }
+}
+
+// Freezing a pre-image on its own: what the first write to a file waits for.
+// A reflink costs the same at any size; without one it is a full copy.
+static void run_freeze(BenchTarget& target) {
+    for (uint64_t size : opt.sizes) {
+        string path = bench_dir + "/freeze_" + size_label(size) + ".bin";
+        if (!fill_file(target, path, size)) continue;
+        string backend = vfs_backend_path(path.c_str());
+
+        // Which mechanism the backend and the store end up with
+        int src = open(backend.c_str(), O_RDONLY);
+        if (src == -1) continue;
+        string probe_path;
+        int probe = ObjectStore::open_staging(probe_path);
+        CopyMethod method = probe == -1 ? CopyMethod::FAILED : copy_file_fd(src, probe);
+        close(src);
+        if (probe != -1) {
+            close(probe);
+            unlink(probe_path.c_str());
+        }
+
+        BenchResult r{"freeze", "size=" + size_label(size) + ",method=" + copy_method_name(method)};
+        Clock::time_point start = Clock::now();
+        for (uint64_t i = 0; i < opt.iterations; i++) {
+            Clock::time_point op = Clock::now();
+            string staged = ObjectStore::stage_file(backend);
+            if (staged.empty()) break;
+            r.latencies_ns.push_back(elapsed_ns(op));
+            unlink(staged.c_str());
+        }
+        r.seconds = elapsed_ns(start) / 1e9;
+        r.bytes = size * r.latencies_ns.size();
+        emit(target.name(), r);
+    }
+}
+
+// The binary metadata log that load_metadata/save_metadata read and write
+static void run_metadata(BenchTarget& target) {
+    string meta_path = opt.scratch + "/bench.meta";
+
+    for (uint64_t count : opt.meta_versions) {
+        vector<FileVersion> versions(count);
+        for (uint64_t i = 0; i < count; i++) {
+            FileVersion& v = versions[i];
+            v.object_id = string(64, "0123456789abcdef"[i % 16]);
+            v.timestamp = 1700000000 + i;
+            v.size = 4096;
+            v.stored_size = 4096;
+            v.version_number = i + 1;
+            v.base_version = 0;
+        }
+        string param = "versions=" + to_string(count);
+        uint64_t log_bytes = count * sizeof(MetaLogRecord);
+
+        BenchResult write_all{"meta_write_all", param};
+        BenchResult read_all{"meta_read_all", param};
+        BenchResult read_last{"meta_read_last", param};
+        for (uint64_t i = 0; i < opt.iterations; i++) {
+            Clock::time_point op = Clock::now();
+            MetaLog::write_all(meta_path, versions);
+            write_all.latencies_ns.push_back(elapsed_ns(op));
+
+            vector<FileVersion> loaded;
+            op = Clock::now();
+            MetaLog::read_all(meta_path, loaded);
+            read_all.latencies_ns.push_back(elapsed_ns(op));
+
+            FileVersion last;
+            op = Clock::now();
+            MetaLog::read_last(meta_path, last);
+            read_last.latencies_ns.push_back(elapsed_ns(op));
+        }
+        for (BenchResult *r : {&write_all, &read_all, &read_last}) {
+            for (uint64_t ns : r->latencies_ns) r->seconds += ns / 1e9;
+            r->bytes = (r == &read_last ? sizeof(MetaLogRecord) : log_bytes) * r->latencies_ns.size();
+            emit(target.name(), *r);
+        }
+
+        // Appending one version at a time, as commits do
+        unlink(meta_path.c_str());
+        BenchResult append{"meta_append", param};
+        Clock::time_point start = Clock::now();
+        for (const FileVersion& v : versions) {
+            Clock::time_point op = Clock::now();
+            if (!MetaLog::append(meta_path, v)) break;
+            append.latencies_ns.push_back(elapsed_ns(op));
+        }
+        append.seconds = elapsed_ns(start) / 1e9;
+        append.bytes = append.latencies_ns.size() * sizeof(MetaLogRecord);
+        emit(target.name(), append);
+        unlink(meta_path.c_str());
+    }
+}
+
+// get_versions on a file with a long history, from the cache and from disk
+static void run_history(BenchTarget& target) {
+    for (uint64_t count : opt.history_versions) {
+        string path = bench_dir + "/history_" + to_string(count) + ".txt";
+        if (!fill_file(target, path, 4096)) continue;
+        string backend = vfs_backend_path(path.c_str());
+
+        int fd = open(backend.c_str(), O_WRONLY);
+        if (fd == -1) continue;
+        for (uint64_t i = 0; i < count; i++) {
+            uint32_t stamp = i;
+            pwrite(fd, &stamp, sizeof(stamp), 0);
+            VersionManager::create_version(backend);
+        }
+        close(fd);
+
+        string param = "versions=" + to_string(count);
+        BenchResult warm{"get_versions", param + ",cache=warm"};
+        BenchResult count_r{"get_version_count", param + ",cache=warm"};
+        VersionManager::get_versions(backend);
+        for (uint64_t i = 0; i < opt.iterations * 10; i++) {
+            Clock::time_point op = Clock::now();
+            VersionManager::get_versions(backend);
+            warm.latencies_ns.push_back(elapsed_ns(op));
+
+            op = Clock::now();
+            VersionManager::get_version_count(backend);
+            count_r.latencies_ns.push_back(elapsed_ns(op));
+        }
+
+        // A capacity of 0 sends every lookup to the metadata log
+        size_t capacity = VersionCache::get_stats().capacity;
+        VersionCache::set_capacity(0);
+        BenchResult cold{"get_versions", param + ",cache=cold"};
+        for (uint64_t i = 0; i < opt.iterations; i++) {
+            Clock::time_point op = Clock::now();
+            VersionManager::get_versions(backend);
+            cold.latencies_ns.push_back(elapsed_ns(op));
+        }
+        VersionCache::set_capacity(capacity);
+
+        for (BenchResult *r : {&warm, &count_r, &cold}) {
+            for (uint64_t ns : r->latencies_ns) r->seconds += ns / 1e9;
+            emit(target.name(), *r);
+        }
+    }
+}
+
+// Many 4 KiB files, 1000 per directory: create, stat, read, rewrite, unlink
+static void run_small_files(BenchTarget& target) {
+    const size_t FILE_SIZE = 4096;
+    const uint64_t PER_DIR = 1000;
+    string data(FILE_SIZE, 's');
+    char buf[FILE_SIZE];
+
+    string root = bench_dir + "/small";
+    target.mkdir(root);
+    vector<string> paths;
+    for (uint64_t i = 0; i < opt.files; i++) {
+        string dir = root + "/d" + to_string(i / PER_DIR);
+        if (i % PER_DIR == 0) target.mkdir(dir);
+        paths.push_back(dir + "/f" + to_string(i));
+    }
+    string param = "files=" + to_string(opt.files);
+
+    auto phase = [&](const char *scenario, uint64_t bytes_per_op, auto&& op) {
+        BenchResult r{scenario, param};
+        Clock::time_point start = Clock::now();
+        for (const string& path : paths) {
+            Clock::time_point t = Clock::now();
+            op(path);
+            r.latencies_ns.push_back(elapsed_ns(t));
+        }
+        r.seconds = elapsed_ns(start) / 1e9;
+        r.bytes = bytes_per_op * r.latencies_ns.size();
+        emit(target.name(), r);
+    };
+
+    auto write_file = [&](const string& path, int flags) {
+        int h = target.open(path, flags);
+        if (h < 0) return;
+        target.pwrite(h, data.data(), data.size(), 0);
+        target.close(h);
+    };
+
+    phase("small_create", FILE_SIZE, [&](const string& path) {
+        write_file(path, O_CREAT | O_WRONLY | O_TRUNC);
+    });
+    phase("small_stat", 0, [&](const string& path) {
+        struct stat st;
+        target.stat(path, st);
+    });
+    phase("small_read", FILE_SIZE, [&](const string& path) {
+        int h = target.open(path, O_RDONLY);
+        if (h < 0) return;
+        target.pread(h, buf, sizeof(buf), 0);
+        target.close(h);
+    });
+    phase("small_rewrite", FILE_SIZE, [&](const string& path) {
+        write_file(path, O_WRONLY | O_TRUNC);
+    });
+    phase("small_unlink", 0, [&](const string& path) {
+        target.unlink(path);
+    });
+}
+
+// Writers rewriting their own files in parallel
+static void run_concurrent(BenchTarget& target) {
+    const size_t WRITE_SIZE = 16 << 10;
+    const int FILES_PER_THREAD = 16;
+    string data(WRITE_SIZE, 'c');
+
+    string root = bench_dir + "/concurrent";
+    target.mkdir(root);
+
+    for (uint64_t thread_count : opt.threads) {
+        vector<vector<string>> paths(thread_count);
+        for (uint64_t t = 0; t < thread_count; t++) {
+            for (int j = 0; j < FILES_PER_THREAD; j++) {
+                string path = root + "/t" + to_string(thread_count) + "_" + to_string(t) + "_" + to_string(j);
+                fill_file(target, path, WRITE_SIZE);
+                paths[t].push_back(path);
+            }
+        }
+
+        vector<vector<uint64_t>> latencies(thread_count);
+        Clock::time_point start = Clock::now();
+        vector<thread> writers;
+        for (uint64_t t = 0; t < thread_count; t++) {
+            writers.emplace_back([&, t] {
+                for (uint64_t i = 0; i < opt.ops_per_thread; i++) {
+                    Clock::time_point op = Clock::now();
+                    int h = target.open(paths[t][i % FILES_PER_THREAD], O_WRONLY | O_TRUNC);
+                    if (h < 0) continue;
+                    target.pwrite(h, data.data(), data.size(), 0);
+                    target.close(h);
+                    latencies[t].push_back(elapsed_ns(op));
+                }
+            });
+        }
+        for (auto& w : writers) w.join();
+        for (auto& files : paths) {
+            for (const string& path : files) drain(target, path);
+        }
+
+        BenchResult r{"concurrent_write", "threads=" + to_string(thread_count)};
+        r.seconds = elapsed_ns(start) / 1e9;
+        for (auto& l : latencies) r.latencies_ns.insert(r.latencies_ns.end(), l.begin(), l.end());
+        r.bytes = WRITE_SIZE * r.latencies_ns.size();
+        emit(target.name(), r);
+    }
+}
+
+// "1K,64K,1M" (K/M/G/T are powers of 1024)
+static bool parse_list(const char *text, vector<uint64_t>& out) {
+    out.clear();
+    istringstream iss(text);
+    string item;
+    while (getline(iss, item, ',')) {
+        char *end;
+        uint64_t value = strtoull(item.c_str(), &end, 10);
+        if (end == item.c_str()) return false;
+        switch (*end) {
+            case 'T': value <<= 10; [[fallthrough]];
+            case 'G': value <<= 10; [[fallthrough]];
+            case 'M': value <<= 10; [[fallthrough]];
+            case 'K': value <<= 10; end++; break;
+            default: break;
+        }
+        if (*end != '\0' || value == 0) return false;
+        out.push_back(value);
+    }
+    return !out.empty();
+}
+
+static int remove_entry(const char *path, const struct stat *st, int type, struct FTW *ftw) {
+    (void) st; (void) type; (void) ftw;
+    remove(path);
+    return 0;
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+        "usage: %s [options]\n"
+        "  --mount DIR          run the file workloads through a mounted vfs_mount\n"
+        "  --dir DIR            scratch directory for direct mode (default: new /tmp dir)\n"
+        "  --scenario LIST      write_cycle,create_version,freeze,metadata,history,small_files,\n"
+        "                       concurrent\n"
+        "  --sizes LIST         file sizes (default 1K,64K,1M,16M; up to 4G)\n"
+        "  --meta-versions LIST metadata log lengths (default 1,100,10000,100000)\n"
+        "  --history LIST       versions per file for get_versions (default 1,100,1000)\n"
+        "  --files N            small files (default 10000)\n"
+        "  --threads LIST       concurrent writers (default 1,4,16)\n"
+        "  --iterations N       repetitions per measurement (default 20)\n"
+        "  --ops N              operations per concurrent writer (default 200)\n"
+        "  --keep               keep the files written (and the scratch directory)\n"
+        "  --verbose            show the version store's log\n", prog);
+}
+
+static bool parse_options(int argc, char *argv[]) {
+    static const struct option longopts[] = {
+        {"mount", required_argument, nullptr, 'm'},
+        {"dir", required_argument, nullptr, 'd'},
+        {"scenario", required_argument, nullptr, 's'},
+        {"sizes", required_argument, nullptr, 'z'},
+        {"meta-versions", required_argument, nullptr, 'M'},
+        {"history", required_argument, nullptr, 'H'},
+        {"files", required_argument, nullptr, 'f'},
+        {"threads", required_argument, nullptr, 't'},
+        {"iterations", required_argument, nullptr, 'i'},
+        {"ops", required_argument, nullptr, 'o'},
+        {"keep", no_argument, nullptr, 'k'},
+        {"verbose", no_argument, nullptr, 'v'},
+        {"help", no_argument, nullptr, 'h'},
+        {nullptr, 0, nullptr, 0}
+    };
+
+    int c;
+    vector<uint64_t> single;
+    while ((c = getopt_long(argc, argv, "", longopts, nullptr)) != -1) {
+        switch (c) {
+            case 'm': opt.mountpoint = optarg; break;
+            case 'd': opt.scratch = optarg; break;
+            case 's': {
+                istringstream iss(optarg);
+                string name;
+                while (getline(iss, name, ',')) opt.scenarios.insert(name);
+                break;
+            }
+            case 'z': if (!parse_list(optarg, opt.sizes)) return false; break;
+            case 'M': if (!parse_list(optarg, opt.meta_versions)) return false; break;
+            case 'H': if (!parse_list(optarg, opt.history_versions)) return false; break;
+            case 't': if (!parse_list(optarg, opt.threads)) return false; break;
+            case 'f': if (!parse_list(optarg, single)) return false; opt.files = single[0]; break;
+            case 'i': if (!parse_list(optarg, single)) return false; opt.iterations = single[0]; break;
+            case 'o': if (!parse_list(optarg, single)) return false; opt.ops_per_thread = single[0]; break;
+            case 'k': opt.keep = true; break;
+            case 'v': opt.verbose = true; break;
+            default: return false;
+        }
+    }
+    return optind == argc;
+}
+
+int main(int argc, char *argv[]) {
+    if (!parse_options(argc, argv)) {
+        usage(argv[0]);
+        return 1;
+    }
+    bool direct = opt.mountpoint.empty();
+
+    results = fdopen(dup(STDOUT_FILENO), "w");
+    notes = fdopen(dup(STDERR_FILENO), "w");
+    if (!opt.verbose) {
+        // The store logs every version it takes; keep that out of the numbers' way
+        int null_fd = open("/dev/null", O_WRONLY);
+        dup2(null_fd, STDOUT_FILENO);
+        dup2(null_fd, STDERR_FILENO);
+        close(null_fd);
+    }
+
+    unique_ptr<BenchTarget> target;
+    string real_bench_dir;
+    if (direct) {
+        if (opt.scratch.empty()) {
+            char tmpl[] = "/tmp/vfs_bench_XXXXXX";
+            if (!mkdtemp(tmpl)) {
+                fprintf(notes, "vfs_bench: cannot create a scratch directory\n");
+                return 1;
+            }
+            opt.scratch = tmpl;
+        }
+        // The store lives next to data/, as it does under runtime/
+        string data = opt.scratch + "/data";
+        mkdir(opt.scratch.c_str(), 0755);
+        mkdir(data.c_str(), 0755);
+        setenv("VFS_BACKEND_ROOT", data.c_str(), 1);
+        vfs_start_backend();
+
+        target = make_direct_target();
+        bench_dir = "/vfs_bench";
+        real_bench_dir = data + bench_dir;
+    } else {
+        struct stat st;
+        if (stat(opt.mountpoint.c_str(), &st) != 0 || !S_ISDIR(st.st_mode)) {
+            fprintf(notes, "vfs_bench: %s is not a directory\n", opt.mountpoint.c_str());
+            return 1;
+        }
+        target = make_mount_target(opt.mountpoint);
+        bench_dir = "/vfs_bench_" + to_string(getpid());
+        real_bench_dir = opt.mountpoint + bench_dir;
+    }
+
+    int res = target->mkdir(bench_dir);
+    if (res != 0) {
+        fprintf(notes, "vfs_bench: cannot create %s: %s\n", bench_dir.c_str(), strerror(-res));
+        return 1;
+    }
+
+    if (selected("write_cycle")) run_write_cycle(*target);
+    if (selected("create_version") && direct_only(*target, "create_version")) run_create_version(*target);
+    if (selected("freeze") && direct_only(*target, "freeze")) run_freeze(*target);
+    if (selected("metadata") && direct_only(*target, "metadata")) run_metadata(*target);
+    if (selected("history") && direct_only(*target, "history")) run_history(*target);
+    if (selected("small_files")) run_small_files(*target);
+    if (selected("concurrent")) run_concurrent(*target);
+
+    if (direct) {
+        vfs_stop_backend();
+        if (!opt.keep) nftw(opt.scratch.c_str(), remove_entry, 64, FTW_DEPTH | FTW_PHYS);
+    } else if (!opt.keep) {
+        // Through the mount this versions every file once more; use a scratch mount
+        nftw(real_bench_dir.c_str(), remove_entry, 64, FTW_DEPTH | FTW_PHYS);
+    }
+    return 0;
+}
@@ -0,0 +1,99 @@
+#include "file_copy.h"
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+
+#ifdef __linux__
+#include <sys/ioctl.h>
+#include <sys/sendfile.h>
+#include <linux/fs.h>
+#endif
+
+using namespace std;
+
+// Errors meaning "this mechanism is not supported here", as opposed to a real I/O error
+static bool is_unsupported(int err) {
+    return err == EXDEV || err == EINVAL || err == ENOSYS || err == EOPNOTSUPP ||
+           err == ENOTTY || err == EBADF || err == ETXTBSY;
+}
+
+CopyMethod copy_file_fd(int src_fd, int dst_fd) {
+    struct stat st;
+    if (fstat(src_fd, &st) != 0) return CopyMethod::FAILED;
+
+    off_t size = st.st_size;
+    off_t copied = 0;
+
+#ifdef __linux__
+#ifdef FICLONE
+    if (ioctl(dst_fd, FICLONE, src_fd) == 0) return CopyMethod::REFLINK;
+#endif
+
+    // Each fallback picks up wherever the previous one stopped
+    while (copied < size) {
+        loff_t in_off = copied, out_off = copied;
+        ssize_t n = copy_file_range(src_fd, &in_off, dst_fd, &out_off, size - copied, 0);
+        if (n <= 0) {
+            if (n < 0 && !is_unsupported(errno)) return CopyMethod::FAILED;
+            break;
+        }
+        copied += n;
+    }
+    if (copied >= size && size > 0) return CopyMethod::COPY_FILE_RANGE;
+
+    if (copied < size && lseek(dst_fd, copied, SEEK_SET) == copied) {
+        while (copied < size) {
+            off_t in_off = copied;
+            ssize_t n = sendfile(dst_fd, src_fd, &in_off, size - copied);
+            if (n <= 0) {
+                if (n < 0 && !is_unsupported(errno)) return CopyMethod::FAILED;
+                break;
+            }
+            copied += n;
+        }
+        if (copied >= size) return CopyMethod::SENDFILE;
+    }
+#endif
+
+    char buf[65536];
+    while (true) {
+        ssize_t n = pread(src_fd, buf, sizeof(buf), copied);
+        if (n < 0) return CopyMethod::FAILED;
+        if (n == 0) break;
+        for (ssize_t done = 0; done < n;) {
+            ssize_t w = pwrite(dst_fd, buf + done, n - done, copied + done);
+            if (w <= 0) return CopyMethod::FAILED;
+            done += w;
+        }
+        copied += n;
+    }
+    return CopyMethod::READ_WRITE;
+}
+
+CopyMethod copy_file_path(const string& src_path, const string& dst_path) {
+    int src = open(src_path.c_str(), O_RDONLY);
+    if (src == -1) return CopyMethod::FAILED;
+
+    int dst = open(dst_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (dst == -1) {
+        close(src);
+        return CopyMethod::FAILED;
+    }
+
+    CopyMethod method = copy_file_fd(src, dst);
+    close(src);
+    if (close(dst) != 0) method = CopyMethod::FAILED;
+    return method;
+}
+
+const char* copy_method_name(CopyMethod method) {
+    switch (method) {
+        case CopyMethod::REFLINK:         return "reflink";
+        case CopyMethod::COPY_FILE_RANGE: return "copy_file_range";
+        case CopyMethod::SENDFILE:        return "sendfile";
+        case CopyMethod::READ_WRITE:      return "read/write";
+        default:                          return "failed";
+    }
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <string>
+
+using namespace std;
+
+// How the data ended up being copied
+enum class CopyMethod {
+    REFLINK,          // ioctl(FICLONE): copy-on-write clone, no data moved
+    COPY_FILE_RANGE,  // in-kernel copy
+    SENDFILE,         // in-kernel copy through the page cache
+    READ_WRITE,       // plain userspace copy
+    FAILED
+};
+
+// Copy the whole content of src_fd into dst_fd (which should be empty),
+// trying the cheapest mechanism first and falling back as needed
+CopyMethod copy_file_fd(int src_fd, int dst_fd);
+
+// Path based wrapper: dst is created or truncated
+CopyMethod copy_file_path(const string& src_path, const string& dst_path);
+
+const char* copy_method_name(CopyMethod method);
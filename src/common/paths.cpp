@@ -1,17 +1,16 @@
 #include "paths.h"
 #include <string>
 #include <cstdlib>
+#include <cstring>
 #include <unistd.h>
 #include <limits.h>
 #include <sys/stat.h>
 
 using namespace std;
 
-static string backend_root_cached;
-
-// Get the absolute path to runtime/data, creating it if needed
-static string get_backend_root() {
-    if (!backend_root_cached.empty()) return backend_root_cached;
+// Work out the absolute path to runtime/data, creating it if needed
+static string compute_backend_root() {
+    string backend_root_cached;
 
     // Try environment variable first (you can set this before mounting)
     char *env_root = getenv("VFS_BACKEND_ROOT");
@@ -36,33 +35,67 @@ static string get_backend_root() {
         mkdir(backend_root_cached.c_str(), 0755);  // Create runtime/data/
     }
 
+    // Remove trailing slash from backend if present
+    if (!backend_root_cached.empty() && backend_root_cached.back() == '/') {
+        backend_root_cached.pop_back();
+    }
+
     return backend_root_cached;
 }
 
+// Computed once; the function-local static makes the first call safe
+// even when several FUSE worker threads race into it
+static const string& get_backend_root() {
+    static const string root = compute_backend_root();
+    return root;
+}
+
 string vfs_backend_path(const char *virtual_path) {
-    string backend = get_backend_root();
-    
-    // Remove trailing slash from backend if present
-    if (!backend.empty() && backend.back() == '/') {
-        backend.pop_back();
-    }
+    const string& backend = get_backend_root();
 
-    // Handle the virtual path
-    string vp(virtual_path);
-    
-    // Root directory case
-    if (vp == "/") {
-        return backend;
-    }
+    // Skip the leading slash (we add it back); the root maps to the backend itself
+    if (*virtual_path == '/') virtual_path++;
+    if (*virtual_path == '\0') return backend;
 
-    // Remove leading slash if present (we'll add it back)
-    if (!vp.empty() && vp.front() == '/') {
-        vp.erase(0, 1);
-    }
+    string path;
+    path.reserve(backend.size() + 1 + strlen(virtual_path));
+    path += backend;
+    path += '/';
+    path += virtual_path;
+    return path;
+}
+
+// Whether `path` is `prefix` or lies below it
+static bool under(const string& path, const string& prefix) {
+    return path.compare(0, prefix.size(), prefix) == 0 &&
+           (path.size() == prefix.size() || path[prefix.size()] == '/');
+}
+
+string renamed_path(const string& path, const string& from, const string& to, bool exchange) {
+    if (under(path, from)) return to + path.substr(from.size());
+    if (exchange && under(path, to)) return from + path.substr(to.size());
+    return path;
+}
 
-    // Return the combined path
-    if (vp.empty()) {
-        return backend;
+string normalize_path(const string& path) {
+    string clean;
+    clean.reserve(path.size());
+    if (!path.empty() && path[0] != '/') clean += '.';
+    size_t pos = 0;
+    while (pos < path.size()) {
+        size_t end = path.find('/', pos);
+        if (end == string::npos) end = path.size();
+        if (end > pos && path.compare(pos, end - pos, ".") != 0) {
+            clean += '/';
+            clean.append(path, pos, end - pos);
+        }
+        pos = end + 1;
     }
-    return backend + "/" + vp;
-}
\ No newline at end of file
+    return clean;
+}
+
+bool path_below(const string& path, const string& root, string& rel) {
+    if (root.empty() || !under(path, root)) return false;
+    rel = path.size() == root.size() ? "/" : path.substr(root.size());
+    return true;
+}
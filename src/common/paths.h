@@ -4,3 +4,14 @@
 using namespace std;
 
 string vfs_backend_path(const char *virtual_path);
+
+// Where `path` is after `from` was renamed to `to` (or exchanged with it):
+// the same path with the moved prefix replaced, or `path` if unaffected
+string renamed_path(const string& path, const string& from, const string& to, bool exchange);
+
+// "a//b" and "a/./b" name the same file as "a/b"
+string normalize_path(const string& path);
+
+// Where a normalized `path` lies below a normalized `root`: "/a/b" ("/" for
+// the root itself); false if it is outside
+bool path_below(const string& path, const string& root, string& rel);
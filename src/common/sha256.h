@@ -0,0 +1,29 @@
+#pragma once
+
+#include <string>
+#include <cstdint>
+#include <cstddef>
+
+using namespace std;
+
+// Minimal streaming SHA-256, used to address version content by hash
+class Sha256 {
+public:
+    Sha256();
+
+    void update(const void* data, size_t len);
+
+    // Finish the digest and return it as 64 lowercase hex characters
+    string final_hex();
+
+    // Convenience: hash a whole buffer in one call
+    static string hex(const void* data, size_t len);
+
+private:
+    uint32_t state[8];
+    uint8_t block[64];
+    size_t block_len;
+    uint64_t total_len;
+
+    void transform(const uint8_t* chunk);
+};
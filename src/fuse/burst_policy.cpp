@@ -0,0 +1,90 @@
+#include "burst_policy.h"
+#include <chrono>
+#include <mutex>
+#include <unordered_map>
+
+using namespace std;
+
+using Clock = chrono::steady_clock;
+
+struct Burst {
+    Clock::time_point started;
+    Clock::time_point last;
+};
+
+// Ended bursts are swept once the table grows past this many entries
+static const size_t SWEEP_THRESHOLD = 4096;
+
+static mutex policy_mutex;
+static unordered_map<string, Burst> bursts;
+static Clock::duration window = Clock::duration::zero();
+static Clock::duration max_burst = Clock::duration::zero();
+static uint64_t versions_taken = 0;
+static uint64_t coalesced = 0;
+
+static Clock::duration seconds_to_duration(double seconds) {
+    return chrono::duration_cast<Clock::duration>(chrono::duration<double>(seconds));
+}
+
+static bool is_open(const Burst& burst, Clock::time_point now) {
+    return now - burst.last < window && now - burst.started < max_burst;
+}
+
+static void sweep(Clock::time_point now) {
+    for (auto it = bursts.begin(); it != bursts.end();) {
+        if (is_open(it->second, now)) ++it;
+        else it = bursts.erase(it);
+    }
+}
+
+void BurstPolicy::configure(double window_seconds, double max_burst_seconds) {
+    lock_guard<mutex> lock(policy_mutex);
+    window = seconds_to_duration(window_seconds > 0 ? window_seconds : 0);
+    max_burst = seconds_to_duration(max_burst_seconds > window_seconds ? max_burst_seconds : window_seconds);
+    bursts.clear();
+}
+
+bool BurstPolicy::enabled() {
+    lock_guard<mutex> lock(policy_mutex);
+    return window > Clock::duration::zero();
+}
+
+bool BurstPolicy::should_version(const string& backend_path) {
+    lock_guard<mutex> lock(policy_mutex);
+    if (window == Clock::duration::zero()) {
+        versions_taken++;
+        return true;
+    }
+
+    Clock::time_point now = Clock::now();
+    auto it = bursts.find(backend_path);
+    if (it != bursts.end() && is_open(it->second, now)) {
+        it->second.last = now;
+        coalesced++;
+        return false;
+    }
+
+    if (it == bursts.end() && bursts.size() >= SWEEP_THRESHOLD) sweep(now);
+    bursts[backend_path] = Burst{now, now};
+    versions_taken++;
+    return true;
+}
+
+void BurstPolicy::touched(const string& backend_path) {
+    lock_guard<mutex> lock(policy_mutex);
+    if (window == Clock::duration::zero()) return;
+
+    Clock::time_point now = Clock::now();
+    auto it = bursts.find(backend_path);
+    if (it != bursts.end() && is_open(it->second, now)) it->second.last = now;
+}
+
+void BurstPolicy::forget(const string& backend_path) {
+    lock_guard<mutex> lock(policy_mutex);
+    bursts.erase(backend_path);
+}
+
+BurstPolicyStats BurstPolicy::get_stats() {
+    lock_guard<mutex> lock(policy_mutex);
+    return BurstPolicyStats{versions_taken, coalesced, bursts.size()};
+}
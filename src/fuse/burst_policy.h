@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+using namespace std;
+
+struct BurstPolicyStats {
+    uint64_t versions;    // Modifications that took a new version
+    uint64_t coalesced;   // Modifications folded into the version before them
+    size_t tracked;       // Paths with a burst still open
+};
+
+// Decides whether a modification of a file needs a new version, or is part
+// of a burst of saves whose pre-image is already stored. A burst stays open
+// while the file keeps being modified within `window` of the previous
+// modification, up to `max_burst` after it started; all of it then ends up
+// as one version (the content before the burst). A window of 0 turns
+// coalescing off: every modification takes a version.
+class BurstPolicy {
+public:
+    static void configure(double window_seconds, double max_burst_seconds);
+
+    static bool enabled();
+
+    // A modification of `backend_path` is about to happen; returns true if
+    // the caller must take a version first. Either way the burst is extended.
+    static bool should_version(const string& backend_path);
+
+    // The file was modified without asking (e.g. a write to a handle whose
+    // version was settled at open); keeps an open burst going
+    static void touched(const string& backend_path);
+
+    // The path no longer names the same file (unlinked, renamed)
+    static void forget(const string& backend_path);
+
+    static BurstPolicyStats get_stats();
+};
@@ -0,0 +1,39 @@
+#include "cache_options.h"
+#include <cstddef>
+#include <iostream>
+
+using namespace std;
+
+static CacheConfig config;
+
+#define CACHE_OPT(t, p, v) { t, offsetof(CacheConfig, p), v }
+
+static const struct fuse_opt cache_opts[] = {
+    CACHE_OPT("attr_timeout=%lf", attr_timeout, 0),
+    CACHE_OPT("entry_timeout=%lf", entry_timeout, 0),
+    CACHE_OPT("negative_timeout=%lf", negative_timeout, 0),
+    CACHE_OPT("kernel_cache", kernel_cache, 1),
+    CACHE_OPT("auto_cache", auto_cache, 1),
+    CACHE_OPT("writeback_cache", writeback_cache, 1),
+    FUSE_OPT_END
+};
+
+bool CacheOptions::parse(struct fuse_args *args) {
+    // Options not listed above are left in `args` for libfuse
+    return fuse_opt_parse(args, &config, cache_opts, nullptr) == 0;
+}
+
+const CacheConfig& CacheOptions::get() {
+    return config;
+}
+
+void CacheOptions::help() {
+    cout << "Caching options:" << endl
+         << "    -o attr_timeout=T      cache attributes for T seconds (default 1.0)" << endl
+         << "    -o entry_timeout=T     cache name lookups for T seconds (default 1.0)" << endl
+         << "    -o negative_timeout=T  cache failed lookups for T seconds (default 0)" << endl
+         << "    -o kernel_cache        keep file data cached across opens" << endl
+         << "    -o auto_cache          keep file data unless the file changed" << endl
+         << "    -o writeback_cache     let the kernel batch writes" << endl
+         << endl;
+}
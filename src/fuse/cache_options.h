@@ -0,0 +1,29 @@
+#pragma once
+
+#define FUSE_USE_VERSION 30
+
+#include <fuse3/fuse_opt.h>
+
+using namespace std;
+
+// How long and how much the kernel may cache, set with -o on the command line
+struct CacheConfig {
+    double attr_timeout = 1.0;      // Seconds attributes stay valid
+    double entry_timeout = 1.0;     // Seconds name lookups stay valid
+    double negative_timeout = 0.0;  // Seconds a failed lookup is remembered
+    int kernel_cache = 0;           // Never drop file data on open
+    int auto_cache = 0;             // Drop file data on open only if mtime/size changed
+    int writeback_cache = 0;        // Let the kernel batch writes
+};
+
+// Caching options shared by both mounts
+class CacheOptions {
+public:
+    // Take the caching options out of the mount arguments; false on a malformed option
+    static bool parse(struct fuse_args *args);
+
+    static const CacheConfig& get();
+
+    // Print the options for --help
+    static void help();
+};
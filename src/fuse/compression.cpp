@@ -0,0 +1,131 @@
+#include "compression.h"
+#include <unistd.h>
+#include <algorithm>
+#include <cstring>
+
+using namespace std;
+
+static const size_t CHUNK = 65536;
+
+// Extensions whose content is already compressed; deflating them only costs CPU
+static const char* const PRECOMPRESSED[] = {
+    "gz", "tgz", "bz2", "xz", "zst", "lz4", "zip", "7z", "rar", "jar",
+    "jpg", "jpeg", "png", "gif", "webp", "heic",
+    "mp3", "mp4", "m4a", "mkv", "mov", "avi", "ogg", "flac", "webm",
+    "docx", "xlsx", "pptx", "odt", "epub", "pdf"
+};
+
+const char* codec_name(Codec codec) {
+    switch (codec) {
+        case Codec::NONE:         return "none";
+        case Codec::DEFLATE_FAST: return "deflate-fast";
+        case Codec::DEFLATE_BEST: return "deflate-best";
+    }
+    return "unknown";
+}
+
+const char* codec_suffix(Codec codec) {
+    switch (codec) {
+        case Codec::NONE:         return "";
+        case Codec::DEFLATE_FAST: return ".zf";
+        case Codec::DEFLATE_BEST: return ".zb";
+    }
+    return "";
+}
+
+Codec codec_for_file(const string& path) {
+    size_t slash = path.find_last_of('/');
+    size_t dot = path.find_last_of('.');
+    if (dot == string::npos || (slash != string::npos && dot < slash)) return Codec::DEFLATE_FAST;
+
+    string ext = path.substr(dot + 1);
+    transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+    for (const char* known : PRECOMPRESSED) {
+        if (ext == known) return Codec::NONE;
+    }
+    return Codec::DEFLATE_FAST;
+}
+
+Deflater::Deflater(int out_fd, Codec codec) : fd(out_fd) {
+    memset(&zs, 0, sizeof(zs));
+    int level = (codec == Codec::DEFLATE_BEST) ? Z_BEST_COMPRESSION : Z_BEST_SPEED;
+    ok = deflateInit(&zs, level) == Z_OK;
+}
+
+Deflater::~Deflater() {
+    deflateEnd(&zs);
+}
+
+bool Deflater::pump(int flush) {
+    unsigned char out[CHUNK];
+    int ret;
+    do {
+        zs.next_out = out;
+        zs.avail_out = sizeof(out);
+        ret = deflate(&zs, flush);
+        if (ret == Z_STREAM_ERROR) return false;
+
+        size_t have = sizeof(out) - zs.avail_out;
+        size_t done = 0;
+        while (done < have) {
+            ssize_t n = ::write(fd, out + done, have - done);
+            if (n <= 0) return false;
+            done += n;
+        }
+        written += have;
+    } while (zs.avail_out == 0);
+    return flush != Z_FINISH || ret == Z_STREAM_END;
+}
+
+bool Deflater::write(const char* data, size_t len) {
+    while (ok && len > 0) {
+        // avail_in is 32-bit; feed very large buffers in pieces
+        size_t piece = min(len, (size_t)1 << 30);
+        zs.next_in = (Bytef*)data;
+        zs.avail_in = piece;
+        ok = pump(Z_NO_FLUSH);
+        data += piece;
+        len -= piece;
+    }
+    return ok;
+}
+
+bool Deflater::finish() {
+    if (ok) ok = pump(Z_FINISH);
+    return ok;
+}
+
+bool inflate_fd(int in_fd, const function<bool(const char*, size_t)>& sink) {
+    z_stream zs;
+    memset(&zs, 0, sizeof(zs));
+    if (inflateInit(&zs) != Z_OK) return false;
+
+    unsigned char in[CHUNK];
+    unsigned char out[CHUNK];
+    int ret = Z_OK;
+
+    while (ret != Z_STREAM_END) {
+        ssize_t n = read(in_fd, in, sizeof(in));
+        if (n <= 0) break;  // Error, or truncated stream
+        zs.next_in = in;
+        zs.avail_in = n;
+
+        do {
+            zs.next_out = out;
+            zs.avail_out = sizeof(out);
+            ret = inflate(&zs, Z_NO_FLUSH);
+            if (ret != Z_OK && ret != Z_STREAM_END) {
+                inflateEnd(&zs);
+                return false;
+            }
+            size_t have = sizeof(out) - zs.avail_out;
+            if (have > 0 && !sink((const char*)out, have)) {
+                inflateEnd(&zs);
+                return false;
+            }
+        } while (zs.avail_out == 0 && ret != Z_STREAM_END);
+    }
+
+    inflateEnd(&zs);
+    return ret == Z_STREAM_END;
+}
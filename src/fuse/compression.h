@@ -0,0 +1,50 @@
+#pragma once
+
+#include <string>
+#include <functional>
+#include <cstdint>
+#include <zlib.h>
+
+using namespace std;
+
+// How an object's data is stored on disk
+enum class Codec {
+    NONE,          // Raw bytes (already-compressed formats, or when compression does not pay)
+    DEFLATE_FAST,  // zlib level 1: cheap enough for the snapshot path
+    DEFLATE_BEST   // zlib level 9: for versions that have aged out of the recent window
+};
+
+const char* codec_name(Codec codec);
+
+// Suffix of an object file stored with this codec ("" for raw objects)
+const char* codec_suffix(Codec codec);
+
+// Codec for new versions of a file, chosen by file type: formats that are
+// already compressed are stored raw, everything else with the fast codec
+Codec codec_for_file(const string& path);
+
+// Streaming compressor writing a zlib stream to a file descriptor
+class Deflater {
+public:
+    Deflater(int out_fd, Codec codec);
+    ~Deflater();
+
+    bool write(const char* data, size_t len);
+
+    // Flush the end of the stream; the output is incomplete until this succeeds
+    bool finish();
+
+    uint64_t bytes_out() const { return written; }
+
+private:
+    z_stream zs;
+    int fd;
+    bool ok;
+    uint64_t written = 0;
+
+    bool pump(int flush);
+};
+
+// Decompress a zlib stream from a file descriptor, handing each chunk of
+// output to `sink` (which returns false to abort)
+bool inflate_fd(int in_fd, const function<bool(const char*, size_t)>& sink);
@@ -0,0 +1,161 @@
+#include "delta.h"
+#include <unordered_map>
+#include <vector>
+#include <cstring>
+#include <cstdint>
+
+using namespace std;
+
+static const char DELTA_MAGIC[4] = {'V', 'T', 'D', '1'};
+static const char OP_COPY = 'C';
+static const char OP_INSERT = 'I';
+
+// Don't chase more than this many candidate blocks per checksum bucket
+static const size_t MAX_CANDIDATES = 8;
+
+static void put_varint(string& out, uint64_t v) {
+    while (v >= 0x80) {
+        out += (char)((v & 0x7f) | 0x80);
+        v >>= 7;
+    }
+    out += (char)v;
+}
+
+static bool get_varint(const string& in, size_t& pos, uint64_t& v) {
+    v = 0;
+    for (int shift = 0; shift < 64 && pos < in.size(); shift += 7) {
+        uint8_t byte = (uint8_t)in[pos++];
+        v |= (uint64_t)(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) return true;
+    }
+    return false;
+}
+
+// rsync-style weak checksum that can be rolled one byte at a time
+struct RollingChecksum {
+    uint32_t a = 0, b = 0;
+    size_t len = 0;
+
+    void init(const uint8_t* p, size_t n) {
+        a = b = 0;
+        len = n;
+        for (size_t i = 0; i < n; i++) {
+            a += p[i];
+            b += (uint32_t)(n - i) * p[i];
+        }
+    }
+
+    void roll(uint8_t out, uint8_t in) {
+        a = a - out + in;
+        b = b - (uint32_t)len * out + a;
+    }
+
+    uint32_t value() const { return (a & 0xffff) | (b << 16); }
+};
+
+static void emit_insert(string& out, const string& target, size_t from, size_t to) {
+    if (to <= from) return;
+    out += OP_INSERT;
+    put_varint(out, to - from);
+    out.append(target, from, to - from);
+}
+
+static void emit_copy(string& out, size_t offset, size_t len) {
+    out += OP_COPY;
+    put_varint(out, offset);
+    put_varint(out, len);
+}
+
+string delta_encode(const string& base, const string& target, size_t block_size) {
+    string out(DELTA_MAGIC, sizeof(DELTA_MAGIC));
+    put_varint(out, target.size());
+
+    const uint8_t* b = (const uint8_t*)base.data();
+    const uint8_t* t = (const uint8_t*)target.data();
+    size_t n = target.size();
+
+    if (block_size == 0 || base.size() < block_size || n < block_size) {
+        emit_insert(out, target, 0, n);
+        return out;
+    }
+
+    // Index the base at block boundaries
+    unordered_map<uint32_t, vector<size_t>> index;
+    index.reserve(base.size() / block_size);
+    RollingChecksum rc;
+    for (size_t off = 0; off + block_size <= base.size(); off += block_size) {
+        rc.init(b + off, block_size);
+        auto& bucket = index[rc.value()];
+        if (bucket.size() < MAX_CANDIDATES) bucket.push_back(off);
+    }
+
+    size_t pos = 0, literal_start = 0;
+    rc.init(t, block_size);
+
+    while (pos + block_size <= n) {
+        bool matched = false;
+        auto it = index.find(rc.value());
+        if (it != index.end()) {
+            for (size_t off : it->second) {
+                if (memcmp(b + off, t + pos, block_size) != 0) continue;
+
+                // Grow the match forwards, then backwards into pending literals
+                size_t len = block_size;
+                while (pos + len < n && off + len < base.size() && b[off + len] == t[pos + len]) len++;
+                while (pos > literal_start && off > 0 && b[off - 1] == t[pos - 1]) {
+                    pos--; off--; len++;
+                }
+
+                emit_insert(out, target, literal_start, pos);
+                emit_copy(out, off, len);
+                pos += len;
+                literal_start = pos;
+                matched = true;
+                break;
+            }
+        }
+
+        if (matched) {
+            if (pos + block_size <= n) rc.init(t + pos, block_size);
+            continue;
+        }
+
+        if (pos + block_size < n) rc.roll(t[pos], t[pos + block_size]);
+        pos++;
+    }
+
+    emit_insert(out, target, literal_start, n);
+    return out;
+}
+
+bool delta_apply(const string& base, const string& delta, string& out) {
+    out.clear();
+    if (delta.size() < sizeof(DELTA_MAGIC) || memcmp(delta.data(), DELTA_MAGIC, sizeof(DELTA_MAGIC)) != 0) {
+        return false;
+    }
+
+    size_t pos = sizeof(DELTA_MAGIC);
+    uint64_t target_size;
+    if (!get_varint(delta, pos, target_size)) return false;
+    out.reserve(target_size);
+
+    while (pos < delta.size()) {
+        char op = delta[pos++];
+        if (op == OP_COPY) {
+            uint64_t offset, len;
+            if (!get_varint(delta, pos, offset) || !get_varint(delta, pos, len)) return false;
+            if (offset > base.size() || len > base.size() - offset) return false;
+            out.append(base, offset, len);
+        } else if (op == OP_INSERT) {
+            uint64_t len;
+            if (!get_varint(delta, pos, len)) return false;
+            if (len > delta.size() - pos) return false;
+            out.append(delta, pos, len);
+            pos += len;
+        } else {
+            return false;
+        }
+    }
+
+    return out.size() == target_size;
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <string>
+#include <cstddef>
+
+using namespace std;
+
+// Binary deltas between two versions of a file.
+// The encoder indexes the base in fixed-size blocks and slides a rolling
+// checksum over the target (rsync-style) to find reusable ranges; the
+// result is a list of COPY (from base) and INSERT (literal) operations.
+
+// Default block size used for matching
+const size_t DELTA_BLOCK_SIZE = 64;
+
+// Encode `target` as a delta against `base`
+string delta_encode(const string& base, const string& target, size_t block_size = DELTA_BLOCK_SIZE);
+
+// Rebuild the target by applying `delta` to `base`
+// Returns false if the delta is malformed or does not match the base
+bool delta_apply(const string& base, const string& delta, string& out);
@@ -0,0 +1,156 @@
+#include "dir_cache.h"
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <cstring>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+
+using namespace std;
+
+struct DirEntry {
+    string virtual_dir;
+    shared_ptr<CachedDir> dir;
+};
+
+static mutex cache_mutex;
+static shared_ptr<CachedDir> root;
+static list<DirEntry> lru;  // Most recently used at the front
+static unordered_map<string, list<DirEntry>::iterator> index_by_path;
+static size_t capacity = 256;
+static uint64_t generation = 0;  // Bumped by invalidate()
+static uint64_t hits = 0, misses = 0, evictions = 0;
+
+CachedDir::~CachedDir() {
+    if (fd != -1) close(fd);
+}
+
+// Caller holds cache_mutex
+static void evict_to(size_t max_entries) {
+    while (lru.size() > max_entries) {
+        index_by_path.erase(lru.back().virtual_dir);
+        lru.pop_back();
+        evictions++;
+    }
+}
+
+bool DirCache::init(const string& backend_root) {
+    auto dir = make_shared<CachedDir>();
+    dir->fd = open(backend_root.c_str(), O_PATH | O_DIRECTORY);
+    if (dir->fd == -1) return false;
+
+    lock_guard<mutex> lock(cache_mutex);
+    root = dir;
+    return true;
+}
+
+void DirCache::clear() {
+    lock_guard<mutex> lock(cache_mutex);
+    index_by_path.clear();
+    lru.clear();
+    root.reset();
+}
+
+void DirCache::set_capacity(size_t max_entries) {
+    lock_guard<mutex> lock(cache_mutex);
+    capacity = max_entries;
+    evict_to(capacity);
+}
+
+shared_ptr<CachedDir> DirCache::parent_of(const char* virtual_path, const char*& name) {
+    const char* slash = strrchr(virtual_path, '/');
+    if (!slash || slash[1] == '\0') {
+        // The root itself
+        name = ".";
+        return get("");
+    }
+    name = slash + 1;
+    return get(string(virtual_path, slash - virtual_path));
+}
+
+shared_ptr<CachedDir> DirCache::get(const string& virtual_dir) {
+    shared_ptr<CachedDir> base;
+    size_t base_len = 0;
+    uint64_t seen_generation;
+    {
+        lock_guard<mutex> lock(cache_mutex);
+        if (virtual_dir.empty() || virtual_dir == "/") {
+            if (!root) errno = ESTALE;
+            return root;
+        }
+
+        auto it = index_by_path.find(virtual_dir);
+        if (it != index_by_path.end()) {
+            hits++;
+            lru.splice(lru.begin(), lru, it->second);
+            return it->second->dir;
+        }
+        misses++;
+
+        // Start from the deepest ancestor that is already open
+        base = root;
+        size_t cut = virtual_dir.size();
+        while ((cut = virtual_dir.rfind('/', cut - 1)) != string::npos && cut > 0) {
+            auto ancestor = index_by_path.find(virtual_dir.substr(0, cut));
+            if (ancestor != index_by_path.end()) {
+                base = ancestor->second->dir;
+                base_len = cut;
+                break;
+            }
+        }
+        seen_generation = generation;
+    }
+    if (!base) {
+        errno = ESTALE;
+        return nullptr;
+    }
+
+    size_t rel_start = base_len;
+    while (rel_start < virtual_dir.size() && virtual_dir[rel_start] == '/') rel_start++;
+
+    auto dir = make_shared<CachedDir>();
+    dir->fd = openat(base->fd, virtual_dir.c_str() + rel_start, O_PATH | O_DIRECTORY);
+    if (dir->fd == -1) return nullptr;
+
+    lock_guard<mutex> lock(cache_mutex);
+    // A rename or rmdir since the lookup may have moved what we opened;
+    // use the handle for this request but do not cache it
+    if (capacity == 0 || generation != seen_generation) return dir;
+
+    auto it = index_by_path.find(virtual_dir);
+    if (it != index_by_path.end()) return it->second->dir;  // Another thread won
+
+    lru.push_front(DirEntry{virtual_dir, dir});
+    index_by_path[virtual_dir] = lru.begin();
+    evict_to(capacity);
+    return dir;
+}
+
+void DirCache::invalidate(const string& virtual_dir) {
+    lock_guard<mutex> lock(cache_mutex);
+    generation++;
+
+    for (auto it = lru.begin(); it != lru.end();) {
+        const string& path = it->virtual_dir;
+        bool beneath = path.compare(0, virtual_dir.size(), virtual_dir) == 0 &&
+                       (path.size() == virtual_dir.size() || path[virtual_dir.size()] == '/');
+        if (beneath) {
+            index_by_path.erase(path);
+            it = lru.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+DirCacheStats DirCache::get_stats() {
+    lock_guard<mutex> lock(cache_mutex);
+    DirCacheStats stats;
+    stats.hits = hits;
+    stats.misses = misses;
+    stats.evictions = evictions;
+    stats.entries = lru.size();
+    stats.capacity = capacity;
+    return stats;
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+using namespace std;
+
+// An O_PATH handle on a backend directory
+struct CachedDir {
+    int fd = -1;
+    ~CachedDir();
+};
+
+struct DirCacheStats {
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t evictions;
+    size_t entries;
+    size_t capacity;
+};
+
+// LRU cache of directory handles for the path-based mount, keyed by virtual
+// path. Operations resolve the parent directory once and then work with
+// *at() calls relative to it, so the kernel does not re-walk the whole
+// backend path (and no absolute path string is built) on every request.
+// Entries are dropped when the mount renames or removes a directory;
+// changes made to the backend behind the mount's back are not noticed.
+class DirCache {
+public:
+    // Open the backend root; false if it cannot be opened
+    static bool init(const string& backend_root);
+
+    // Close every handle
+    static void clear();
+
+    // Maximum number of directories kept open (besides the root)
+    static void set_capacity(size_t max_entries);
+
+    // Handle on the directory containing `virtual_path`; `name` is set to
+    // the last component ("." for the root). nullptr with errno set on failure.
+    static shared_ptr<CachedDir> parent_of(const char* virtual_path, const char*& name);
+
+    // Handle on a directory ("" or "/" is the root)
+    static shared_ptr<CachedDir> get(const string& virtual_dir);
+
+    // Forget a directory and everything cached beneath it
+    static void invalidate(const string& virtual_dir);
+
+    static DirCacheStats get_stats();
+};
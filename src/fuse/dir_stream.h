@@ -0,0 +1,46 @@
+#pragma once
+
+#include <dirent.h>
+#include <sys/types.h>
+#include <errno.h>
+#include <mutex>
+
+using namespace std;
+
+// An open directory listing, stored in the FUSE file handle between
+// readdir calls. The entry that did not fit into the previous reply is
+// kept so the next call resumes with it; `offset` is the cookie (d_off)
+// the stream is positioned at, so a readdir at any other offset seeks.
+struct DirStream {
+    mutex lock;
+    DIR *dp = nullptr;
+    off_t offset = 0;
+    struct dirent *entry = nullptr;
+
+    ~DirStream() {
+        if (dp) closedir(dp);
+    }
+
+    // Position the stream for a readdir at `off`
+    void seek(off_t off) {
+        if (off == offset) return;
+        seekdir(dp, off);
+        entry = nullptr;
+        offset = off;
+    }
+
+    // The next entry to return (nullptr at the end or on error, errno tells)
+    struct dirent *peek() {
+        if (!entry) {
+            errno = 0;
+            entry = readdir(dp);
+        }
+        return entry;
+    }
+
+    // The peeked entry was returned to the kernel
+    void consume() {
+        offset = entry->d_off;
+        entry = nullptr;
+    }
+};
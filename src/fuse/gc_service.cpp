@@ -0,0 +1,190 @@
+#include "gc_service.h"
+#include "version_manager.h"
+#include "snapshot_queue.h"
+#include "tree_snapshots.h"
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <iostream>
+
+using namespace std;
+
+// ioprio_set(2) has no glibc wrapper
+static const int IOPRIO_WHO_PROCESS = 1;
+static const int IOPRIO_CLASS_IDLE = 3;
+static const int IOPRIO_CLASS_SHIFT = 13;
+
+// How often a pass waiting on queued snapshots looks again, and how long
+// it waits for them per file before pruning anyway
+static const chrono::milliseconds BUSY_POLL(50);
+static const chrono::milliseconds MAX_YIELD(1000);
+
+static mutex gc_mutex;
+static condition_variable wake;  // Signalled on stop
+static thread worker;
+static bool stopping = false;
+
+static RetentionPolicy policy;
+static string backend_root;
+static chrono::seconds interval;
+static uint64_t rate;
+static GcStats stats;
+
+// Sleep unless stopped first; false once stopping
+static bool pause_for(chrono::milliseconds duration) {
+    unique_lock<mutex> lock(gc_mutex);
+    return !wake.wait_for(lock, duration, [] { return stopping; });
+}
+
+static bool is_stopping() {
+    lock_guard<mutex> lock(gc_mutex);
+    return stopping;
+}
+
+// Apply the policy to one file; false once stopping
+static bool prune_file(const string& path, GcStats& pass) {
+    // Foreground versioning goes first, but under steady writes the queue
+    // never drains: then the pass only slows down (one file per MAX_YIELD)
+    for (auto waited = chrono::milliseconds(0); waited < MAX_YIELD && SnapshotQueue::pending() > 0;
+         waited += BUSY_POLL) {
+        if (!pause_for(BUSY_POLL)) return false;
+    }
+    if (is_stopping()) return false;
+
+    vector<FileVersion> versions = VersionManager::get_versions(path);
+    vector<int> doomed = policy.select(versions, time(nullptr));
+
+    // Versions a tree snapshot reads are kept whatever their age
+    if (!doomed.empty() && TreeSnapshots::active()) {
+        vector<bool> pinned = TreeSnapshots::pinned(versions);
+        vector<int> kept;
+        for (int number : doomed) {
+            bool pin = false;
+            for (size_t i = 0; i < versions.size(); i++) {
+                if (versions[i].version_number == number) pin = pinned[i];
+            }
+            if (!pin) kept.push_back(number);
+        }
+        doomed.swap(kept);
+    }
+    if (doomed.empty()) return true;
+
+    PruneResult result = VersionManager::delete_versions(path, doomed);
+    if (result.removed == 0) return true;
+
+    pass.files_pruned++;
+    pass.versions_removed += result.removed;
+    pass.bytes_reclaimed += result.reclaimed;
+    pass.bytes_rewritten += result.rewritten;
+
+    // Pay for the I/O: rebuilt data was read and written, deletions are cheap
+    uint64_t moved = 2 * (uint64_t)result.rewritten;
+    if (rate == 0 || moved == 0) return true;
+    return pause_for(chrono::milliseconds(moved * 1000 / rate));
+}
+
+// Depth-first walk of the live tree; false once stopping
+static bool prune_tree(const string& dir, GcStats& pass) {
+    DIR* dp = opendir(dir.c_str());
+    if (!dp) return true;
+
+    vector<string> subdirs;
+    bool go_on = true;
+    struct dirent* de;
+    while (go_on && (de = readdir(dp)) != nullptr) {
+        string name = de->d_name;
+        if (name == "." || name == "..") continue;
+        string path = dir + "/" + name;
+
+        struct stat st;
+        if (lstat(path.c_str(), &st) != 0) continue;
+        if (S_ISDIR(st.st_mode)) {
+            subdirs.push_back(path);
+        } else if (S_ISREG(st.st_mode)) {
+            go_on = prune_file(path, pass);
+        }
+    }
+    closedir(dp);
+
+    for (const string& sub : subdirs) {
+        if (!go_on) break;
+        go_on = prune_tree(sub, pass);
+    }
+    return go_on;
+}
+
+// Histories whose file is gone from the tree (deleted, or left behind by a
+// directory move); live files were seen by prune_tree
+static bool prune_orphans(GcStats& pass) {
+    bool go_on = true;
+    VersionManager::for_each_history([&](const string& path) {
+        struct stat st;
+        if (lstat(path.c_str(), &st) == 0 && S_ISREG(st.st_mode)) return true;
+        go_on = prune_file(path, pass);
+        return go_on;
+    });
+    return go_on;
+}
+
+static void gc_loop() {
+    // Best effort: the disk serves everyone else first
+    syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, 0, IOPRIO_CLASS_IDLE << IOPRIO_CLASS_SHIFT);
+
+    while (true) {
+        GcStats pass = {};
+        bool finished = prune_tree(backend_root, pass) && prune_orphans(pass);
+        pass.passes = 1;
+
+        {
+            lock_guard<mutex> lock(gc_mutex);
+            stats.passes += pass.passes;
+            stats.files_pruned += pass.files_pruned;
+            stats.versions_removed += pass.versions_removed;
+            stats.bytes_reclaimed += pass.bytes_reclaimed;
+            stats.bytes_rewritten += pass.bytes_rewritten;
+        }
+        if (pass.versions_removed > 0) {
+            cerr << "[VFS] ✓ GC pass: " << pass.versions_removed << " versions of " << pass.files_pruned
+                 << " files removed, " << pass.bytes_reclaimed << " bytes reclaimed ("
+                 << pass.bytes_rewritten << " rewritten)" << endl;
+        }
+
+        if (!finished) return;
+        unique_lock<mutex> lock(gc_mutex);
+        if (wake.wait_for(lock, interval, [] { return stopping; })) return;
+    }
+}
+
+void GarbageCollector::start(const RetentionPolicy& retention, const string& root,
+                             unsigned interval_seconds, uint64_t bytes_per_second) {
+    lock_guard<mutex> lock(gc_mutex);
+    if (worker.joinable() || retention.empty()) return;
+
+    policy = retention;
+    backend_root = root;
+    interval = chrono::seconds(interval_seconds);
+    rate = bytes_per_second;
+    stopping = false;
+    worker = thread(gc_loop);
+}
+
+void GarbageCollector::stop() {
+    {
+        lock_guard<mutex> lock(gc_mutex);
+        if (!worker.joinable()) return;
+        stopping = true;
+    }
+    wake.notify_all();
+    worker.join();
+}
+
+GcStats GarbageCollector::get_stats() {
+    lock_guard<mutex> lock(gc_mutex);
+    return stats;
+}
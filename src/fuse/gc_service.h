@@ -0,0 +1,34 @@
+#pragma once
+
+#include "retention.h"
+#include <cstdint>
+#include <string>
+
+using namespace std;
+
+struct GcStats {
+    uint64_t passes;
+    uint64_t files_pruned;       // Files that lost at least one version
+    uint64_t versions_removed;
+    uint64_t bytes_reclaimed;    // Object store bytes freed
+    uint64_t bytes_rewritten;    // Bytes written rebuilding survivors
+};
+
+// Background thread applying a retention policy to every file's history.
+// A pass walks the backend tree one file at a time, then the histories of
+// files no longer in it. Before each file it gives queued snapshots up to a
+// second to drain; it runs at idle I/O priority and sleeps off the bytes it
+// moved so it never exceeds `rate` bytes per second. Pruning goes
+// through the version store's file locks, so it is safe against the mount
+// (unlike deleting objects from outside).
+class GarbageCollector {
+public:
+    // Start a pass every `interval` seconds; no-op for an empty policy
+    static void start(const RetentionPolicy& policy, const string& backend_root,
+                      unsigned interval, uint64_t rate);
+
+    // Abandon the current pass and wait for the thread
+    static void stop();
+
+    static GcStats get_stats();
+};
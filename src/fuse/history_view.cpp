@@ -0,0 +1,474 @@
+#include "history_view.h"
+#include "version_manager.h"
+#include "object_store.h"
+#include "op_stats.h"
+#include "tree_snapshots.h"
+#include "../common/paths.h"
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <errno.h>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <vector>
+
+using namespace std;
+
+static const char* const HISTORY_DIR_NAME = "history";
+static const char* const STATS_NAME = "stats";
+static const char* const STATS_PROM_NAME = "stats.prom";
+static const char* const SNAPSHOTS_NAME = "snapshots";
+static const char* const AS_OF_NAME = "as-of";
+
+static void dir_attr(struct stat& st, time_t mtime) {
+    memset(&st, 0, sizeof(st));
+    st.st_mode = S_IFDIR | 0555;
+    st.st_nlink = 2;
+    st.st_uid = getuid();
+    st.st_gid = getgid();
+    st.st_mtime = st.st_ctime = st.st_atime = mtime;
+}
+
+// Rendered on open, so the size is unknown until then (like /proc files)
+static void stats_attr(struct stat& st) {
+    memset(&st, 0, sizeof(st));
+    st.st_mode = S_IFREG | 0444;
+    st.st_nlink = 1;
+    st.st_uid = getuid();
+    st.st_gid = getgid();
+    st.st_mtime = st.st_ctime = st.st_atime = time(nullptr);
+}
+
+// The snapshot list, which also takes commands
+static void snapshots_attr(struct stat& st) {
+    stats_attr(st);
+    st.st_mode = S_IFREG | 0644;
+}
+
+static void version_attr(struct stat& st, const FileVersion& version) {
+    memset(&st, 0, sizeof(st));
+    st.st_mode = S_IFREG | 0444;
+    st.st_nlink = 1;
+    st.st_uid = getuid();
+    st.st_gid = getgid();
+    st.st_size = version.size;
+    st.st_blocks = (version.stored_size + 511) / 512;
+    st.st_mtime = st.st_ctime = st.st_atime = version.timestamp;
+}
+
+// "vN" -> N, or 0 if the name is not a version name
+static int parse_version_name(const char* name) {
+    if (name[0] != 'v' || name[1] < '1' || name[1] > '9') return 0;
+    char* end;
+    long n = strtol(name + 1, &end, 10);
+    return (*end == '\0' && n > 0 && n <= 0x7fffffff) ? (int)n : 0;
+}
+
+// A live path names a file with history if it is not a directory and has versions
+static bool has_history(const string& live_path) {
+    string backend = vfs_backend_path(live_path.c_str());
+    struct stat st;
+    if (lstat(backend.c_str(), &st) == 0 && S_ISDIR(st.st_mode)) return false;
+    return VersionManager::get_version_count(backend) > 0;
+}
+
+static bool find_version(const string& live_path, int number, FileVersion& version) {
+    vector<FileVersion> versions = VersionManager::get_versions(vfs_backend_path(live_path.c_str()));
+    for (const FileVersion& v : versions) {
+        // A record that the path did not exist has no content to show
+        if (v.version_number == number && !(v.flags & VERSION_FLAG_ABSENT)) {
+            version = v;
+            return true;
+        }
+    }
+    return false;
+}
+
+static time_t newest_timestamp(const string& live_path) {
+    vector<FileVersion> versions = VersionManager::get_versions(vfs_backend_path(live_path.c_str()));
+    return versions.empty() ? 0 : versions.back().timestamp;
+}
+
+// Unix seconds, "YYYY-MM-DD" or "YYYY-MM-DDTHH:MM:SS" (local time)
+static bool parse_time(const string& text, time_t& when) {
+    if (text.empty()) return false;
+    if (text.find_first_not_of("0123456789") == string::npos) {
+        when = strtoll(text.c_str(), nullptr, 10);
+        return true;
+    }
+    for (const char* format : {"%Y-%m-%dT%H:%M:%S", "%Y-%m-%d"}) {
+        struct tm tm;
+        memset(&tm, 0, sizeof(tm));
+        const char* end = strptime(text.c_str(), format, &tm);
+        if (end && *end == '\0') {
+            tm.tm_isdst = -1;
+            when = mktime(&tm);
+            return when != -1;
+        }
+    }
+    return false;
+}
+
+// Whether the live file came into being after `when` (false if unknown)
+static bool born_after(const string& backend, time_t when) {
+    struct statx stx;
+    if (statx(AT_FDCWD, backend.c_str(), AT_SYMLINK_NOFOLLOW, STATX_BTIME, &stx) != 0) return false;
+    return (stx.stx_mask & STATX_BTIME) && stx.stx_btime.tv_sec > when;
+}
+
+enum class AsOfState { ABSENT, LIVE, STORED };
+
+// What a file held at `when`. Versions are frozen just before a change, so
+// the first one taken after `when` holds the content the file had then.
+// With none since, the live file is still that content unless it changed
+// without a version, in which case the newest version before `when` is
+// the best there is; a file gone without a version since was already gone.
+static AsOfState state_at(const string& backend, time_t when, FileVersion& version, struct stat& st) {
+    VersionsAround around;
+    bool history = VersionManager::versions_around(backend, when, around);
+    bool live = lstat(backend.c_str(), &st) == 0 && S_ISREG(st.st_mode);
+
+    if (history && around.has_after) {
+        // A file created since has nothing to show for then
+        if (!around.has_before && live && born_after(backend, when)) return AsOfState::ABSENT;
+        if (around.after.flags & VERSION_FLAG_ABSENT) return AsOfState::ABSENT;
+        version = around.after;
+        return AsOfState::STORED;
+    }
+    if (!live) return AsOfState::ABSENT;
+    if (st.st_mtime <= when) return AsOfState::LIVE;
+    if (history && around.has_before) {
+        if (around.before.flags & VERSION_FLAG_ABSENT) return AsOfState::ABSENT;
+        version = around.before;
+        return AsOfState::STORED;
+    }
+    return born_after(backend, when) ? AsOfState::ABSENT : AsOfState::LIVE;
+}
+
+static void as_of_file_attr(struct stat& st, AsOfState state, const FileVersion& version, time_t when) {
+    if (state == AsOfState::STORED) {
+        version_attr(st, version);
+        st.st_mtime = st.st_ctime = st.st_atime = min(version.timestamp, when);
+        return;
+    }
+    // The live stat, read-only like the rest of the namespace
+    st.st_mode = S_IFREG | (st.st_mode & 0444);
+    st.st_nlink = 1;
+}
+
+// Resolve what follows "/as-of"
+static bool resolve_as_of(const char* rest, HistoryNode& node, struct stat& st) {
+    if (*rest == '\0') {
+        node.kind = HistoryKind::AS_OF;
+        node.path = "/";
+        dir_attr(st, 0);
+        return true;
+    }
+    if (*rest != '/') return false;
+
+    const char* slash = strchr(rest + 1, '/');
+    string time_text = slash ? string(rest + 1, slash - rest - 1) : string(rest + 1);
+    time_t when;
+    if (!parse_time(time_text, when)) return false;
+
+    string live = slash ? slash : "/";
+    while (live.size() > 1 && live.back() == '/') live.pop_back();
+    node.as_of = when;
+    node.path = live;
+
+    string backend = vfs_backend_path(live.c_str());
+    struct stat live_st;
+    if (stat(backend.c_str(), &live_st) == 0 && S_ISDIR(live_st.st_mode)) {
+        node.kind = HistoryKind::AS_OF_DIR;
+        dir_attr(st, min(live_st.st_mtime, when));
+        return true;
+    }
+
+    FileVersion version;
+    AsOfState state = state_at(backend, when, version, st);
+    if (state == AsOfState::ABSENT) return false;
+    node.kind = HistoryKind::AS_OF_FILE;
+    node.version = state == AsOfState::STORED ? version.version_number : 0;
+    as_of_file_attr(st, state, version, when);
+    return true;
+}
+
+bool HistoryView::contains(const char* virtual_path) {
+    size_t len = strlen(HISTORY_TOP);
+    return strncmp(virtual_path, HISTORY_TOP, len) == 0 &&
+           (virtual_path[len] == '\0' || virtual_path[len] == '/');
+}
+
+bool HistoryView::shows_history_of(const string& view_path, const string& live_path) {
+    // /history/<path> and its versions
+    string history = string(HISTORY_TOP) + "/" + HISTORY_DIR_NAME + live_path;
+    if (view_path.compare(0, history.size(), history) == 0 &&
+        (view_path.size() == history.size() || view_path[history.size()] == '/')) {
+        return true;
+    }
+
+    // /as-of/<time><path>, for any time
+    string as_of = string(HISTORY_TOP) + "/" + AS_OF_NAME + "/";
+    if (view_path.compare(0, as_of.size(), as_of) != 0) return false;
+    size_t slash = view_path.find('/', as_of.size());
+    return slash != string::npos && view_path.compare(slash, string::npos, live_path) == 0;
+}
+
+bool HistoryView::resolve(const char* virtual_path, HistoryNode& node, struct stat& st) {
+    errno = ENOENT;
+    if (!contains(virtual_path)) return false;
+
+    const char* rest = virtual_path + strlen(HISTORY_TOP);
+    if (*rest == '\0') {
+        node.kind = HistoryKind::TOP;
+        node.path = "/";
+        dir_attr(st, 0);
+        return true;
+    }
+
+    if (strcmp(rest + 1, STATS_NAME) == 0 || strcmp(rest + 1, STATS_PROM_NAME) == 0) {
+        node.kind = HistoryKind::STATS;
+        node.path = rest;
+        node.prometheus = strcmp(rest + 1, STATS_PROM_NAME) == 0;
+        stats_attr(st);
+        return true;
+    }
+
+    size_t as_of_len = strlen(AS_OF_NAME);
+    if (strncmp(rest + 1, AS_OF_NAME, as_of_len) == 0 &&
+        (rest[1 + as_of_len] == '\0' || rest[1 + as_of_len] == '/')) {
+        return resolve_as_of(rest + 1 + as_of_len, node, st);
+    }
+
+    if (strcmp(rest + 1, SNAPSHOTS_NAME) == 0) {
+        node.kind = HistoryKind::SNAPSHOTS;
+        node.path = rest;
+        snapshots_attr(st);
+        return true;
+    }
+
+    // "/history" followed by nothing or a live path
+    size_t name_len = strlen(HISTORY_DIR_NAME);
+    if (rest[0] != '/' || strncmp(rest + 1, HISTORY_DIR_NAME, name_len) != 0) return false;
+    rest += 1 + name_len;
+    if (*rest != '\0' && *rest != '/') return false;
+
+    string live = (*rest == '\0') ? "/" : rest;
+    while (live.size() > 1 && live.back() == '/') live.pop_back();
+
+    // A version entry: the parent is a file with history
+    size_t slash = live.find_last_of('/');
+    int number = parse_version_name(live.c_str() + slash + 1);
+    if (number > 0 && slash > 0) {
+        string file = live.substr(0, slash);
+        FileVersion version;
+        if (has_history(file) && find_version(file, number, version)) {
+            node.kind = HistoryKind::VERSION;
+            node.path = file;
+            node.version = number;
+            version_attr(st, version);
+            return true;
+        }
+    }
+
+    struct stat live_st;
+    string backend = vfs_backend_path(live.c_str());
+    if (stat(backend.c_str(), &live_st) == 0 && S_ISDIR(live_st.st_mode)) {
+        node.kind = HistoryKind::DIR;
+        node.path = live;
+        dir_attr(st, live_st.st_mtime);
+        return true;
+    }
+    if (live != "/" && has_history(live)) {
+        node.kind = HistoryKind::FILE;
+        node.path = live;
+        dir_attr(st, newest_timestamp(live));
+        return true;
+    }
+    return false;
+}
+
+bool HistoryView::list(const HistoryNode& node,
+                       const function<bool(const char* name, const struct stat& st)>& fill) {
+    struct stat st;
+    dir_attr(st, 0);
+    if (!fill(".", st) || !fill("..", st)) return true;
+
+    if (node.kind == HistoryKind::TOP) {
+        if (!fill(HISTORY_DIR_NAME, st) || !fill(AS_OF_NAME, st)) return true;
+        stats_attr(st);
+        if (!fill(STATS_NAME, st) || !fill(STATS_PROM_NAME, st)) return true;
+        snapshots_attr(st);
+        fill(SNAPSHOTS_NAME, st);
+        return true;
+    }
+
+    if (node.kind == HistoryKind::FILE) {
+        vector<FileVersion> versions = VersionManager::get_versions(vfs_backend_path(node.path.c_str()));
+        for (const FileVersion& v : versions) {
+            if (v.flags & VERSION_FLAG_ABSENT) continue;
+            string name = "v" + to_string(v.version_number);
+            version_attr(st, v);
+            if (!fill(name.c_str(), st)) break;
+        }
+        return true;
+    }
+
+    // Times are looked up by name, never listed
+    if (node.kind == HistoryKind::AS_OF) return true;
+
+    if (node.kind == HistoryKind::AS_OF_DIR) {
+        string backend = vfs_backend_path(node.path.c_str());
+        DIR* dp = opendir(backend.c_str());
+        if (!dp) return false;
+
+        string prefix = (backend.back() == '/') ? backend : backend + "/";
+        struct dirent* de;
+        while ((de = readdir(dp)) != nullptr) {
+            if (strcmp(de->d_name, ".") == 0 || strcmp(de->d_name, "..") == 0) continue;
+
+            struct stat child;
+            if (fstatat(dirfd(dp), de->d_name, &child, AT_SYMLINK_NOFOLLOW) != 0) continue;
+            if (S_ISDIR(child.st_mode)) {
+                dir_attr(st, min(child.st_mtime, node.as_of));
+            } else if (S_ISREG(child.st_mode)) {
+                FileVersion version;
+                AsOfState state = state_at(prefix + de->d_name, node.as_of, version, st);
+                if (state == AsOfState::ABSENT) continue;
+                as_of_file_attr(st, state, version, node.as_of);
+            } else {
+                continue;
+            }
+            if (!fill(de->d_name, st)) break;
+        }
+        closedir(dp);
+        return true;
+    }
+
+    if (node.kind != HistoryKind::DIR) {
+        errno = ENOTDIR;
+        return false;
+    }
+
+    // Live subdirectories, and the live files that have history
+    string backend = vfs_backend_path(node.path.c_str());
+    DIR* dp = opendir(backend.c_str());
+    if (!dp) return false;
+
+    string prefix = (node.path == "/") ? "/" : node.path + "/";
+    struct dirent* de;
+    while ((de = readdir(dp)) != nullptr) {
+        if (strcmp(de->d_name, ".") == 0 || strcmp(de->d_name, "..") == 0) continue;
+
+        struct stat child;
+        if (fstatat(dirfd(dp), de->d_name, &child, AT_SYMLINK_NOFOLLOW) != 0) continue;
+        if (S_ISDIR(child.st_mode)) {
+            dir_attr(st, child.st_mtime);
+        } else if (S_ISREG(child.st_mode) && has_history(prefix + de->d_name)) {
+            dir_attr(st, newest_timestamp(prefix + de->d_name));
+        } else {
+            continue;
+        }
+        if (!fill(de->d_name, st)) break;
+    }
+    closedir(dp);
+    return true;
+}
+
+// Put rebuilt content into an anonymous in-memory file
+static int memory_file(const string& content) {
+    int fd = memfd_create("vertext-version", MFD_CLOEXEC);
+    if (fd == -1) return -1;
+
+    size_t done = 0;
+    while (done < content.size()) {
+        ssize_t n = write(fd, content.data() + done, content.size() - done);
+        if (n <= 0) {
+            close(fd);
+            errno = EIO;
+            return -1;
+        }
+        done += n;
+    }
+    return fd;
+}
+
+int HistoryView::open(const HistoryNode& node) {
+    if (node.kind == HistoryKind::STATS) {
+        return memory_file(node.prometheus ? OpStats::render_prometheus() : OpStats::render_text());
+    }
+    if (node.kind == HistoryKind::SNAPSHOTS) {
+        return memory_file(TreeSnapshots::render());
+    }
+    if (node.kind == HistoryKind::AS_OF_FILE && node.version == 0) {
+        return ::open(vfs_backend_path(node.path.c_str()).c_str(), O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+    }
+    if (node.kind != HistoryKind::VERSION && node.kind != HistoryKind::AS_OF_FILE) {
+        errno = EISDIR;
+        return -1;
+    }
+
+    FileVersion version;
+    if (!find_version(node.path, node.version, version)) {
+        errno = ENOENT;
+        return -1;
+    }
+
+    // Full raw versions are served straight from the object store
+    if (version.base_version == 0 && !(version.flags & VERSION_FLAG_JOURNAL)) {
+        int fd = ObjectStore::open_raw(version.object_id);
+        if (fd != -1) return fd;
+    }
+
+    string content;
+    if (!VersionManager::read_version_content(vfs_backend_path(node.path.c_str()), node.version, content)) {
+        errno = EIO;
+        return -1;
+    }
+    return memory_file(content);
+}
+
+// One "create NAME", "delete NAME" or "restore NAME" command
+static int run_snapshot_command(const string& line) {
+    size_t space = line.find(' ');
+    if (space == string::npos) return -EINVAL;
+    string verb = line.substr(0, space);
+    string name = line.substr(space + 1);
+
+    bool ok;
+    if (verb == "create") {
+        TreeSnapshot snapshot;
+        ok = TreeSnapshots::create(name, snapshot);
+    } else if (verb == "delete") {
+        ok = TreeSnapshots::remove(name);
+    } else if (verb == "restore") {
+        TreeRestoreResult result;
+        ok = TreeSnapshots::restore(name, result);
+        if (ok && result.failed > 0) return -EIO;
+    } else {
+        return -EINVAL;
+    }
+    return ok ? 0 : -errno;
+}
+
+ssize_t HistoryView::write(const HistoryNode& node, const char* data, size_t size) {
+    if (node.kind != HistoryKind::SNAPSHOTS) return -EROFS;
+
+    // Commands are whole lines; a write may carry several
+    string text(data, size);
+    size_t pos = 0;
+    while (pos < text.size()) {
+        size_t end = text.find('\n', pos);
+        if (end == string::npos) end = text.size();
+        string line = text.substr(pos, end - pos);
+        pos = end + 1;
+        if (line.empty()) continue;
+
+        int err = run_snapshot_command(line);
+        if (err != 0) return err;
+    }
+    return size;
+}
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <functional>
+#include <string>
+
+using namespace std;
+
+// Read-only view of the version store on the mount:
+//
+//   /.vertext/history/<dir>/...          the live tree's directories
+//   /.vertext/history/<path>/            a file with history, as a directory
+//   /.vertext/history/<path>/vN          version N of that file
+//   /.vertext/as-of/<time>/...           the whole tree as it was at <time>
+//                                        (Unix seconds, YYYY-MM-DD or
+//                                        YYYY-MM-DDTHH:MM:SS in local time)
+//   /.vertext/stats                      operation counters and latencies
+//   /.vertext/stats.prom                 the same in Prometheus text format
+//   /.vertext/snapshots                  whole-tree snapshots; write "create NAME",
+//                                        "delete NAME" or "restore NAME" to it
+//
+// A version's content only changes when its history is rewritten (versions
+// pruned, or the history moved by a rename), so the kernel may cache
+// versions for a long time if the mount invalidates them when that happens.
+// Files whose history is gone from the live tree (deleted) are not listed
+// but can still be opened by name, in both trees. The stats and snapshot
+// files are rendered when opened and report a size of 0, so they must be
+// opened with direct_io. The snapshot file is the only writable entry.
+
+// Top of the namespace on the mount
+const char* const HISTORY_TOP = "/.vertext";
+const char* const HISTORY_TOP_NAME = ".vertext";
+
+// Attribute/entry timeout for version entries, which only change when
+// their history is rewritten
+const double HISTORY_VERSION_TIMEOUT = 3600.0;
+
+enum class HistoryKind {
+    TOP,        // /.vertext
+    DIR,        // /.vertext/history and the live directories below it
+    FILE,       // A file with history, listing its versions
+    VERSION,    // One version of a file
+    STATS,      // A stats report
+    AS_OF,      // /.vertext/as-of (lists nothing; any time can be looked up)
+    AS_OF_DIR,  // A live directory as of a time
+    AS_OF_FILE, // A file's content as of a time
+    SNAPSHOTS   // The tree snapshot list and its commands
+};
+
+struct HistoryNode {
+    HistoryKind kind = HistoryKind::TOP;
+    string path;          // Live virtual path the node stands for ("/" for the history root)
+    int version = 0;      // For VERSION; for AS_OF_FILE, 0 when the live file is still current
+    time_t as_of = 0;     // For AS_OF_DIR and AS_OF_FILE
+    bool prometheus = false;  // For STATS: Prometheus format
+};
+
+class HistoryView {
+public:
+    // Whether a virtual path lies inside the namespace
+    static bool contains(const char* virtual_path);
+
+    // Whether an entry of the namespace shows (part of) the history of the
+    // file at `live_path`: its version list, a version, or an as-of view
+    static bool shows_history_of(const string& view_path, const string& live_path);
+
+    // Resolve a path inside the namespace and fill its attributes;
+    // false with errno set if there is nothing there
+    static bool resolve(const char* virtual_path, HistoryNode& node, struct stat& st);
+
+    // List a directory node (TOP, DIR, FILE or an AS_OF one); `fill`
+    // returns false to stop early
+    static bool list(const HistoryNode& node,
+                     const function<bool(const char* name, const struct stat& st)>& fill);
+
+    // Open a VERSION or AS_OF_FILE node for reading: the stored object itself
+    // when it is kept raw (so reads can be spliced from it), otherwise an
+    // in-memory file holding the rebuilt content; or the live file when it
+    // has not changed since. A STATS node opens a snapshot of the report.
+    // Returns an fd, or -1 with errno set.
+    static int open(const HistoryNode& node);
+
+    // Run the commands in a write to the SNAPSHOTS node, one per line.
+    // Returns `size`, or a negative errno (-EROFS for any other node).
+    static ssize_t write(const HistoryNode& node, const char* data, size_t size);
+};
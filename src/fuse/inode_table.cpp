@@ -0,0 +1,228 @@
+#include "inode_table.h"
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <map>
+#include <shared_mutex>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+static const uint64_t ROOT_NODEID = 1;  // FUSE_ROOT_ID
+
+static shared_mutex table_mutex;
+static unordered_map<uint64_t, shared_ptr<Inode>> nodes;
+static map<pair<dev_t, ino_t>, uint64_t> by_key;
+static unordered_map<string, uint64_t> by_view;
+static uint64_t next_nodeid = ROOT_NODEID + 1;
+static string root_path;
+
+Inode::~Inode() {
+    if (fd != -1) close(fd);
+}
+
+bool InodeTable::init(const string& backend_root) {
+    int fd = open(backend_root.c_str(), O_PATH | O_DIRECTORY);
+    struct stat st;
+    if (fd == -1 || fstat(fd, &st) != 0) {
+        if (fd != -1) close(fd);
+        return false;
+    }
+
+    auto root = make_shared<Inode>();
+    root->nodeid = ROOT_NODEID;
+    root->fd = fd;
+    root->dev = st.st_dev;
+    root->ino = st.st_ino;
+    root->nlookup = 1;  // The kernel never forgets the root
+
+    unique_lock<shared_mutex> lock(table_mutex);
+    root_path = backend_root;
+    nodes[ROOT_NODEID] = root;
+    by_key[{st.st_dev, st.st_ino}] = ROOT_NODEID;
+    return true;
+}
+
+void InodeTable::clear() {
+    // Parents are released after their children (the map holds the last references)
+    unordered_map<uint64_t, shared_ptr<Inode>> doomed;
+    {
+        unique_lock<shared_mutex> lock(table_mutex);
+        doomed.swap(nodes);
+        by_key.clear();
+        by_view.clear();
+    }
+}
+
+shared_ptr<Inode> InodeTable::get(uint64_t nodeid) {
+    shared_lock<shared_mutex> lock(table_mutex);
+    auto it = nodes.find(nodeid);
+    return it != nodes.end() ? it->second : nullptr;
+}
+
+shared_ptr<Inode> InodeTable::lookup(uint64_t parent_id, const char* name, struct stat& st) {
+    shared_ptr<Inode> parent = get(parent_id);
+    if (!parent) {
+        errno = ESTALE;
+        return nullptr;
+    }
+
+    int fd = openat(parent->fd, name, O_PATH | O_NOFOLLOW);
+    if (fd == -1) return nullptr;
+    if (fstatat(fd, "", &st, AT_EMPTY_PATH | AT_SYMLINK_NOFOLLOW) != 0) {
+        int err = errno;
+        close(fd);
+        errno = err;
+        return nullptr;
+    }
+
+    unique_lock<shared_mutex> lock(table_mutex);
+    auto key = make_pair(st.st_dev, st.st_ino);
+    auto it = by_key.find(key);
+    if (it != by_key.end()) {
+        // Already known: one more reference, and remember the latest name
+        shared_ptr<Inode> inode = nodes[it->second];
+        inode->nlookup++;
+        if (inode->nodeid != ROOT_NODEID) {
+            inode->parent = parent;
+            inode->name = name;
+        }
+        lock.unlock();
+        close(fd);
+        return inode;
+    }
+
+    auto inode = make_shared<Inode>();
+    inode->nodeid = next_nodeid++;
+    inode->fd = fd;
+    inode->dev = st.st_dev;
+    inode->ino = st.st_ino;
+    inode->nlookup = 1;
+    inode->parent = parent;
+    inode->name = name;
+
+    nodes[inode->nodeid] = inode;
+    by_key[key] = inode->nodeid;
+    return inode;
+}
+
+shared_ptr<Inode> InodeTable::lookup_view(const string& view_path) {
+    unique_lock<shared_mutex> lock(table_mutex);
+    auto it = by_view.find(view_path);
+    if (it != by_view.end()) {
+        shared_ptr<Inode> inode = nodes[it->second];
+        inode->nlookup++;
+        return inode;
+    }
+
+    auto inode = make_shared<Inode>();
+    inode->nodeid = next_nodeid++;
+    inode->nlookup = 1;
+    inode->view_path = view_path;
+
+    nodes[inode->nodeid] = inode;
+    by_view[view_path] = inode->nodeid;
+    return inode;
+}
+
+void InodeTable::forget(uint64_t nodeid, uint64_t nlookup) {
+    shared_ptr<Inode> doomed;  // Closed after the lock is dropped
+    unique_lock<shared_mutex> lock(table_mutex);
+    auto it = nodes.find(nodeid);
+    if (it == nodes.end() || nodeid == ROOT_NODEID) return;
+
+    shared_ptr<Inode>& inode = it->second;
+    inode->nlookup -= min(nlookup, inode->nlookup);
+    if (inode->nlookup > 0) return;
+
+    doomed = inode;
+    if (inode->view_path.empty()) {
+        by_key.erase({inode->dev, inode->ino});
+    } else {
+        by_view.erase(inode->view_path);
+    }
+    nodes.erase(it);
+}
+
+// Caller holds table_mutex
+static string path_of(const shared_ptr<Inode>& inode) {
+    vector<const string*> parts;
+    for (const Inode* cur = inode.get(); cur && cur->parent; cur = cur->parent.get()) {
+        parts.push_back(&cur->name);
+    }
+
+    string path = root_path;
+    for (auto it = parts.rbegin(); it != parts.rend(); ++it) {
+        path += "/";
+        path += **it;
+    }
+    return path;
+}
+
+string InodeTable::backend_path(uint64_t nodeid) {
+    shared_lock<shared_mutex> lock(table_mutex);
+    auto it = nodes.find(nodeid);
+    return it != nodes.end() ? path_of(it->second) : "";
+}
+
+string InodeTable::backend_path(uint64_t parent, const char* name) {
+    shared_lock<shared_mutex> lock(table_mutex);
+    auto it = nodes.find(parent);
+    return it != nodes.end() ? path_of(it->second) + "/" + name : "";
+}
+
+void InodeTable::renamed(uint64_t parent_id, const char* name) {
+    shared_ptr<Inode> parent = get(parent_id);
+    if (!parent) return;
+
+    // The moved object is found by identity at its new place
+    struct stat st;
+    if (fstatat(parent->fd, name, &st, AT_SYMLINK_NOFOLLOW) != 0) return;
+
+    unique_lock<shared_mutex> lock(table_mutex);
+    auto it = by_key.find({st.st_dev, st.st_ino});
+    if (it == by_key.end()) return;
+
+    shared_ptr<Inode>& inode = nodes[it->second];
+    inode->parent = parent;
+    inode->name = name;
+}
+
+uint64_t InodeTable::find(const string& backend_path) {
+    struct stat st;
+    if (lstat(backend_path.c_str(), &st) != 0) return 0;
+
+    shared_lock<shared_mutex> lock(table_mutex);
+    auto it = by_key.find({st.st_dev, st.st_ino});
+    return it != by_key.end() ? it->second : 0;
+}
+
+vector<uint64_t> InodeTable::find_views(const function<bool(const string& view_path)>& match) {
+    vector<uint64_t> found;
+    shared_lock<shared_mutex> lock(table_mutex);
+    for (const auto& [view_path, nodeid] : by_view) {
+        if (match(view_path)) found.push_back(nodeid);
+    }
+    return found;
+}
+
+bool InodeTable::data_unchanged(uint64_t nodeid, const struct stat& st) {
+    unique_lock<shared_mutex> lock(table_mutex);
+    auto it = nodes.find(nodeid);
+    if (it == nodes.end()) return false;
+
+    Inode& inode = *it->second;
+    bool same = inode.cached_size == st.st_size &&
+                inode.cached_mtime.tv_sec == st.st_mtim.tv_sec &&
+                inode.cached_mtime.tv_nsec == st.st_mtim.tv_nsec;
+    inode.cached_size = st.st_size;
+    inode.cached_mtime = st.st_mtim;
+    return same;
+}
+
+size_t InodeTable::size() {
+    shared_lock<shared_mutex> lock(table_mutex);
+    return nodes.size();
+}
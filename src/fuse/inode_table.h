@@ -0,0 +1,82 @@
+#pragma once
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// One backend file or directory the kernel knows about
+struct Inode {
+    uint64_t nodeid = 0;
+    int fd = -1;               // O_PATH handle on the backend object
+    dev_t dev = 0;
+    ino_t ino = 0;
+    uint64_t nlookup = 0;      // Lookups the kernel has not forgotten yet
+
+    // Size and mtime when the kernel last cached the data (auto_cache)
+    off_t cached_size = -1;
+    struct timespec cached_mtime = {0, 0};
+
+    // Where the object was last seen, for operations that need a backend
+    // path (versioning); guarded by the table lock
+    shared_ptr<Inode> parent;
+    string name;
+
+    // Path in the history namespace for its synthetic entries (fd is -1);
+    // empty for backend objects
+    string view_path;
+
+    ~Inode();
+};
+
+// Inode table of the low-level mount: maps FUSE nodeids to O_PATH handles
+// on the backend, so operations work relative to fds instead of rebuilding
+// and re-walking absolute paths. The same backend object (dev, ino) always
+// gets the same nodeid while the kernel holds a reference to it.
+class InodeTable {
+public:
+    // Register the backend root as FUSE_ROOT_ID
+    static bool init(const string& backend_root);
+
+    // Release every inode (on unmount)
+    static void clear();
+
+    // Nodeid -> inode, or nullptr if unknown
+    static shared_ptr<Inode> get(uint64_t nodeid);
+
+    // Resolve `name` in `parent`, taking one lookup reference on the result.
+    // Fills `st`; returns the inode or nullptr with errno set.
+    static shared_ptr<Inode> lookup(uint64_t parent, const char* name, struct stat& st);
+
+    // Same for an entry of the history namespace, identified by its path
+    static shared_ptr<Inode> lookup_view(const string& view_path);
+
+    // Drop `nlookup` references; the inode is freed when none remain
+    static void forget(uint64_t nodeid, uint64_t nlookup);
+
+    // Backend path of an inode, rebuilt from its parent chain
+    static string backend_path(uint64_t nodeid);
+    static string backend_path(uint64_t parent, const char* name);
+
+    // Record that whatever is now at `name` in `parent` was just moved there
+    static void renamed(uint64_t parent, const char* name);
+
+    // Nodeid of the object at a backend path, or 0 if the kernel does not know it
+    static uint64_t find(const string& backend_path);
+
+    // Nodeids of the history namespace entries whose path `match` accepts
+    static vector<uint64_t> find_views(const function<bool(const string& view_path)>& match);
+
+    // Whether the data the kernel may have cached at the last open is still
+    // current (same size and mtime as `st`); records `st` for the next check
+    static bool data_unchanged(uint64_t nodeid, const struct stat& st);
+
+    // Number of live inodes (root included)
+    static size_t size();
+};
@@ -0,0 +1,309 @@
+#include "meta_log.h"
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cstring>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <algorithm>
+#include <climits>
+
+using namespace std;
+
+static const char META_LOG_MAGIC[8] = {'V', 'T', 'X', 'M', 'E', 'T', 'A', '1'};
+
+static void hex_to_raw(const string& hex, uint8_t* raw, size_t len) {
+    memset(raw, 0, len);
+    for (size_t i = 0; i < len && i * 2 + 1 < hex.size(); i++) {
+        unsigned int byte = 0;
+        sscanf(hex.c_str() + i * 2, "%2x", &byte);
+        raw[i] = (uint8_t)byte;
+    }
+}
+
+static string raw_to_hex(const uint8_t* raw, size_t len) {
+    static const char digits[] = "0123456789abcdef";
+    string out;
+    out.reserve(len * 2);
+    for (size_t i = 0; i < len; i++) {
+        out += digits[raw[i] >> 4];
+        out += digits[raw[i] & 0xf];
+    }
+    return out;
+}
+
+bool MetaLog::read_header(int fd, MetaLogHeader& header) {
+    if (pread(fd, &header, sizeof(header), 0) != (ssize_t)sizeof(header)) return false;
+    return memcmp(header.magic, META_LOG_MAGIC, sizeof(META_LOG_MAGIC)) == 0 &&
+           header.format == META_LOG_FORMAT &&
+           header.record_size == sizeof(MetaLogRecord);
+}
+
+void MetaLog::init_header(MetaLogHeader& header, uint64_t count) {
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, META_LOG_MAGIC, sizeof(META_LOG_MAGIC));
+    header.format = META_LOG_FORMAT;
+    header.record_size = sizeof(MetaLogRecord);
+    header.count = count;
+}
+
+void MetaLog::to_record(const FileVersion& version, MetaLogRecord& record) {
+    memset(&record, 0, sizeof(record));
+    record.version_number = version.version_number;
+    record.base_version = version.base_version;
+    record.timestamp = version.timestamp;
+    record.size = version.size;
+    record.flags = version.flags;
+    record.stored_size = version.stored_size;
+    record.epoch = version.epoch;
+    hex_to_raw(version.object_id, record.object_id, sizeof(record.object_id));
+}
+
+void MetaLog::from_record(const MetaLogRecord& record, FileVersion& version) {
+    version.version_number = record.version_number;
+    version.base_version = record.base_version;
+    version.timestamp = record.timestamp;
+    version.size = record.size;
+    version.flags = record.flags;
+    version.stored_size = record.stored_size;
+    version.epoch = record.epoch;
+    version.object_id = raw_to_hex(record.object_id, sizeof(record.object_id));
+}
+
+bool MetaLog::is_log(const string& meta_path) {
+    int fd = open(meta_path.c_str(), O_RDONLY);
+    if (fd == -1) return false;
+    MetaLogHeader header;
+    bool ok = read_header(fd, header);
+    close(fd);
+    return ok;
+}
+
+bool MetaLog::maybe_log(const string& meta_path) {
+    int fd = open(meta_path.c_str(), O_RDONLY);
+    if (fd == -1) return false;
+    char magic[sizeof(META_LOG_MAGIC)];
+    ssize_t n = pread(fd, magic, sizeof(magic), 0);
+    close(fd);
+    // A read error proves nothing either way; leave the file alone
+    return n < 0 || memcmp(magic, META_LOG_MAGIC, n) == 0;
+}
+
+// Records the file actually holds: a torn or corrupt header may claim more
+static uint64_t intact_count(int fd, const MetaLogHeader& header) {
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(header)) return 0;
+    uint64_t present = ((uint64_t)st.st_size - sizeof(header)) / sizeof(MetaLogRecord);
+    return min(header.count, present);
+}
+
+bool MetaLog::read_all(const string& meta_path, vector<FileVersion>& versions) {
+    versions.clear();
+    int fd = open(meta_path.c_str(), O_RDONLY);
+    if (fd == -1) return false;
+
+    MetaLogHeader header;
+    if (!read_header(fd, header)) {
+        close(fd);
+        return false;
+    }
+
+    vector<MetaLogRecord> records(intact_count(fd, header));
+    size_t bytes = records.size() * sizeof(MetaLogRecord);
+    ssize_t n = bytes ? pread(fd, records.data(), bytes, sizeof(header)) : 0;
+    close(fd);
+    if (n != (ssize_t)bytes) return false;
+
+    versions.resize(records.size());
+    for (size_t i = 0; i < records.size(); i++) {
+        from_record(records[i], versions[i]);
+    }
+    return true;
+}
+
+int MetaLog::read_count(const string& meta_path) {
+    int fd = open(meta_path.c_str(), O_RDONLY);
+    if (fd == -1) return 0;
+    MetaLogHeader header;
+    bool ok = read_header(fd, header);
+    uint64_t count = ok ? intact_count(fd, header) : 0;
+    close(fd);
+    return ok ? (int)min<uint64_t>(count, INT_MAX) : -1;
+}
+
+bool MetaLog::read_last(const string& meta_path, FileVersion& version) {
+    int fd = open(meta_path.c_str(), O_RDONLY);
+    if (fd == -1) return false;
+
+    MetaLogHeader header;
+    MetaLogRecord record;
+    uint64_t count = read_header(fd, header) ? intact_count(fd, header) : 0;
+    bool ok = count > 0 &&
+        pread(fd, &record, sizeof(record), sizeof(header) + (count - 1) * sizeof(record))
+            == (ssize_t)sizeof(record);
+    close(fd);
+
+    if (ok) from_record(record, version);
+    return ok;
+}
+
+bool MetaLog::read_around(const string& meta_path, time_t when, VersionsAround& around) {
+    around = VersionsAround();
+    int fd = open(meta_path.c_str(), O_RDONLY);
+    if (fd == -1) return false;
+
+    MetaLogHeader header;
+    if (!read_header(fd, header)) {
+        close(fd);
+        return false;
+    }
+
+    auto read_at = [&](uint64_t index, MetaLogRecord& record) {
+        return pread(fd, &record, sizeof(record), sizeof(header) + index * sizeof(record)) == (ssize_t)sizeof(record);
+    };
+
+    // First record with a timestamp after `when`
+    uint64_t count = intact_count(fd, header);
+    uint64_t lo = 0, hi = count;
+    MetaLogRecord record;
+    bool ok = true;
+    while (ok && lo < hi) {
+        uint64_t mid = lo + (hi - lo) / 2;
+        ok = read_at(mid, record);
+        if (record.timestamp <= (int64_t)when) lo = mid + 1;
+        else hi = mid;
+    }
+    if (ok && lo > 0 && (ok = read_at(lo - 1, record))) {
+        from_record(record, around.before);
+        around.has_before = true;
+    }
+    if (ok && lo < count && (ok = read_at(lo, record))) {
+        from_record(record, around.after);
+        around.has_after = true;
+    }
+    close(fd);
+    return ok;
+}
+
+bool MetaLog::append(const string& meta_path, const FileVersion& version) {
+    int fd = open(meta_path.c_str(), O_RDWR | O_CREAT, 0644);
+    if (fd == -1) return false;
+
+    MetaLogHeader header;
+    struct stat st;
+    if (!read_header(fd, header)) {
+        // Only a log that never got a whole header may be started afresh;
+        // anything bigger holds records a new header would disown
+        if (fstat(fd, &st) != 0 || st.st_size >= (off_t)sizeof(header)) {
+            close(fd);
+            return false;
+        }
+        init_header(header, 0);
+        if (pwrite(fd, &header, sizeof(header), 0) != (ssize_t)sizeof(header)) {
+            close(fd);
+            return false;
+        }
+    }
+
+    MetaLogRecord record;
+    to_record(version, record);
+    off_t offset = sizeof(header) + header.count * sizeof(record);
+    bool ok = pwrite(fd, &record, sizeof(record), offset) == (ssize_t)sizeof(record);
+
+    // Publish the record by bumping the count only once it is fully written
+    if (ok) {
+        uint64_t count = header.count + 1;
+        ok = pwrite(fd, &count, sizeof(count), offsetof(MetaLogHeader, count)) == (ssize_t)sizeof(count);
+    }
+
+    close(fd);
+    return ok;
+}
+
+bool MetaLog::update(const string& meta_path, size_t index, const FileVersion& version) {
+    int fd = open(meta_path.c_str(), O_RDWR);
+    if (fd == -1) return false;
+
+    MetaLogHeader header;
+    bool ok = read_header(fd, header) && index < header.count;
+    if (ok) {
+        MetaLogRecord record;
+        to_record(version, record);
+        ok = pwrite(fd, &record, sizeof(record), sizeof(header) + index * sizeof(record)) == (ssize_t)sizeof(record);
+    }
+
+    close(fd);
+    return ok;
+}
+
+bool MetaLog::write_all(const string& meta_path, const vector<FileVersion>& versions, bool durable) {
+    // Unique per writer: the TUI and the daemon may rewrite the same log
+    string tmp_path = meta_path + ".XXXXXX";
+    int fd = mkstemp(&tmp_path[0]);
+    if (fd == -1) return false;
+    fchmod(fd, 0644);
+
+    string buf(sizeof(MetaLogHeader) + versions.size() * sizeof(MetaLogRecord), '\0');
+    MetaLogHeader header;
+    init_header(header, versions.size());
+    memcpy(&buf[0], &header, sizeof(header));
+    for (size_t i = 0; i < versions.size(); i++) {
+        MetaLogRecord record;
+        to_record(versions[i], record);
+        memcpy(&buf[sizeof(header) + i * sizeof(record)], &record, sizeof(record));
+    }
+
+    bool ok = write(fd, buf.data(), buf.size()) == (ssize_t)buf.size();
+    if (ok && durable && fdatasync(fd) != 0) ok = false;
+    if (close(fd) != 0) ok = false;
+
+    if (!ok || rename(tmp_path.c_str(), meta_path.c_str()) != 0) {
+        unlink(tmp_path.c_str());
+        return false;
+    }
+
+    if (durable) {
+        size_t slash = meta_path.find_last_of('/');
+        string dir = slash == string::npos ? "." : meta_path.substr(0, slash);
+        int dir_fd = open(dir.c_str(), O_RDONLY | O_DIRECTORY);
+        if (dir_fd == -1) return false;
+        ok = fsync(dir_fd) == 0;
+        close(dir_fd);
+    }
+    return ok;
+}
+
+int MetaLog::trim_tail(const string& meta_path, const function<bool(const FileVersion&)>& valid) {
+    int fd = open(meta_path.c_str(), O_RDWR);
+    if (fd == -1) return 0;
+
+    MetaLogHeader header;
+    if (!read_header(fd, header)) {
+        close(fd);
+        return 0;
+    }
+
+    // Records the file is too short to hold are gone whatever the count says
+    uint64_t count = intact_count(fd, header);
+    while (count > 0) {
+        MetaLogRecord record;
+        if (pread(fd, &record, sizeof(record), sizeof(header) + (count - 1) * sizeof(record))
+                != (ssize_t)sizeof(record)) break;
+        FileVersion version;
+        from_record(record, version);
+        if (valid(version)) break;
+        count--;
+    }
+
+    int dropped = (int)(header.count - count);
+    if (dropped > 0) {
+        uint64_t new_count = count;
+        if (pwrite(fd, &new_count, sizeof(new_count), offsetof(MetaLogHeader, count)) != (ssize_t)sizeof(new_count) ||
+            ftruncate(fd, sizeof(header) + count * sizeof(MetaLogRecord)) != 0) {
+            dropped = -1;
+        }
+    }
+    close(fd);
+    return dropped;
+}
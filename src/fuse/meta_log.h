@@ -0,0 +1,91 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <functional>
+#include "version_manager.h"
+
+using namespace std;
+
+// Append-only binary version log (one per versioned file).
+//
+// Layout: a fixed header holding the record count, followed by fixed-size
+// records. Appending a version writes the new record past the end and then
+// bumps the count in the header, so a torn append is simply not counted.
+
+struct MetaLogHeader {
+    char magic[8];          // "VTXMETA1"
+    uint32_t format;        // META_LOG_FORMAT
+    uint32_t record_size;   // sizeof(MetaLogRecord)
+    uint64_t count;         // Number of valid records
+    uint8_t reserved[40];
+};
+
+struct MetaLogRecord {
+    uint32_t version_number;
+    uint32_t base_version;
+    int64_t timestamp;
+    uint64_t size;
+    uint8_t object_id[32];  // Raw SHA-256 of the stored object
+    uint32_t flags;         // VERSION_FLAG_*
+    uint32_t padding;
+    uint64_t stored_size;   // Bytes used in the object store
+    uint64_t epoch;         // Tree snapshot epoch (0 in logs that predate snapshots)
+    uint8_t reserved[48];
+};
+
+static_assert(sizeof(MetaLogHeader) == 64, "meta log header must stay 64 bytes");
+static_assert(sizeof(MetaLogRecord) == 128, "meta log record must stay 128 bytes");
+
+const uint32_t META_LOG_FORMAT = 1;
+
+class MetaLog {
+public:
+    // True if the file exists and starts with a binary log header
+    static bool is_log(const string& meta_path);
+
+    // True if the file may be a binary log, even one whose header is torn or
+    // not written yet: it is empty or starts with (part of) the magic. Only
+    // files for which this is false are in the old text format.
+    static bool maybe_log(const string& meta_path);
+
+    // Read every record; returns false if the log is missing or invalid
+    static bool read_all(const string& meta_path, vector<FileVersion>& versions);
+
+    // Number of versions, from the header alone
+    // (0 if there is no log, -1 if the file is not in the binary format)
+    static int read_count(const string& meta_path);
+
+    // Read only the newest record
+    static bool read_last(const string& meta_path, FileVersion& version);
+
+    // Binary search the records for the ones either side of `when`,
+    // reading O(log n) of them
+    static bool read_around(const string& meta_path, time_t when, VersionsAround& around);
+
+    // Append one record, creating the log if needed (a log too short to
+    // hold a header is started afresh; a larger one with a bad header fails)
+    static bool append(const string& meta_path, const FileVersion& version);
+
+    // Overwrite the record at `index` in place
+    static bool update(const string& meta_path, size_t index, const FileVersion& version);
+
+    // Replace the whole log (used when history is rewritten); `durable`
+    // syncs the new log and its directory entry before returning
+    static bool write_all(const string& meta_path, const vector<FileVersion>& versions,
+                          bool durable = false);
+
+    // Drop newest records until `valid` accepts one (crash recovery: a torn
+    // append, or a version whose object never reached the disk).
+    // Returns the number of records dropped.
+    static int trim_tail(const string& meta_path, const function<bool(const FileVersion&)>& valid);
+
+    // Conversion between the in-memory and on-disk forms
+    static void to_record(const FileVersion& version, MetaLogRecord& record);
+    static void from_record(const MetaLogRecord& record, FileVersion& version);
+
+private:
+    static bool read_header(int fd, MetaLogHeader& header);
+    static void init_header(MetaLogHeader& header, uint64_t count);
+};
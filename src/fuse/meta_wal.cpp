@@ -0,0 +1,449 @@
+#include "meta_wal.h"
+#include "meta_log.h"
+#include "object_store.h"
+#include <sys/stat.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <zlib.h>
+#include <condition_variable>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <ctime>
+#include <iostream>
+#include <mutex>
+#include <shared_mutex>
+#include <thread>
+
+using namespace std;
+
+// Layout: a fixed header, then records of a fixed part followed by the name
+// of the meta log (relative to the meta directory). A record is valid only
+// if its checksum matches, so a torn write at the end is simply not replayed.
+
+struct WalHeader {
+    char magic[8];       // "VTXWAL01"
+    uint32_t format;     // WAL_FORMAT
+    uint32_t clean;      // 1 once the log was emptied by a clean stop
+    uint8_t reserved[48];
+};
+
+struct WalRecord {
+    uint32_t crc;        // CRC-32 of everything after this field, name included
+    uint16_t name_len;
+    uint16_t reserved;
+    MetaLogRecord version;
+};
+
+static_assert(sizeof(WalHeader) == 64, "WAL header must stay 64 bytes");
+static_assert(sizeof(WalRecord) == 136, "WAL record must stay 136 bytes");
+
+static const char WAL_MAGIC[8] = {'V', 'T', 'X', 'W', 'A', 'L', '0', '1'};
+static const uint32_t WAL_FORMAT = 1;
+static const char* const WAL_NAME = "versions.wal";
+
+// The log is emptied once it holds this much
+static const off_t CHECKPOINT_BYTES = 4L * 1024 * 1024;
+
+// Staging files younger than this may belong to a running TUI
+static const time_t STAGING_GRACE_SECONDS = 60;
+
+static Durability current_level = Durability::NONE;
+static string meta_root;
+static int wal_fd = -1;
+static int store_fd = -1;   // Directory in the object store, for syncfs()
+static int meta_fd = -1;    // Only if the meta directory is on another filesystem
+
+static mutex wal_mutex;
+static condition_variable wal_wake;
+static string pending;                 // Encoded records not written yet
+static uint64_t buffered_seq = 0;      // Records handed to the log
+static uint64_t durable_seq = 0;       // Records known to be on disk
+static bool syncing = false;
+static bool broken = false;            // A sync failed; nothing can be promised any more
+static bool stopping = false;
+static off_t wal_size = 0;
+static unsigned batch_delay_ms = 50;
+static thread flusher;
+
+// Held shared from logging a record until it has been applied, and
+// exclusively by a checkpoint, which may only drop applied records
+static shared_mutex checkpoint_lock;
+
+static uint32_t record_crc(const WalRecord& record, const char* name) {
+    uLong crc = crc32(0L, Z_NULL, 0);
+    const Bytef* body = (const Bytef*)&record + sizeof(record.crc);
+    crc = crc32(crc, body, sizeof(record) - sizeof(record.crc));
+    return (uint32_t)crc32(crc, (const Bytef*)name, record.name_len);
+}
+
+static bool write_fully(int fd, const char* data, size_t len, off_t offset) {
+    size_t done = 0;
+    while (done < len) {
+        ssize_t n = pwrite(fd, data + done, len - done, offset + done);
+        if (n <= 0) return false;
+        done += n;
+    }
+    return true;
+}
+
+static bool sync_filesystems() {
+    if (syncfs(store_fd) != 0) return false;
+    return meta_fd == -1 || syncfs(meta_fd) == 0;
+}
+
+static bool write_header(int fd, bool clean) {
+    WalHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, WAL_MAGIC, sizeof(WAL_MAGIC));
+    header.format = WAL_FORMAT;
+    header.clean = clean ? 1 : 0;
+    return write_fully(fd, (const char*)&header, sizeof(header), 0) && fdatasync(fd) == 0;
+}
+
+// A version is usable if its object made it into the store
+static bool version_intact(const FileVersion& version) {
+    if (version.version_number <= 0 || version.object_id.empty()) return false;
+    if (ObjectStore::ref_count(version.object_id) <= 0) return false;
+    return version.size == 0 || ObjectStore::stored_size(version.object_id) > 0;
+}
+
+// Meta logs live two fan-out levels down (meta/ab/cd/<key>.meta); the
+// flat ones of the old layout sit at the top until they are moved
+static void for_each_meta_log(const string& dir_path, int depth, const function<void(const string&)>& fn) {
+    DIR* dir = opendir(dir_path.c_str());
+    if (!dir) return;
+    struct dirent* entry;
+    while ((entry = readdir(dir)) != nullptr) {
+        string name = entry->d_name;
+        if (name[0] == '.') continue;
+        string path = dir_path + "/" + name;
+        if (name.size() > 5 && name.compare(name.size() - 5, 5, ".meta") == 0) {
+            fn(path);
+        } else if (depth < 2 && name.size() == 2) {
+            for_each_meta_log(path, depth + 1, fn);
+        }
+    }
+    closedir(dir);
+}
+
+bool MetaWal::parse_durability(const string& text, Durability& level) {
+    if (text == "none") level = Durability::NONE;
+    else if (text == "batched") level = Durability::BATCHED;
+    else if (text == "strict") level = Durability::STRICT;
+    else return false;
+    return true;
+}
+
+const char* MetaWal::durability_name(Durability level) {
+    switch (level) {
+        case Durability::NONE: return "none";
+        case Durability::BATCHED: return "batched";
+        case Durability::STRICT: return "strict";
+    }
+    return "?";
+}
+
+Durability MetaWal::level() {
+    return current_level;
+}
+
+void MetaWal::recover(const string& meta_dir, const string& store_dir) {
+    string path = meta_dir + "/" + WAL_NAME;
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd == -1) return;
+
+    struct stat st;
+    string log;
+    if (fstat(fd, &st) == 0 && st.st_size > 0) {
+        log.resize(st.st_size);
+        if (pread(fd, &log[0], log.size(), 0) != (ssize_t)log.size()) log.clear();
+    }
+    close(fd);
+
+    // A header that cannot be read means the crash hit while it was written
+    WalHeader header;
+    bool valid_header = log.size() >= sizeof(header);
+    if (valid_header) {
+        memcpy(&header, log.data(), sizeof(header));
+        valid_header = memcmp(header.magic, WAL_MAGIC, sizeof(WAL_MAGIC)) == 0 && header.format == WAL_FORMAT;
+    }
+    if (valid_header && header.clean) return;
+
+    cerr << "[VFS] Recovering version metadata after an unclean shutdown..." << endl;
+
+    // Torn appends and versions whose objects never reached the disk can only
+    // be at the end of a meta log; cut them off before replaying the log
+    int trimmed = 0;
+    for_each_meta_log(meta_dir, 0, [&trimmed](const string& meta_path) {
+        int dropped = MetaLog::trim_tail(meta_path, version_intact);
+        if (dropped > 0) trimmed += dropped;
+    });
+
+    // Versions that were durable in the log but never reached their meta log
+    int replayed = 0;
+    size_t offset = valid_header ? sizeof(WalHeader) : log.size();
+    while (offset + sizeof(WalRecord) <= log.size()) {
+        WalRecord record;
+        memcpy(&record, log.data() + offset, sizeof(record));
+        const char* name = log.data() + offset + sizeof(record);
+        if (record.name_len == 0 || offset + sizeof(record) + record.name_len > log.size()) break;
+        if (record.crc != record_crc(record, name)) break;
+        offset += sizeof(record) + record.name_len;
+
+        string meta_name(name, record.name_len);
+        if (meta_name.find("..") != string::npos) continue;
+        string meta_path = meta_dir + "/" + meta_name;
+
+        FileVersion version;
+        MetaLog::from_record(record.version, version);
+        if (!version_intact(version)) continue;
+
+        // Already there, or pruned since: only versions past the newest one are missing
+        if (MetaLog::read_count(meta_path) < 0) continue;
+        FileVersion last;
+        if (MetaLog::read_last(meta_path, last) && last.version_number >= version.version_number) continue;
+
+        version.stored_size = ObjectStore::stored_size(version.object_id);
+        if (MetaLog::append(meta_path, version)) replayed++;
+    }
+
+    // Staging files of commits that never finished
+    int removed = 0;
+    string tmp_dir = store_dir + "/tmp";
+    DIR* dir = opendir(tmp_dir.c_str());
+    if (dir) {
+        time_t now = time(nullptr);
+        struct dirent* entry;
+        while ((entry = readdir(dir)) != nullptr) {
+            string staged = tmp_dir + "/" + entry->d_name;
+            struct stat staged_st;
+            if (entry->d_name[0] == '.' || stat(staged.c_str(), &staged_st) != 0 || !S_ISREG(staged_st.st_mode)) continue;
+            if (now - staged_st.st_mtime < STAGING_GRACE_SECONDS) continue;
+            if (unlink(staged.c_str()) == 0) removed++;
+        }
+        closedir(dir);
+    }
+
+    cerr << "[VFS] ✓ Recovery: " << replayed << " versions replayed, " << trimmed
+         << " torn records dropped, " << removed << " staging files removed" << endl;
+}
+
+void MetaWal::start(const string& meta_dir, const string& store_dir, Durability level, unsigned batch_ms) {
+    recover(meta_dir, store_dir);
+
+    string path = meta_dir + "/" + WAL_NAME;
+    meta_root = meta_dir;
+    current_level = level;
+    if (level == Durability::NONE) {
+        // Nothing will be logged; make sure what was recovered is on disk first
+        int fd = open(store_dir.c_str(), O_RDONLY | O_DIRECTORY);
+        if (fd != -1) {
+            syncfs(fd);
+            close(fd);
+        }
+        unlink(path.c_str());
+        return;
+    }
+
+    store_fd = open(store_dir.c_str(), O_RDONLY | O_DIRECTORY);
+    int dir_fd = open(meta_dir.c_str(), O_RDONLY | O_DIRECTORY);
+    struct stat store_st, meta_st;
+    if (store_fd != -1 && dir_fd != -1 && fstat(store_fd, &store_st) == 0 &&
+        fstat(dir_fd, &meta_st) == 0 && store_st.st_dev != meta_st.st_dev) {
+        meta_fd = dir_fd;
+    } else if (dir_fd != -1) {
+        close(dir_fd);
+    }
+
+    // Recovered versions must be durable before the old log is overwritten
+    wal_fd = open(path.c_str(), O_RDWR | O_CREAT, 0644);
+    if (store_fd == -1 || wal_fd == -1 || !sync_filesystems() ||
+        ftruncate(wal_fd, 0) != 0 || !write_header(wal_fd, false)) {
+        cerr << "[VFS] ✗ Cannot open the metadata log " << path << "; versions will not be synced" << endl;
+        if (wal_fd != -1) close(wal_fd);
+        if (store_fd != -1) close(store_fd);
+        if (meta_fd != -1) close(meta_fd);
+        wal_fd = store_fd = meta_fd = -1;
+        current_level = Durability::NONE;
+        return;
+    }
+
+    {
+        lock_guard<mutex> lock(wal_mutex);
+        wal_size = sizeof(WalHeader);
+        pending.clear();
+        buffered_seq = durable_seq = 0;
+        syncing = broken = stopping = false;
+        batch_delay_ms = max(batch_ms, 1u);
+    }
+
+    if (level == Durability::BATCHED) {
+        flusher = thread([] {
+            unique_lock<mutex> lock(wal_mutex);
+            while (true) {
+                wal_wake.wait(lock, [] { return stopping || buffered_seq != durable_seq; });
+                if (stopping) break;
+                // Let the batch fill up
+                wal_wake.wait_for(lock, chrono::milliseconds(batch_delay_ms), [] { return stopping; });
+                lock.unlock();
+                flush_batch();
+                checkpoint(false);
+                lock.lock();
+            }
+        });
+    }
+}
+
+void MetaWal::stop() {
+    if (current_level == Durability::NONE) return;
+
+    {
+        lock_guard<mutex> lock(wal_mutex);
+        stopping = true;
+    }
+    wal_wake.notify_all();
+    if (flusher.joinable()) flusher.join();
+
+    checkpoint(true);
+    bool clean;
+    {
+        lock_guard<mutex> lock(wal_mutex);
+        clean = !broken;
+    }
+    if (clean && !write_header(wal_fd, true)) {
+        cerr << "[VFS] ✗ Cannot mark the metadata log clean" << endl;
+    }
+
+    close(wal_fd);
+    close(store_fd);
+    if (meta_fd != -1) close(meta_fd);
+    wal_fd = store_fd = meta_fd = -1;
+    current_level = Durability::NONE;
+}
+
+bool MetaWal::flush_batch() {
+    unique_lock<mutex> lock(wal_mutex);
+    wal_wake.wait(lock, [] { return !syncing; });
+    if (durable_seq == buffered_seq) return !broken;
+
+    syncing = true;
+    string batch;
+    batch.swap(pending);
+    uint64_t upto = buffered_seq;
+    off_t offset = wal_size;
+    lock.unlock();
+
+    // Objects and reference counts first, so a durable record never points
+    // at data that is not; then the records themselves
+    bool ok = sync_filesystems() &&
+              write_fully(wal_fd, batch.data(), batch.size(), offset) &&
+              fdatasync(wal_fd) == 0;
+
+    lock.lock();
+    if (ok) {
+        wal_size += batch.size();
+    } else if (!broken) {
+        cerr << "[VFS] ✗ Syncing the version store failed: " << strerror(errno)
+             << "; new versions can no longer be made durable" << endl;
+        broken = true;
+    }
+    durable_seq = upto;
+    syncing = false;
+    wal_wake.notify_all();
+    return ok;
+}
+
+void MetaWal::checkpoint(bool force) {
+    {
+        lock_guard<mutex> lock(wal_mutex);
+        if (!force && wal_size + (off_t)pending.size() < CHECKPOINT_BYTES) return;
+    }
+
+    // No commit is between logging and applying its record now
+    unique_lock<shared_mutex> exclusive(checkpoint_lock);
+    unique_lock<mutex> lock(wal_mutex);
+    wal_wake.wait(lock, [] { return !syncing; });
+    if (!force && wal_size + (off_t)pending.size() < CHECKPOINT_BYTES) return;
+    syncing = true;
+    lock.unlock();
+
+    // Every logged version is in its meta log; once those are on disk the
+    // log has nothing left to replay
+    bool ok = sync_filesystems() &&
+              ftruncate(wal_fd, sizeof(WalHeader)) == 0 &&
+              fdatasync(wal_fd) == 0;
+
+    lock.lock();
+    if (ok) {
+        pending.clear();
+        wal_size = sizeof(WalHeader);
+    } else if (!broken) {
+        cerr << "[VFS] ✗ Metadata log checkpoint failed: " << strerror(errno) << endl;
+        broken = true;
+    }
+    durable_seq = buffered_seq;
+    syncing = false;
+    wal_wake.notify_all();
+}
+
+void MetaWal::barrier() {
+    if (current_level == Durability::NONE) return;
+    {
+        // Nothing logged since the last checkpoint (the common case when
+        // a directory's histories move one after another)
+        lock_guard<mutex> lock(wal_mutex);
+        if (wal_size == sizeof(WalHeader) && pending.empty()) return;
+    }
+    checkpoint(true);
+}
+
+bool MetaWal::commit(const string& meta_path, const FileVersion& version, const function<bool()>& apply) {
+    if (current_level == Durability::NONE) return apply();
+
+    string name = meta_path.compare(0, meta_root.size() + 1, meta_root + "/") == 0
+        ? meta_path.substr(meta_root.size() + 1) : meta_path;
+
+    WalRecord record;
+    memset(&record, 0, sizeof(record));
+    record.name_len = (uint16_t)name.size();
+    MetaLog::to_record(version, record.version);
+    record.crc = record_crc(record, name.c_str());
+
+    bool ok;
+    {
+        shared_lock<shared_mutex> shared(checkpoint_lock);
+        uint64_t seq;
+        {
+            lock_guard<mutex> lock(wal_mutex);
+            if (broken && current_level == Durability::STRICT) return false;
+            pending.append((const char*)&record, sizeof(record));
+            pending.append(name);
+            seq = ++buffered_seq;
+        }
+
+        if (current_level == Durability::STRICT) {
+            // Group commit: whoever finds no sync running leads the next one,
+            // covering every record buffered by then
+            unique_lock<mutex> lock(wal_mutex);
+            while (durable_seq < seq && !broken) {
+                if (syncing) {
+                    wal_wake.wait(lock);
+                } else {
+                    lock.unlock();
+                    flush_batch();
+                    lock.lock();
+                }
+            }
+            if (broken) return false;
+        } else {
+            wal_wake.notify_all();
+        }
+
+        ok = apply();
+    }
+
+    if (current_level == Durability::STRICT) checkpoint(false);
+    return ok;
+}
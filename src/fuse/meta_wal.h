@@ -0,0 +1,66 @@
+#pragma once
+
+#include <string>
+#include <functional>
+#include "version_manager.h"
+
+using namespace std;
+
+// How hard version commits work to survive a crash
+enum class Durability {
+    NONE,     // Nothing is synced (a crash may lose or tear recent versions)
+    BATCHED,  // Commits are synced in the background every few milliseconds
+    STRICT,   // A commit returns only once it is on disk
+};
+
+// Write-ahead log for version metadata, with group commit.
+//
+// Every new version is logged here before it is appended to its file's
+// meta log. A sync covers a whole batch of commits: one syncfs() makes the
+// objects, reference counts and meta logs written so far durable, then the
+// batch's log records are written and fdatasync()ed behind them. In strict
+// mode committers wait for the batch holding their record (whoever arrives
+// while no sync is running leads the next one); in batched mode a
+// background thread syncs every `batch_ms` milliseconds.
+//
+// After a crash the log is replayed on start: versions it holds that never
+// reached their meta log are appended, meta logs whose tail is torn or
+// points at missing objects are trimmed, and staging files are removed.
+// The log is truncated at each checkpoint and on a clean stop.
+class MetaWal {
+public:
+    // Parse "none", "batched" or "strict"
+    static bool parse_durability(const string& text, Durability& level);
+    static const char* durability_name(Durability level);
+
+    // Recover what a crash left behind, then open the log under `meta_dir`.
+    // `store_dir` is the object store (the filesystem that gets synced).
+    static void start(const string& meta_dir, const string& store_dir,
+                      Durability level, unsigned batch_ms);
+
+    // Sync everything and truncate the log
+    static void stop();
+
+    static Durability level();
+
+    // Make every version logged so far durable and empty the log. Called
+    // before a meta log is moved, so a replay never reaches its old name.
+    static void barrier();
+
+    // Log a new version of the meta log at `meta_path` and run `apply`
+    // (the actual append); strict mode waits until the record is durable
+    // before applying. False if the record cannot be made durable or
+    // `apply` fails.
+    static bool commit(const string& meta_path, const FileVersion& version,
+                       const function<bool()>& apply);
+
+private:
+    // Helper: Replay the log left by a crashed run and repair meta logs
+    static void recover(const string& meta_dir, const string& store_dir);
+
+    // Helper: Write and sync the records buffered so far
+    static bool flush_batch();
+
+    // Helper: Sync everything and empty the log once it has grown too large
+    static void checkpoint(bool force);
+};
@@ -0,0 +1,465 @@
+#include "object_store.h"
+#include "../common/sha256.h"
+#include "../common/file_copy.h"
+#include "op_stats.h"
+#include <sys/stat.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <mutex>
+#include <atomic>
+#include <functional>
+
+using namespace std;
+
+string ObjectStore::objects_root;
+
+// Reference counts are read-modify-write, so each object id maps to a lock stripe
+static const size_t OBJECT_LOCK_STRIPES = 64;
+static mutex object_locks[OBJECT_LOCK_STRIPES];
+
+static mutex& object_lock(const string& object_id) {
+    return object_locks[hash<string>()(object_id) % OBJECT_LOCK_STRIPES];
+}
+
+// Present once the store uses the two-level (ab/cd/<id>) layout
+static const char* const LAYOUT_MARKER = "LAYOUT";
+
+// Compressed copies are kept only if they save at least this fraction
+static const double MIN_COMPRESSION_GAIN = 0.1;
+
+// Order in which an object's data file is looked for; recompress() only
+// moves objects towards the front of the list, and writes the new file
+// before removing the old one, so a lookup in this order never misses both
+static const Codec LOOKUP_ORDER[] = {Codec::DEFLATE_BEST, Codec::DEFLATE_FAST, Codec::NONE};
+
+void ObjectStore::init(const string& objects_dir) {
+    objects_root = objects_dir;
+    mkdir(objects_root.c_str(), 0755);
+    mkdir((objects_root + "/tmp").c_str(), 0755);
+    upgrade_layout();
+}
+
+string ObjectStore::base_path(const string& object_id) {
+    return objects_root + "/" + object_id.substr(0, 2) + "/" + object_id.substr(2, 2) + "/" + object_id;
+}
+
+void ObjectStore::upgrade_layout() {
+    string marker = objects_root + "/" + LAYOUT_MARKER;
+    struct stat st;
+    if (stat(marker.c_str(), &st) == 0) return;
+
+    // Objects used to sit one level down (ab/<id>); move them (and their
+    // reference counts) to ab/cd/<id>. Renames within one filesystem, so
+    // this is quick even for a large store, and safe to redo if interrupted.
+    size_t moved = 0;
+    DIR* root = opendir(objects_root.c_str());
+    if (root) {
+        struct dirent* shard;
+        while ((shard = readdir(root)) != nullptr) {
+            if (strlen(shard->d_name) != 2 || shard->d_name[0] == '.') continue;
+            string shard_path = objects_root + "/" + shard->d_name;
+            DIR* dir = opendir(shard_path.c_str());
+            if (!dir) continue;
+            struct dirent* entry;
+            while ((entry = readdir(dir)) != nullptr) {
+                string name = entry->d_name;
+                if (name.size() < 4 || name[0] == '.') continue;
+                string old_path = shard_path + "/" + name;
+                if (stat(old_path.c_str(), &st) != 0 || !S_ISREG(st.st_mode)) continue;
+                string sub = shard_path + "/" + name.substr(2, 2);
+                mkdir(sub.c_str(), 0755);
+                if (rename(old_path.c_str(), (sub + "/" + name).c_str()) == 0) moved++;
+            }
+            closedir(dir);
+        }
+        closedir(root);
+    }
+
+    FILE* f = fopen(marker.c_str(), "w");
+    if (f) {
+        fprintf(f, "2\n");
+        fclose(f);
+    }
+    if (moved > 0) {
+        cerr << "[VFS] ✓ Moved " << moved << " object files to the two-level layout" << endl;
+    }
+}
+
+string ObjectStore::object_path(const string& object_id) {
+    Codec codec;
+    struct stat st;
+    if (!locate(object_id, codec, st)) codec = Codec::NONE;
+    return base_path(object_id) + codec_suffix(codec);
+}
+
+string ObjectStore::ref_path(const string& object_id) {
+    return base_path(object_id) + ".ref";
+}
+
+bool ObjectStore::locate(const string& object_id, Codec& codec, struct stat& st) {
+    for (Codec c : LOOKUP_ORDER) {
+        if (stat((base_path(object_id) + codec_suffix(c)).c_str(), &st) == 0) {
+            codec = c;
+            return true;
+        }
+    }
+    return false;
+}
+
+int ObjectStore::open_object(const string& object_id, Codec& codec) {
+    // A second pass covers a recompress() finishing between two lookups
+    for (int pass = 0; pass < 2; pass++) {
+        for (Codec c : LOOKUP_ORDER) {
+            int fd = open((base_path(object_id) + codec_suffix(c)).c_str(), O_RDONLY);
+            if (fd != -1) {
+                codec = c;
+                return fd;
+            }
+        }
+    }
+    return -1;
+}
+
+Codec ObjectStore::object_codec(const string& object_id) {
+    Codec codec;
+    struct stat st;
+    return locate(object_id, codec, st) ? codec : Codec::NONE;
+}
+
+off_t ObjectStore::stored_size(const string& object_id) {
+    Codec codec;
+    struct stat st;
+    return locate(object_id, codec, st) ? st.st_size : 0;
+}
+
+int ObjectStore::ref_count(const string& object_id) {
+    FILE* f = fopen(ref_path(object_id).c_str(), "r");
+    if (!f) return 0;
+    int count = 0;
+    if (fscanf(f, "%d", &count) != 1) count = 0;
+    fclose(f);
+    return count;
+}
+
+bool ObjectStore::write_ref_count(const string& object_id, int count) {
+    string path = ref_path(object_id);
+    string tmp = path + ".tmp";  // Unique per object, and callers hold the object's lock
+    FILE* f = fopen(tmp.c_str(), "w");
+    if (!f) return false;
+    fprintf(f, "%d\n", count);
+    fclose(f);
+    return rename(tmp.c_str(), path.c_str()) == 0;
+}
+
+int ObjectStore::open_staging(string& tmp_path) {
+    tmp_path = objects_root + "/tmp/obj_XXXXXX";
+    int fd = mkstemp(&tmp_path[0]);
+    if (fd == -1) {
+        cerr << "[VFS] ✗ Failed to create object staging file in " << objects_root << endl;
+    }
+    return fd;
+}
+
+string ObjectStore::stage_compressed(Codec codec, uint64_t raw_size,
+                                     const function<bool(Deflater&)>& fill) {
+    string tmp_path;
+    int fd = open_staging(tmp_path);
+    if (fd == -1) return "";
+
+    Deflater deflater(fd, codec);
+    bool ok = fill(deflater) && deflater.finish();
+    if (close(fd) != 0) ok = false;
+
+    if (!ok || deflater.bytes_out() > raw_size * (1.0 - MIN_COMPRESSION_GAIN)) {
+        unlink(tmp_path.c_str());
+        return "";
+    }
+    return tmp_path;
+}
+
+string ObjectStore::commit_staging(const string& tmp_path, const string& object_id, Codec codec) {
+    string final_path = base_path(object_id) + codec_suffix(codec);
+    mkdir((objects_root + "/" + object_id.substr(0, 2)).c_str(), 0755);
+    mkdir((objects_root + "/" + object_id.substr(0, 2) + "/" + object_id.substr(2, 2)).c_str(), 0755);
+
+    // Held across the existence check and the new reference so a concurrent
+    // release() cannot delete the object in between
+    lock_guard<mutex> guard(object_lock(object_id));
+
+    struct stat tmp_st;
+    off_t size = stat(tmp_path.c_str(), &tmp_st) == 0 ? tmp_st.st_size : 0;
+
+    Codec existing;
+    struct stat st;
+    if (locate(object_id, existing, st)) {
+        // Identical content is already stored; just keep the existing copy
+        unlink(tmp_path.c_str());
+        OpStats::add_bytes(StatBytes::STORE_DEDUPED, size);
+    } else if (rename(tmp_path.c_str(), final_path.c_str()) != 0) {
+        unlink(tmp_path.c_str());
+        return "";
+    } else {
+        OpStats::add_bytes(StatBytes::STORE_STORED, size);
+    }
+
+    if (!write_ref_count(object_id, ref_count(object_id) + 1)) return "";
+    return object_id;
+}
+
+string ObjectStore::stage_file(const string& src_path) {
+    int src = open(src_path.c_str(), O_RDONLY);
+    if (src == -1) return "";
+
+    string tmp_path;
+    int dst = open_staging(tmp_path);
+    if (dst == -1) {
+        close(src);
+        return "";
+    }
+
+    // Let the kernel copy (or clone) the data
+    struct stat st;
+    if (fstat(src, &st) == 0) OpStats::add_bytes(StatBytes::STORE_STAGED, st.st_size);
+    bool ok = copy_file_fd(src, dst) != CopyMethod::FAILED;
+    close(src);
+    if (close(dst) != 0) ok = false;
+
+    if (!ok) {
+        unlink(tmp_path.c_str());
+        return "";
+    }
+    return tmp_path;
+}
+
+string ObjectStore::stage_link(const string& src_path) {
+    struct stat st;
+    if (stat(src_path.c_str(), &st) != 0) return "";
+
+    // link() cannot pick a free name the way mkstemp() does
+    static atomic<uint64_t> next_link{0};
+    for (;;) {
+        string tmp_path = objects_root + "/tmp/lnk_" + to_string(getpid()) + "_" + to_string(next_link++);
+        if (link(src_path.c_str(), tmp_path.c_str()) == 0) {
+            OpStats::add_bytes(StatBytes::STORE_LINKED, st.st_size);
+            return tmp_path;
+        }
+        if (errno != EEXIST) return "";
+    }
+}
+
+string ObjectStore::put_staged(const string& staged_path, Codec codec) {
+    int fd = open(staged_path.c_str(), O_RDONLY);
+    if (fd == -1) return "";
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        unlink(staged_path.c_str());
+        return "";
+    }
+
+    // Hash (and, if asked, compress) in a single pass over the data
+    Sha256 hasher;
+    bool read_ok = true;
+    bool hashed = false;
+    auto hash_into = [&](Deflater* deflater) {
+        char buf[65536];
+        ssize_t n;
+        while ((n = read(fd, buf, sizeof(buf))) > 0) {
+            hasher.update(buf, n);
+            if (deflater && !deflater->write(buf, n)) return false;
+        }
+        read_ok = (n == 0);
+        hashed = read_ok;
+        return read_ok;
+    };
+
+    string compressed;
+    if (codec != Codec::NONE) {
+        compressed = stage_compressed(codec, st.st_size, [&](Deflater& d) { return hash_into(&d); });
+    }
+    if (!hashed && read_ok && lseek(fd, 0, SEEK_SET) == 0) {
+        // Compression gave up part way: hash the whole content again from the start
+        hasher = Sha256();
+        hash_into(nullptr);
+    }
+    close(fd);
+
+    if (!read_ok) {
+        if (!compressed.empty()) unlink(compressed.c_str());
+        unlink(staged_path.c_str());
+        return "";
+    }
+
+    string object_id = hasher.final_hex();
+    if (compressed.empty()) {
+        return commit_staging(staged_path, object_id, Codec::NONE);
+    }
+    unlink(staged_path.c_str());
+    return commit_staging(compressed, object_id, codec);
+}
+
+string ObjectStore::put_file(const string& src_path, Codec codec) {
+    // On a reflink-capable filesystem only the hashing pass touches the data
+    string staged_path = stage_file(src_path);
+    if (staged_path.empty()) return "";
+    return put_staged(staged_path, codec);
+}
+
+string ObjectStore::put_data(const string& data, Codec codec) {
+    string object_id = Sha256::hex(data.data(), data.size());
+
+    if (codec != Codec::NONE) {
+        string compressed = stage_compressed(codec, data.size(),
+            [&data](Deflater& d) { return d.write(data.data(), data.size()); });
+        if (!compressed.empty()) return commit_staging(compressed, object_id, codec);
+    }
+
+    string tmp_path;
+    int dst = open_staging(tmp_path);
+    if (dst == -1) return "";
+
+    size_t done = 0;
+    while (done < data.size()) {
+        ssize_t n = write(dst, data.data() + done, data.size() - done);
+        if (n <= 0) break;
+        done += n;
+    }
+    close(dst);
+
+    if (done != data.size()) {
+        unlink(tmp_path.c_str());
+        return "";
+    }
+
+    return commit_staging(tmp_path, object_id, Codec::NONE);
+}
+
+bool ObjectStore::read_object(const string& object_id, string& out) {
+    out.clear();
+    Codec codec;
+    int fd = open_object(object_id, codec);
+    if (fd == -1) return false;
+
+    bool ok;
+    if (codec == Codec::NONE) {
+        char buf[65536];
+        ssize_t n;
+        while ((n = read(fd, buf, sizeof(buf))) > 0) {
+            out.append(buf, n);
+        }
+        ok = (n == 0);
+    } else {
+        ok = inflate_fd(fd, [&out](const char* data, size_t len) {
+            out.append(data, len);
+            return true;
+        });
+    }
+    close(fd);
+    return ok;
+}
+
+bool ObjectStore::restore_object(const string& object_id, const string& dst_path) {
+    Codec codec;
+    int src = open_object(object_id, codec);
+    if (src == -1) return false;
+
+    int dst = open(dst_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (dst == -1) {
+        close(src);
+        return false;
+    }
+
+    bool ok;
+    if (codec == Codec::NONE) {
+        ok = copy_file_fd(src, dst) != CopyMethod::FAILED;
+    } else {
+        ok = inflate_fd(src, [dst](const char* data, size_t len) {
+            size_t done = 0;
+            while (done < len) {
+                ssize_t n = write(dst, data + done, len - done);
+                if (n <= 0) return false;
+                done += n;
+            }
+            return true;
+        });
+    }
+    close(src);
+    if (close(dst) != 0) ok = false;
+    return ok;
+}
+
+int ObjectStore::open_raw(const string& object_id) {
+    Codec codec;
+    int fd = open_object(object_id, codec);
+    if (fd != -1 && codec != Codec::NONE) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+bool ObjectStore::recompress(const string& object_id, Codec codec) {
+    lock_guard<mutex> guard(object_lock(object_id));
+
+    Codec current;
+    int src = open_object(object_id, current);
+    if (src == -1) return false;
+
+    // Objects stored raw were found not to compress; leave them alone
+    if (current == codec || current == Codec::NONE) {
+        close(src);
+        return current == codec;
+    }
+
+    string tmp_path;
+    int dst = open_staging(tmp_path);
+    if (dst == -1) {
+        close(src);
+        return false;
+    }
+
+    Deflater deflater(dst, codec);
+    bool ok = inflate_fd(src, [&deflater](const char* data, size_t len) {
+        return deflater.write(data, len);
+    }) && deflater.finish();
+    close(src);
+    if (close(dst) != 0) ok = false;
+
+    // The new file goes in before the old one goes away (see LOOKUP_ORDER)
+    string old_path = base_path(object_id) + codec_suffix(current);
+    if (!ok || rename(tmp_path.c_str(), (base_path(object_id) + codec_suffix(codec)).c_str()) != 0) {
+        unlink(tmp_path.c_str());
+        return false;
+    }
+    unlink(old_path.c_str());
+    return true;
+}
+
+bool ObjectStore::add_ref(const string& object_id) {
+    lock_guard<mutex> guard(object_lock(object_id));
+    return write_ref_count(object_id, ref_count(object_id) + 1);
+}
+
+off_t ObjectStore::release(const string& object_id) {
+    lock_guard<mutex> guard(object_lock(object_id));
+    int count = ref_count(object_id) - 1;
+    if (count > 0) {
+        write_ref_count(object_id, count);
+        return 0;
+    }
+
+    off_t freed = 0;
+    for (Codec codec : LOOKUP_ORDER) {
+        string path = base_path(object_id) + codec_suffix(codec);
+        struct stat st;
+        if (stat(path.c_str(), &st) == 0 && unlink(path.c_str()) == 0) freed += st.st_size;
+    }
+    unlink(ref_path(object_id).c_str());
+    return freed;
+}
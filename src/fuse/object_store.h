@@ -0,0 +1,106 @@
+#pragma once
+
+#include <string>
+#include <sys/types.h>
+#include "compression.h"
+
+using namespace std;
+
+// Content-addressed store for version data.
+// Each distinct content is kept once under its SHA-256 id, fanned out over
+// two directory levels (ab/cd/abcd...) so no directory grows too large; a
+// small reference count next to the object tracks how many versions use it.
+// Objects may be stored compressed: the id is always the hash of the
+// uncompressed content and the file suffix names the codec.
+class ObjectStore {
+public:
+    // Initialize the store under the given directory
+    static void init(const string& objects_dir);
+
+    // Store the contents of a file and take a reference on it
+    // Returns the object id, or an empty string on failure
+    static string put_file(const string& src_path, Codec codec = Codec::NONE);
+
+    // Copy (or reflink) a file into a private staging file without hashing it,
+    // freezing its current content; returns the staging path or "" on failure.
+    // Without reflink support this copies the whole file before returning.
+    static string stage_file(const string& src_path);
+
+    // Hard-link a file into staging instead of copying it. The staged file
+    // only stays frozen once the caller has removed every other name of it;
+    // returns the staging path, or "" with errno set (EXDEV: another filesystem)
+    static string stage_link(const string& src_path);
+
+    // Create an empty private staging file to be filled by the caller
+    // Returns an open fd (and its path in tmp_path), or -1 on failure
+    static int open_staging(string& tmp_path);
+
+    // Hash a staged file and move it into the store (no data copy)
+    static string put_staged(const string& staged_path, Codec codec = Codec::NONE);
+
+    // Store an in-memory buffer and take a reference on it
+    static string put_data(const string& data, Codec codec = Codec::NONE);
+
+    // Read a whole object into memory (decompressed)
+    static bool read_object(const string& object_id, string& out);
+
+    // Write an object's content to a file, creating or truncating it.
+    // Raw objects go through the copy engine, compressed ones are inflated
+    // chunk by chunk straight into the destination.
+    static bool restore_object(const string& object_id, const string& dst_path);
+
+    // Open an object stored raw for reading its content in place;
+    // -1 if it does not exist or is compressed
+    static int open_raw(const string& object_id);
+
+    // Re-encode a stored object with another codec (same id, same content)
+    static bool recompress(const string& object_id, Codec codec);
+
+    // Codec the object is currently stored with
+    static Codec object_codec(const string& object_id);
+
+    // Bytes the object takes on disk (0 if it does not exist)
+    static off_t stored_size(const string& object_id);
+
+    // Take an extra reference on an existing object
+    static bool add_ref(const string& object_id);
+
+    // Drop a reference; the object is deleted once nothing uses it.
+    // Returns the bytes that freed (0 while other references remain)
+    static off_t release(const string& object_id);
+
+    // Current reference count (0 if the object does not exist)
+    static int ref_count(const string& object_id);
+
+    // Path of the object's data on disk (with the suffix of its codec)
+    static string object_path(const string& object_id);
+
+private:
+    static string objects_root;
+
+    // Helper: Path of the object without any codec suffix
+    static string base_path(const string& object_id);
+
+    // Helper: Move objects from the old single-level layout
+    static void upgrade_layout();
+
+    // Helper: Find the object's data file; false if it does not exist
+    static bool locate(const string& object_id, Codec& codec, struct stat& st);
+
+    // Helper: Open the object's data file for reading
+    static int open_object(const string& object_id, Codec& codec);
+
+    // Helper: Deflate `raw_size` bytes produced by `fill` into a new staging file;
+    // returns its path, or "" if compression failed or did not pay off
+    static string stage_compressed(Codec codec, uint64_t raw_size,
+                                   const function<bool(Deflater&)>& fill);
+
+    // Helper: Move a fully written staging file into place and reference it
+    static string commit_staging(const string& tmp_path, const string& object_id, Codec codec);
+
+    // Helper: Path of the reference count file for an object
+    static string ref_path(const string& object_id);
+
+    // Helper: Overwrite the reference count of an object
+    static bool write_ref_count(const string& object_id, int count);
+};
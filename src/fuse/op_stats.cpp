@@ -0,0 +1,282 @@
+#include "op_stats.h"
+#include <bit>
+#include <atomic>
+#include <condition_variable>
+#include <cstdio>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <iostream>
+
+using namespace std;
+
+static const size_t OPS = (size_t)StatOp::COUNT;
+static const size_t BYTE_KINDS = (size_t)StatBytes::COUNT;
+
+// Bucket b counts latencies in [2^(b-1), 2^b) nanoseconds; the last one
+// takes everything slower (2^47 ns is about 39 hours)
+static const size_t BUCKETS = 48;
+
+static const char* const OP_NAMES[OPS] = {
+    "lookup", "forget", "getattr", "setattr", "truncate", "readlink", "mkdir", "unlink", "rmdir", "rename",
+    "open", "create", "read", "write", "flush", "fsync", "release",
+    "opendir", "readdir", "readdirplus", "releasedir", "statfs",
+    "create_version", "create_version_async", "commit_version", "get_versions", "get_version_count",
+    "restore_version", "read_version", "delete_versions", "load_metadata", "save_metadata", "versions_around",
+};
+
+static const char* const BYTE_NAMES[BYTE_KINDS] = {
+    "read", "written", "store_staged", "store_linked", "store_stored", "store_deduped",
+};
+
+static bool is_store_op(size_t op) {
+    return op >= (size_t)StatOp::CREATE_VERSION;
+}
+
+// One thread's counters. Only the owning thread writes them, so updates are
+// plain load/store pairs; the atomics only keep concurrent readers defined.
+struct ThreadStats {
+    atomic<uint64_t> count[OPS];
+    atomic<uint64_t> failed[OPS];
+    atomic<uint64_t> total_ns[OPS];
+    atomic<uint64_t> max_ns[OPS];
+    atomic<uint64_t> buckets[OPS][BUCKETS];
+    atomic<uint64_t> bytes[BYTE_KINDS];
+};
+
+// A merged copy
+struct StatsSnapshot {
+    uint64_t count[OPS] = {};
+    uint64_t failed[OPS] = {};
+    uint64_t total_ns[OPS] = {};
+    uint64_t max_ns[OPS] = {};
+    uint64_t buckets[OPS][BUCKETS] = {};
+    uint64_t bytes[BYTE_KINDS] = {};
+
+    void add(const ThreadStats& t) {
+        for (size_t i = 0; i < OPS; i++) {
+            count[i] += t.count[i].load(memory_order_relaxed);
+            failed[i] += t.failed[i].load(memory_order_relaxed);
+            total_ns[i] += t.total_ns[i].load(memory_order_relaxed);
+            max_ns[i] = max(max_ns[i], t.max_ns[i].load(memory_order_relaxed));
+            for (size_t b = 0; b < BUCKETS; b++) buckets[i][b] += t.buckets[i][b].load(memory_order_relaxed);
+        }
+        for (size_t k = 0; k < BYTE_KINDS; k++) bytes[k] += t.bytes[k].load(memory_order_relaxed);
+    }
+};
+
+static mutex registry_mutex;
+static vector<ThreadStats*> live_threads;
+static ThreadStats retired;  // Sum of the threads that have exited
+static const chrono::steady_clock::time_point started = chrono::steady_clock::now();
+
+static void bump(atomic<uint64_t>& counter, uint64_t n) {
+    counter.store(counter.load(memory_order_relaxed) + n, memory_order_relaxed);
+}
+
+// Registers the thread's block on first use and folds it into `retired` on exit
+struct ThreadStatsHolder {
+    ThreadStats* stats = nullptr;
+
+    ThreadStats& get() {
+        if (!stats) {
+            stats = new ThreadStats();
+            lock_guard<mutex> lock(registry_mutex);
+            live_threads.push_back(stats);
+        }
+        return *stats;
+    }
+
+    ~ThreadStatsHolder() {
+        if (!stats) return;
+        lock_guard<mutex> lock(registry_mutex);
+        StatsSnapshot mine;
+        mine.add(*stats);
+        for (size_t i = 0; i < OPS; i++) {
+            bump(retired.count[i], mine.count[i]);
+            bump(retired.failed[i], mine.failed[i]);
+            bump(retired.total_ns[i], mine.total_ns[i]);
+            if (mine.max_ns[i] > retired.max_ns[i].load(memory_order_relaxed)) {
+                retired.max_ns[i].store(mine.max_ns[i], memory_order_relaxed);
+            }
+            for (size_t b = 0; b < BUCKETS; b++) bump(retired.buckets[i][b], mine.buckets[i][b]);
+        }
+        for (size_t k = 0; k < BYTE_KINDS; k++) bump(retired.bytes[k], mine.bytes[k]);
+        erase(live_threads, stats);
+        delete stats;
+    }
+};
+
+static thread_local ThreadStatsHolder holder;
+static thread_local StatTimer* current_timer = nullptr;
+
+static StatsSnapshot merged() {
+    StatsSnapshot snap;
+    lock_guard<mutex> lock(registry_mutex);
+    snap.add(retired);
+    for (ThreadStats* t : live_threads) snap.add(*t);
+    return snap;
+}
+
+void OpStats::record(StatOp op, uint64_t ns, bool failed) {
+    ThreadStats& t = holder.get();
+    size_t i = (size_t)op;
+    bump(t.count[i], 1);
+    if (failed) bump(t.failed[i], 1);
+    bump(t.total_ns[i], ns);
+    if (ns > t.max_ns[i].load(memory_order_relaxed)) t.max_ns[i].store(ns, memory_order_relaxed);
+    bump(t.buckets[i][min<size_t>(bit_width(ns), BUCKETS - 1)], 1);
+}
+
+void OpStats::add_bytes(StatBytes kind, uint64_t bytes) {
+    bump(holder.get().bytes[(size_t)kind], bytes);
+}
+
+// Upper bound (in microseconds) of the bucket holding the p-th quantile,
+// capped at the slowest time seen
+static double quantile_us(const StatsSnapshot& s, size_t op, double p) {
+    uint64_t rank = (uint64_t)(p * s.count[op]);
+    uint64_t seen = 0;
+    for (size_t b = 0; b < BUCKETS; b++) {
+        seen += s.buckets[op][b];
+        if (seen > rank) return min<uint64_t>(1ULL << b, s.max_ns[op]) / 1000.0;
+    }
+    return s.max_ns[op] / 1000.0;
+}
+
+string OpStats::render_text() {
+    StatsSnapshot s = merged();
+    double uptime = chrono::duration<double>(chrono::steady_clock::now() - started).count();
+
+    string out;
+    char line[256];
+    snprintf(line, sizeof(line), "uptime %.0f s\n\n%-22s %12s %8s %10s %10s %10s %10s %12s\n", uptime,
+             "operation", "count", "errors", "avg_us", "p50_us", "p90_us", "p99_us", "max_us");
+    out += line;
+    for (size_t i = 0; i < OPS; i++) {
+        if (s.count[i] == 0) continue;
+        snprintf(line, sizeof(line), "%-22s %12llu %8llu %10.1f %10.1f %10.1f %10.1f %12.1f\n", OP_NAMES[i],
+                 (unsigned long long)s.count[i], (unsigned long long)s.failed[i],
+                 s.total_ns[i] / 1000.0 / s.count[i], quantile_us(s, i, 0.50), quantile_us(s, i, 0.90),
+                 quantile_us(s, i, 0.99), s.max_ns[i] / 1000.0);
+        out += line;
+    }
+
+    out += "\n";
+    for (size_t k = 0; k < BYTE_KINDS; k++) {
+        snprintf(line, sizeof(line), "bytes_%-16s %12llu\n", BYTE_NAMES[k], (unsigned long long)s.bytes[k]);
+        out += line;
+    }
+    out += "\n(percentiles are upper bounds of power-of-two buckets)\n";
+    return out;
+}
+
+string OpStats::render_prometheus() {
+    StatsSnapshot s = merged();
+    string out;
+    char line[256];
+
+    out += "# HELP vertext_op_duration_seconds Time spent in filesystem requests and version store calls.\n"
+           "# TYPE vertext_op_duration_seconds histogram\n";
+    for (size_t i = 0; i < OPS; i++) {
+        if (s.count[i] == 0) continue;
+        const char* layer = is_store_op(i) ? "store" : "fs";
+
+        // Empty buckets at either end carry no information
+        size_t first = 0, last = BUCKETS - 1;
+        while (first < last && s.buckets[i][first] == 0) first++;
+        while (last > first && s.buckets[i][last] == 0) last--;
+        uint64_t cumulative = 0;
+        for (size_t b = first; b <= last && b < BUCKETS - 1; b++) {
+            cumulative += s.buckets[i][b];
+            snprintf(line, sizeof(line), "vertext_op_duration_seconds_bucket{layer=\"%s\",op=\"%s\",le=\"%.9g\"} %llu\n",
+                     layer, OP_NAMES[i], (double)(1ULL << b) / 1e9, (unsigned long long)cumulative);
+            out += line;
+        }
+        snprintf(line, sizeof(line),
+                 "vertext_op_duration_seconds_bucket{layer=\"%s\",op=\"%s\",le=\"+Inf\"} %llu\n"
+                 "vertext_op_duration_seconds_sum{layer=\"%s\",op=\"%s\"} %.9f\n"
+                 "vertext_op_duration_seconds_count{layer=\"%s\",op=\"%s\"} %llu\n",
+                 layer, OP_NAMES[i], (unsigned long long)s.count[i],
+                 layer, OP_NAMES[i], s.total_ns[i] / 1e9,
+                 layer, OP_NAMES[i], (unsigned long long)s.count[i]);
+        out += line;
+    }
+
+    out += "# HELP vertext_op_errors_total Requests that returned an error.\n"
+           "# TYPE vertext_op_errors_total counter\n";
+    for (size_t i = 0; i < OPS; i++) {
+        if (s.count[i] == 0) continue;
+        snprintf(line, sizeof(line), "vertext_op_errors_total{layer=\"%s\",op=\"%s\"} %llu\n",
+                 is_store_op(i) ? "store" : "fs", OP_NAMES[i], (unsigned long long)s.failed[i]);
+        out += line;
+    }
+
+    out += "# HELP vertext_bytes_total Bytes moved through the mount and into the version store.\n"
+           "# TYPE vertext_bytes_total counter\n";
+    for (size_t k = 0; k < BYTE_KINDS; k++) {
+        snprintf(line, sizeof(line), "vertext_bytes_total{kind=\"%s\"} %llu\n", BYTE_NAMES[k],
+                 (unsigned long long)s.bytes[k]);
+        out += line;
+    }
+    return out;
+}
+
+static mutex dump_mutex;
+static condition_variable dump_wake;
+static thread dump_thread;
+static bool dump_stopping = false;
+
+static void write_dump(const string& path) {
+    string tmp = path + ".tmp";
+    FILE* f = fopen(tmp.c_str(), "w");
+    if (!f) {
+        cerr << "[VFS] ✗ Cannot write stats to " << tmp << endl;
+        return;
+    }
+    string report = OpStats::render_prometheus();
+    bool ok = fwrite(report.data(), 1, report.size(), f) == report.size();
+    if (fclose(f) != 0) ok = false;
+    if (!ok || rename(tmp.c_str(), path.c_str()) != 0) remove(tmp.c_str());
+}
+
+void OpStats::start_dump(const string& path, unsigned interval) {
+    lock_guard<mutex> lock(dump_mutex);
+    if (dump_thread.joinable()) return;
+
+    dump_stopping = false;
+    dump_thread = thread([path, interval] {
+        unique_lock<mutex> lock(dump_mutex);
+        while (!dump_wake.wait_for(lock, chrono::seconds(max(interval, 1u)), [] { return dump_stopping; })) {
+            lock.unlock();
+            write_dump(path);
+            lock.lock();
+        }
+        lock.unlock();
+        write_dump(path);
+    });
+}
+
+void OpStats::stop_dump() {
+    {
+        lock_guard<mutex> lock(dump_mutex);
+        if (!dump_thread.joinable()) return;
+        dump_stopping = true;
+    }
+    dump_wake.notify_all();
+    dump_thread.join();
+}
+
+StatTimer::StatTimer(StatOp op) : op(op), start(chrono::steady_clock::now()), outer(current_timer) {
+    current_timer = this;
+}
+
+StatTimer::~StatTimer() {
+    current_timer = outer;
+    uint64_t ns = chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count();
+    OpStats::record(op, ns, failed);
+}
+
+void StatTimer::fail_current() {
+    if (current_timer) current_timer->fail();
+}
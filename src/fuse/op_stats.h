@@ -0,0 +1,89 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <type_traits>
+
+using namespace std;
+
+// Operations that are counted and timed
+enum class StatOp : int {
+    // Filesystem requests (either mount)
+    LOOKUP, FORGET, GETATTR, SETATTR, TRUNCATE, READLINK, MKDIR, UNLINK, RMDIR, RENAME,
+    OPEN, CREATE, READ, WRITE, FLUSH, FSYNC, RELEASE,
+    OPENDIR, READDIR, READDIRPLUS, RELEASEDIR, STATFS,
+    // Version store
+    CREATE_VERSION, CREATE_VERSION_ASYNC, COMMIT_VERSION, GET_VERSIONS, GET_VERSION_COUNT,
+    RESTORE_VERSION, READ_VERSION, DELETE_VERSIONS, LOAD_METADATA, SAVE_METADATA, VERSIONS_AROUND,
+    COUNT
+};
+
+// Byte counters
+enum class StatBytes : int {
+    READ,            // Requested by readers of the mount (spliced reads are not clipped at EOF)
+    WRITTEN,         // Written through the mount
+    STORE_STAGED,    // Copied out of live files to freeze pre-images
+    STORE_LINKED,    // Frozen by hard-linking a file a rename replaces (never copied)
+    STORE_STORED,    // Added to the object store as new objects
+    STORE_DEDUPED,   // Offered to the object store but already there
+    COUNT
+};
+
+// Per-operation counters and log2-bucketed latency histograms. Each thread
+// updates its own block without locking; readers merge all blocks (and
+// those of threads that have exited) when a report is rendered.
+class OpStats {
+public:
+    static void record(StatOp op, uint64_t ns, bool failed);
+    static void add_bytes(StatBytes kind, uint64_t bytes);
+
+    // Human-readable report (served as /.vertext/stats)
+    static string render_text();
+
+    // Prometheus text exposition format (served as /.vertext/stats.prom)
+    static string render_prometheus();
+
+    // Rewrite `path` (atomically) with the Prometheus report every
+    // `interval` seconds and once more on stop, for a textfile collector
+    static void start_dump(const string& path, unsigned interval);
+    static void stop_dump();
+};
+
+// Times the enclosing scope as one `op`
+class StatTimer {
+public:
+    explicit StatTimer(StatOp op);
+    ~StatTimer();
+
+    void fail() { failed = true; }
+
+    // Mark the innermost running timer of this thread as failed
+    // (for handlers that report errors through a reply call)
+    static void fail_current();
+
+private:
+    StatOp op;
+    bool failed = false;
+    chrono::steady_clock::time_point start;
+    StatTimer* outer;
+};
+
+// Timed<StatOp::X, handler>::call has the handler's signature and times it;
+// a negative return value counts as a failure
+template <StatOp OP, auto FN>
+struct Timed;
+
+template <StatOp OP, typename R, typename... Args, R (*FN)(Args...)>
+struct Timed<OP, FN> {
+    static R call(Args... args) {
+        StatTimer timer(OP);
+        if constexpr (is_void_v<R>) {
+            FN(args...);
+        } else {
+            R res = FN(args...);
+            if (res < 0) timer.fail();
+            return res;
+        }
+    }
+};
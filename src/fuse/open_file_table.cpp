@@ -0,0 +1,72 @@
+#include "open_file_table.h"
+#include "../common/paths.h"
+#include <unordered_map>
+
+using namespace std;
+
+static const size_t SHARD_COUNT = 64;
+
+struct Shard {
+    mutex lock;
+    unordered_map<uint64_t, shared_ptr<OpenFileInfo>> entries;
+};
+
+static Shard shards[SHARD_COUNT];
+
+static Shard& shard_for(uint64_t fh) {
+    // File handles are small, dense fd numbers, so a plain modulo spreads them well
+    return shards[fh % SHARD_COUNT];
+}
+
+shared_ptr<OpenFileInfo> OpenFileTable::insert(uint64_t fh, const string& backend_path,
+                                               bool version_created, off_t original_size) {
+    auto info = make_shared<OpenFileInfo>();
+    info->backend_path = backend_path;
+    info->has_been_written = false;
+    info->version_created = version_created;
+    info->original_size = original_size;
+
+    Shard& shard = shard_for(fh);
+    lock_guard<mutex> guard(shard.lock);
+    shard.entries[fh] = info;
+    return info;
+}
+
+shared_ptr<OpenFileInfo> OpenFileTable::find(uint64_t fh) {
+    Shard& shard = shard_for(fh);
+    lock_guard<mutex> guard(shard.lock);
+    auto it = shard.entries.find(fh);
+    return it != shard.entries.end() ? it->second : nullptr;
+}
+
+shared_ptr<OpenFileInfo> OpenFileTable::remove(uint64_t fh) {
+    Shard& shard = shard_for(fh);
+    lock_guard<mutex> guard(shard.lock);
+    auto it = shard.entries.find(fh);
+    if (it == shard.entries.end()) return nullptr;
+    shared_ptr<OpenFileInfo> info = it->second;
+    shard.entries.erase(it);
+    return info;
+}
+
+void OpenFileTable::renamed(const string& from, const string& to, bool exchange) {
+    // Renames are rare next to writes, so a full walk is fine here
+    for (Shard& shard : shards) {
+        lock_guard<mutex> guard(shard.lock);
+        for (auto& [fh, info] : shard.entries) {
+            lock_guard<mutex> info_guard(info->lock);
+            info->backend_path = renamed_path(info->backend_path, from, to, exchange);
+        }
+    }
+}
+
+bool OpenFileTable::is_open(const string& backend_path) {
+    for (Shard& shard : shards) {
+        lock_guard<mutex> guard(shard.lock);
+        for (auto& [fh, info] : shard.entries) {
+            lock_guard<mutex> info_guard(info->lock);
+            if (info->backend_path == backend_path) return true;
+        }
+    }
+    return false;
+}
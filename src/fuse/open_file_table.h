@@ -0,0 +1,41 @@
+#pragma once
+
+#include <sys/types.h>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+
+using namespace std;
+
+// Write-tracking state for one open file handle
+struct OpenFileInfo {
+    mutex lock;             // Serializes the version-before-first-write check
+    string backend_path;
+    bool has_been_written;
+    bool version_created;
+    off_t original_size;
+    bool journaled = false;  // Writes are captured by the block journal
+};
+
+// Table of open handles, keyed by the FUSE file handle (fi->fh).
+// Sharded so concurrent requests on different handles rarely share a lock;
+// entries are shared_ptrs so a handler can keep using one after dropping
+// the shard lock.
+class OpenFileTable {
+public:
+    static shared_ptr<OpenFileInfo> insert(uint64_t fh, const string& backend_path,
+                                           bool version_created, off_t original_size);
+
+    static shared_ptr<OpenFileInfo> find(uint64_t fh);
+
+    // Remove and return the entry (nullptr if the handle was not tracked)
+    static shared_ptr<OpenFileInfo> remove(uint64_t fh);
+
+    // Point the handles open on (or below) `from` at the new path after a
+    // rename, or an exchange with `to`
+    static void renamed(const string& from, const string& to, bool exchange);
+
+    // Whether any handle is open on `backend_path`
+    static bool is_open(const string& backend_path);
+};
@@ -0,0 +1,142 @@
+#include "retention.h"
+#include <cstdlib>
+#include <set>
+#include <sstream>
+#include <utility>
+
+using namespace std;
+
+// Bucket width of each tier name, in seconds
+static bool bucket_for(const string& name, time_t& bucket) {
+    if (name == "all") bucket = 0;
+    else if (name == "minutely") bucket = 60;
+    else if (name == "hourly") bucket = 3600;
+    else if (name == "daily") bucket = 86400;
+    else if (name == "weekly") bucket = 7 * 86400;
+    else return false;
+    return true;
+}
+
+// "90", "30s", "15m", "1h", "30d", "2w", "1y"
+static bool parse_duration(const string& text, time_t& seconds) {
+    char* end;
+    long long value = strtoll(text.c_str(), &end, 10);
+    if (end == text.c_str() || value <= 0) return false;
+
+    long long unit = 1;
+    string suffix(end);
+    if (suffix == "" || suffix == "s") unit = 1;
+    else if (suffix == "m") unit = 60;
+    else if (suffix == "h") unit = 3600;
+    else if (suffix == "d") unit = 86400;
+    else if (suffix == "w") unit = 7 * 86400;
+    else if (suffix == "y") unit = 365 * 86400;
+    else return false;
+
+    seconds = value * unit;
+    return true;
+}
+
+// "4096", "512K", "100M", "1G", "2T"
+static bool parse_size(const string& text, off_t& bytes) {
+    char* end;
+    long long value = strtoll(text.c_str(), &end, 10);
+    if (end == text.c_str() || value <= 0) return false;
+
+    int shift = 0;
+    string suffix(end);
+    if (suffix == "" || suffix == "B") shift = 0;
+    else if (suffix == "K") shift = 10;
+    else if (suffix == "M") shift = 20;
+    else if (suffix == "G") shift = 30;
+    else if (suffix == "T") shift = 40;
+    else return false;
+
+    bytes = (off_t)value << shift;
+    return true;
+}
+
+bool RetentionPolicy::parse(const string& text) {
+    *this = RetentionPolicy();
+
+    RetentionPolicy parsed;
+    istringstream iss(text);
+    string item;
+    while (getline(iss, item, ',')) {
+        if (item.empty()) continue;
+        size_t colon = item.find(':');
+        if (colon == string::npos) return false;
+        string name = item.substr(0, colon);
+        string value = item.substr(colon + 1);
+
+        if (name == "max") {
+            int count = atoi(value.c_str());
+            if (count <= 0) return false;
+            parsed.max_versions = count;
+        } else if (name == "max_bytes") {
+            if (!parse_size(value, parsed.max_bytes)) return false;
+        } else {
+            RetentionTier tier;
+            if (!bucket_for(name, tier.bucket) || !parse_duration(value, tier.max_age)) return false;
+            // Tiers must cover successively older versions
+            if (!parsed.tiers.empty() && tier.max_age <= parsed.tiers.back().max_age) return false;
+            parsed.tiers.push_back(tier);
+        }
+    }
+
+    parsed.spec = text;
+    *this = parsed;
+    return true;
+}
+
+bool RetentionPolicy::empty() const {
+    return tiers.empty() && max_versions == 0 && max_bytes == 0;
+}
+
+const string& RetentionPolicy::describe() const {
+    return spec;
+}
+
+vector<int> RetentionPolicy::select(const vector<FileVersion>& versions, time_t now) const {
+    vector<int> doomed;
+    if (versions.empty() || empty()) return doomed;
+
+    // Walk newest first, so the first version seen in a bucket is the one it keeps
+    set<pair<size_t, time_t>> buckets_used;
+    int kept = 0;
+    off_t kept_bytes = 0;
+    bool over_budget = false;  // Once a limit is hit, everything older goes too
+
+    for (size_t i = versions.size(); i-- > 0;) {
+        const FileVersion& ver = versions[i];
+        bool newest = (i + 1 == versions.size());
+        bool keep = true;
+
+        if (!tiers.empty()) {
+            time_t age = now > ver.timestamp ? now - ver.timestamp : 0;
+            size_t t = 0;
+            while (t < tiers.size() && age >= tiers[t].max_age) t++;
+
+            if (t == tiers.size()) {
+                keep = false;  // Older than every tier
+            } else if (tiers[t].bucket != 0) {
+                keep = buckets_used.insert({t, ver.timestamp / tiers[t].bucket}).second;
+            }
+        }
+
+        if (keep && !newest) {
+            if (max_versions > 0 && kept >= max_versions) over_budget = true;
+            if (max_bytes > 0 && kept_bytes + (off_t)ver.stored_size > max_bytes) over_budget = true;
+            keep = !over_budget;
+        }
+        keep = keep || newest;
+
+        if (keep) {
+            kept++;
+            kept_bytes += ver.stored_size;
+        } else {
+            doomed.push_back(ver.version_number);
+        }
+    }
+    return doomed;
+}
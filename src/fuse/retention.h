@@ -0,0 +1,44 @@
+#pragma once
+
+#include "version_manager.h"
+#include <string>
+#include <vector>
+#include <ctime>
+#include <sys/types.h>
+
+using namespace std;
+
+// One age band of a retention policy: versions younger than `max_age`
+// (and older than the previous tier) keep one version per `bucket` seconds,
+// or every version when `bucket` is 0
+struct RetentionTier {
+    time_t max_age;
+    time_t bucket;
+};
+
+// Which versions of a file to keep, e.g.
+//   "all:1h,hourly:1d,daily:30d,max:100,max_bytes:1G"
+// keeps every version for an hour, the newest of each hour for a day, the
+// newest of each day for 30 days, and at most 100 versions / 1 GiB stored
+// per file. Tiers are listed youngest first; versions older than the last
+// tier are deleted. The newest version of a file is always kept.
+class RetentionPolicy {
+public:
+    // False (and the policy left empty) on a malformed spec
+    bool parse(const string& text);
+
+    // Nothing configured: every version is kept
+    bool empty() const;
+
+    // Version numbers to delete from `versions` (which is ordered oldest first)
+    vector<int> select(const vector<FileVersion>& versions, time_t now) const;
+
+    // The spec the policy was parsed from
+    const string& describe() const;
+
+private:
+    string spec;
+    vector<RetentionTier> tiers;
+    int max_versions = 0;      // 0 = no limit
+    off_t max_bytes = 0;       // Stored bytes per file, 0 = no limit
+};
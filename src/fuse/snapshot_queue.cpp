@@ -0,0 +1,125 @@
+#include "snapshot_queue.h"
+#include "version_manager.h"
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include <iostream>
+
+using namespace std;
+
+static mutex queue_mutex;
+static condition_variable work_ready;   // Signalled when a job is queued or on stop
+static condition_variable space_ready;  // Signalled when a job leaves the queue
+static condition_variable job_done;     // Signalled when a job is committed
+
+static vector<deque<SnapshotJob>> queues;  // One per worker
+static vector<thread> workers;
+static unordered_map<string, size_t> pending_by_path;  // Keyed by the history's relative path
+static size_t queued = 0;
+static size_t in_flight = 0;
+static size_t capacity = 0;
+static bool stopping = false;
+
+static void worker_loop(size_t id) {
+    while (true) {
+        SnapshotJob job;
+        {
+            unique_lock<mutex> lock(queue_mutex);
+            work_ready.wait(lock, [id] { return stopping || !queues[id].empty(); });
+            if (queues[id].empty()) return;  // Stopping and drained
+
+            job = move(queues[id].front());
+            queues[id].pop_front();
+            queued--;
+            in_flight++;
+        }
+        space_ready.notify_one();
+
+        if (!VersionManager::commit_staged_version(job.backend_path, job.staged_path, job.timestamp, job.size, job.flags, job.epoch)) {
+            cerr << "[VFS] ✗ Background version failed: " << job.backend_path << endl;
+        }
+
+        {
+            lock_guard<mutex> lock(queue_mutex);
+            in_flight--;
+            auto it = pending_by_path.find(VersionManager::relative_path(job.backend_path));
+            if (it != pending_by_path.end() && --it->second == 0) pending_by_path.erase(it);
+        }
+        job_done.notify_all();
+    }
+}
+
+void SnapshotQueue::start(int worker_count, size_t max_pending) {
+    lock_guard<mutex> lock(queue_mutex);
+    if (!workers.empty() || worker_count <= 0) return;
+
+    stopping = false;
+    capacity = max(max_pending, (size_t)1);
+    queues.assign(worker_count, deque<SnapshotJob>());
+    for (int i = 0; i < worker_count; i++) {
+        workers.emplace_back(worker_loop, (size_t)i);
+    }
+}
+
+void SnapshotQueue::stop() {
+    {
+        lock_guard<mutex> lock(queue_mutex);
+        if (workers.empty()) return;
+        stopping = true;
+    }
+    work_ready.notify_all();
+
+    for (auto& t : workers) t.join();
+
+    lock_guard<mutex> lock(queue_mutex);
+    workers.clear();
+    queues.clear();
+}
+
+bool SnapshotQueue::running() {
+    lock_guard<mutex> lock(queue_mutex);
+    return !workers.empty() && !stopping;
+}
+
+void SnapshotQueue::submit(const SnapshotJob& job) {
+    // The mount and the GC may spell the same file differently
+    string key = VersionManager::relative_path(job.backend_path);
+    {
+        unique_lock<mutex> lock(queue_mutex);
+        // Without workers (or while shutting down) commit on the caller's thread
+        if (workers.empty() || stopping) {
+            lock.unlock();
+            VersionManager::commit_staged_version(job.backend_path, job.staged_path, job.timestamp, job.size, job.flags, job.epoch);
+            return;
+        }
+
+        space_ready.wait(lock, [] { return queued < capacity; });
+
+        size_t id = hash<string>()(key) % queues.size();
+        queues[id].push_back(job);
+        queued++;
+        pending_by_path[key]++;
+    }
+    work_ready.notify_all();
+}
+
+void SnapshotQueue::flush() {
+    unique_lock<mutex> lock(queue_mutex);
+    job_done.wait(lock, [] { return queued == 0 && in_flight == 0; });
+}
+
+void SnapshotQueue::flush(const string& backend_path) {
+    string key = VersionManager::relative_path(backend_path);
+    unique_lock<mutex> lock(queue_mutex);
+    job_done.wait(lock, [&key] { return pending_by_path.count(key) == 0; });
+}
+
+size_t SnapshotQueue::pending() {
+    lock_guard<mutex> lock(queue_mutex);
+    return queued + in_flight;
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <string>
+#include <ctime>
+#include <cstdint>
+#include <sys/types.h>
+
+using namespace std;
+
+// A frozen pre-image waiting to become a version
+struct SnapshotJob {
+    string backend_path;  // File the version belongs to
+    string staged_path;   // Private copy/reflink of the content at freeze time
+    time_t timestamp;     // When the pre-image was frozen
+    off_t size;           // Size at freeze time
+    int flags = 0;        // VERSION_FLAG_* of the version to record
+    uint64_t epoch = 0;   // Tree snapshot epoch at freeze time
+};
+
+// Background workers that turn frozen pre-images into versions
+// (hashing, storing and recording metadata) off the write path.
+// Jobs for the same file always go to the same worker, so a file's
+// versions are committed in the order they were frozen.
+class SnapshotQueue {
+public:
+    // Start `workers` threads; at most `max_pending` jobs may be queued
+    static void start(int workers, size_t max_pending);
+
+    // Finish every queued job, then stop the workers
+    static void stop();
+
+    static bool running();
+
+    // Queue a job, waiting for room if the queue is full
+    static void submit(const SnapshotJob& job);
+
+    // Barrier: wait until every job submitted so far is committed
+    static void flush();
+
+    // Barrier for a single file
+    static void flush(const string& backend_path);
+
+    // Number of jobs queued or being committed
+    static size_t pending();
+};
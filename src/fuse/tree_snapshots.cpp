@@ -0,0 +1,725 @@
+#include "tree_snapshots.h"
+#include "meta_wal.h"
+#include "snapshot_queue.h"
+#include "write_journal.h"
+#include "../common/paths.h"
+#include <sys/stat.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstdint>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <sstream>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+
+using namespace std;
+
+// Files under the snapshot directory:
+//   list      "epoch N" (the current epoch), then one "id|epoch|timestamp|name" per snapshot
+//   changes   one "epoch relative/path" line per path changed in an epoch
+//   moves     one "epoch seconds nanoseconds from<TAB>to" line per directory
+//             move whose files are not all preserved yet
+
+static string snapshot_dir;
+static string root_dir;
+static mutex snapshots_mutex;
+static vector<TreeSnapshot> snapshots;
+static int next_id = 1;
+static atomic<uint64_t> epoch{1};
+static atomic<bool> any_snapshot{false};
+
+static mutex changes_mutex;
+static int changes_fd = -1;
+
+// Paths already preserved, with the epoch they were preserved in
+static mutex preserved_mutex;
+static unordered_map<string, uint64_t> preserved;
+static const size_t PRESERVED_SWEEP_SIZE = 4096;
+
+// Serializes restores (and the snapshots they take)
+static mutex restore_mutex;
+
+// A directory moved while snapshots exist. Each file below it is preserved
+// under both names (its content as the old name's, the new name as not
+// existing yet) by a walk of the new directory, or before its first change
+// if that comes sooner.
+struct DirMove {
+    int id = 0;
+    uint64_t epoch = 0;             // Epoch the move happened in
+    struct timespec when = {};
+    string from, to;                // Backend paths
+    bool confirmed = false;         // The rename happened
+    bool done = false;              // Walked, or the rename failed
+    bool resumed = false;           // Left over from a crash
+    unordered_set<string> handled;  // Paths below the directory ("/a/b") dealt with
+};
+
+static mutex moves_mutex;
+static condition_variable moves_cv;
+static vector<shared_ptr<DirMove>> moves;
+static atomic<size_t> moves_pending{0};
+static int next_move_id = 1;
+static thread walker;
+static bool walker_stop = false;
+
+static bool valid_name(const string& name) {
+    if (name.empty() || name.size() > 255 || name == "." || name == "..") return false;
+    return name.find_first_of("|/\n") == string::npos;
+}
+
+static bool load_list(const string& path, vector<TreeSnapshot>& loaded, uint64_t& loaded_epoch) {
+    ifstream in(path);
+    if (!in) return false;
+
+    string line;
+    while (getline(in, line)) {
+        if (line.compare(0, 6, "epoch ") == 0) {
+            loaded_epoch = strtoull(line.c_str() + 6, nullptr, 10);
+            continue;
+        }
+        istringstream iss(line);
+        string id, snap_epoch, timestamp, name;
+        if (!getline(iss, id, '|') || !getline(iss, snap_epoch, '|') ||
+            !getline(iss, timestamp, '|') || !getline(iss, name)) continue;
+
+        TreeSnapshot snapshot;
+        snapshot.id = atoi(id.c_str());
+        snapshot.epoch = strtoull(snap_epoch.c_str(), nullptr, 10);
+        snapshot.timestamp = strtoll(timestamp.c_str(), nullptr, 10);
+        snapshot.name = name;
+        loaded.push_back(snapshot);
+    }
+    return true;
+}
+
+// Write `text` to `path` through a synced temporary file
+static bool replace_file(const string& path, const string& text) {
+    string tmp = path + ".tmp";
+    int fd = open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd == -1) return false;
+    bool ok = write(fd, text.data(), text.size()) == (ssize_t)text.size() && fdatasync(fd) == 0;
+    if (close(fd) != 0) ok = false;
+    if (!ok || rename(tmp.c_str(), path.c_str()) != 0) {
+        unlink(tmp.c_str());
+        return false;
+    }
+
+    int dir_fd = open(snapshot_dir.c_str(), O_RDONLY | O_DIRECTORY);
+    if (dir_fd != -1) {
+        fsync(dir_fd);
+        close(dir_fd);
+    }
+    return true;
+}
+
+// Replace the list durably: a snapshot must not outlive a crash only half taken
+static bool save_list(const vector<TreeSnapshot>& list, uint64_t current) {
+    string text = "epoch " + to_string(current) + "\n";
+    for (const TreeSnapshot& s : list) {
+        text += to_string(s.id) + "|" + to_string(s.epoch) + "|" + to_string((long long)s.timestamp) + "|" + s.name + "\n";
+    }
+    return replace_file(snapshot_dir + "/list", text);
+}
+
+static void log_change(uint64_t change_epoch, const string& backend_path) {
+    string line = to_string(change_epoch) + " " + VersionManager::relative_path(backend_path) + "\n";
+    lock_guard<mutex> lock(changes_mutex);
+    if (changes_fd == -1) return;
+    if (write(changes_fd, line.data(), line.size()) != (ssize_t)line.size()) {
+        cerr << "[VFS] ✗ Cannot record change of " << backend_path << " for tree snapshots" << endl;
+        return;
+    }
+    if (MetaWal::level() == Durability::STRICT) fdatasync(changes_fd);
+}
+
+// Drop the change lines no snapshot reads any more: a restore of a snapshot
+// only looks at paths changed after its epoch, and one line per path (the
+// newest) is enough. With no snapshot left the log is simply emptied.
+static void compact_changes(bool any_left, uint64_t oldest_epoch) {
+    lock_guard<mutex> lock(changes_mutex);
+    if (changes_fd == -1) return;
+    if (!any_left) {
+        if (ftruncate(changes_fd, 0) != 0) cerr << "[VFS] ✗ Cannot empty the tree snapshot change log" << endl;
+        return;
+    }
+
+    string path = snapshot_dir + "/changes";
+    unordered_map<string, uint64_t> newest;
+    {
+        ifstream in(path);
+        string line;
+        while (getline(in, line)) {
+            size_t space = line.find(' ');
+            if (space == string::npos) continue;
+            uint64_t change_epoch = strtoull(line.c_str(), nullptr, 10);
+            if (change_epoch <= oldest_epoch) continue;
+            uint64_t& kept = newest[line.substr(space + 1)];
+            kept = max(kept, change_epoch);
+        }
+    }
+
+    string text;
+    for (const auto& [rel, change_epoch] : newest) text += to_string(change_epoch) + " " + rel + "\n";
+
+    string tmp = path + ".XXXXXX";
+    int fd = mkstemp(&tmp[0]);
+    if (fd == -1) return;
+    bool ok = fchmod(fd, 0644) == 0 && write(fd, text.data(), text.size()) == (ssize_t)text.size() &&
+              fdatasync(fd) == 0;
+    if (!ok || rename(tmp.c_str(), path.c_str()) != 0) {
+        close(fd);
+        unlink(tmp.c_str());
+        return;
+    }
+
+    // Appends go on in the new file
+    close(changes_fd);
+    changes_fd = fd;
+    lseek(changes_fd, 0, SEEK_END);
+    int flags = fcntl(changes_fd, F_GETFL);
+    if (flags != -1) fcntl(changes_fd, F_SETFL, flags | O_APPEND);
+}
+
+// Keep the moves still being walked across a crash (moves_mutex held)
+static void save_moves() {
+    string text;
+    for (const shared_ptr<DirMove>& m : moves) {
+        if (!m->confirmed) continue;
+        text += to_string(m->epoch) + " " + to_string((long long)m->when.tv_sec) + " " + to_string(m->when.tv_nsec) +
+                " " + VersionManager::relative_path(m->from) + "\t" + VersionManager::relative_path(m->to) + "\n";
+    }
+    if (!replace_file(snapshot_dir + "/moves", text)) {
+        cerr << "[VFS] ✗ Cannot record directory moves for tree snapshots" << endl;
+    }
+}
+
+static void load_moves() {
+    ifstream in(snapshot_dir + "/moves");
+    string line;
+    while (getline(in, line)) {
+        istringstream iss(line);
+        auto m = make_shared<DirMove>();
+        long long sec, nsec;
+        string paths;
+        if (!(iss >> m->epoch >> sec >> nsec) || !getline(iss >> ws, paths)) continue;
+        size_t tab = paths.find('\t');
+        if (tab == string::npos) continue;
+        m->id = next_move_id++;
+        m->when.tv_sec = sec;
+        m->when.tv_nsec = nsec;
+        m->from = root_dir + paths.substr(0, tab);
+        m->to = root_dir + paths.substr(tab + 1);
+        m->confirmed = m->resumed = true;
+        moves.push_back(m);
+    }
+    moves_pending = moves.size();
+}
+
+// Preserve one file of a moved directory under both names (moves_mutex held)
+static void settle_item(DirMove& m, const string& rel) {
+    if (!m.confirmed || m.done || m.handled.count(rel)) return;
+    m.handled.insert(rel);
+
+    // Moved files are dealt with before they change or go, so whatever is
+    // missing below the new name now was never one of them
+    string from = m.from + rel, to = m.to + rel;
+    struct stat st;
+    if (lstat(to.c_str(), &st) != 0 || !S_ISREG(st.st_mode)) return;
+
+    // After a crash, files created or changed since the move cannot be told
+    // apart from moved ones but by their change time
+    if (m.resumed && (st.st_ctim.tv_sec > m.when.tv_sec ||
+                      (st.st_ctim.tv_sec == m.when.tv_sec && st.st_ctim.tv_nsec > m.when.tv_nsec))) return;
+
+    if (VersionManager::create_moved_version(from, to, m.epoch)) log_change(m.epoch, from);
+    if (VersionManager::record_absence(to, m.epoch)) log_change(m.epoch, to);
+
+    lock_guard<mutex> lock(preserved_mutex);
+    preserved[from] = m.epoch;
+    preserved[to] = m.epoch;
+}
+
+// Called before a path changes: if it lies below a moved directory (either
+// name), preserve that file first
+static void settle_path(const string& backend_path) {
+    unique_lock<mutex> lock(moves_mutex);
+    vector<shared_ptr<DirMove>> current = moves;
+    for (const shared_ptr<DirMove>& m : current) {
+        string rel;
+        if (!path_below(backend_path, m->to, rel) && !path_below(backend_path, m->from, rel)) continue;
+        if (rel == "/") continue;
+        // The rename is under way; what the path is depends on its outcome
+        moves_cv.wait(lock, [&] { return m->confirmed || m->done; });
+        settle_item(*m, rel);
+    }
+}
+
+// Every regular file below `dir`, as a path relative to it ("/a/b")
+static void list_files(const string& dir, const string& rel, vector<string>& out) {
+    DIR* dp = opendir((dir + rel).c_str());
+    if (!dp) return;
+    struct dirent* entry;
+    while ((entry = readdir(dp)) != nullptr) {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) continue;
+        struct stat st;
+        if (fstatat(dirfd(dp), entry->d_name, &st, AT_SYMLINK_NOFOLLOW) != 0) continue;
+        string child = rel + "/" + entry->d_name;
+        if (S_ISDIR(st.st_mode)) list_files(dir, child, out);
+        else if (S_ISREG(st.st_mode)) out.push_back(child);
+    }
+    closedir(dp);
+}
+
+// Forget a move (moves_mutex held)
+static void finish_move(const shared_ptr<DirMove>& m) {
+    if (m->done) return;
+    m->done = true;
+    moves.erase(find(moves.begin(), moves.end(), m));
+    moves_pending = moves.size();
+    if (m->confirmed) save_moves();
+    moves_cv.notify_all();
+}
+
+// Preserve every file of a move not yet dealt with. Files are listed
+// without the lock; each is settled under it, as hooks may race the walk.
+static void walk_move(const shared_ptr<DirMove>& m) {
+    vector<string> files;
+    list_files(m->to, "", files);
+    for (const string& rel : files) {
+        lock_guard<mutex> lock(moves_mutex);
+        if (m->done) return;
+        settle_item(*m, rel);
+    }
+    lock_guard<mutex> lock(moves_mutex);
+    finish_move(m);
+}
+
+// Walk the moves of (or below, or above) `path` right away, before another
+// rename carries their files off
+static void settle_overlapping(const string& path) {
+    vector<shared_ptr<DirMove>> overlapping;
+    {
+        unique_lock<mutex> lock(moves_mutex);
+        vector<shared_ptr<DirMove>> current = moves;
+        string rel;
+        for (const shared_ptr<DirMove>& m : current) {
+            if (path_below(path, m->from, rel) || path_below(m->from, path, rel) ||
+                path_below(path, m->to, rel) || path_below(m->to, path, rel)) {
+                moves_cv.wait(lock, [&] { return m->confirmed || m->done; });
+                overlapping.push_back(m);
+            }
+        }
+    }
+    for (const shared_ptr<DirMove>& m : overlapping) walk_move(m);
+}
+
+static void walker_loop() {
+    unique_lock<mutex> lock(moves_mutex);
+    while (true) {
+        shared_ptr<DirMove> next;
+        for (const shared_ptr<DirMove>& m : moves) {
+            if (m->confirmed) {
+                next = m;
+                break;
+            }
+        }
+        if (!next) {
+            // Stopping only once every confirmed move is walked
+            if (walker_stop) return;
+            moves_cv.wait(lock);
+            continue;
+        }
+        lock.unlock();
+        walk_move(next);
+        lock.lock();
+    }
+}
+
+// Preserve both names of every file below a directory right away
+static void preserve_tree(const string& from, const string& to) {
+    DIR* dir = opendir(from.c_str());
+    if (dir) {
+        struct dirent* entry;
+        while ((entry = readdir(dir)) != nullptr) {
+            if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) continue;
+            string child_from = from + "/" + entry->d_name, child_to = to + "/" + entry->d_name;
+            struct stat st;
+            if (lstat(child_from.c_str(), &st) == 0 && S_ISDIR(st.st_mode)) {
+                preserve_tree(child_from, child_to);
+            } else {
+                TreeSnapshots::preserve(child_from);
+                TreeSnapshots::preserve(child_to);
+            }
+        }
+        closedir(dir);
+    }
+    TreeSnapshots::preserve(to);
+}
+
+void TreeSnapshots::init(const string& dir, const string& backend_root) {
+    snapshot_dir = dir;
+    root_dir = backend_root;
+    while (root_dir.size() > 1 && root_dir.back() == '/') root_dir.pop_back();
+    mkdir(snapshot_dir.c_str(), 0755);
+
+    vector<TreeSnapshot> loaded;
+    uint64_t loaded_epoch = 1;
+    load_list(snapshot_dir + "/list", loaded, loaded_epoch);
+
+    lock_guard<mutex> lock(snapshots_mutex);
+    snapshots = loaded;
+    next_id = 1;
+    for (const TreeSnapshot& s : snapshots) {
+        next_id = max(next_id, s.id + 1);
+        loaded_epoch = max(loaded_epoch, s.epoch + 1);
+    }
+    epoch = loaded_epoch;
+    any_snapshot = !snapshots.empty();
+
+    lock_guard<mutex> changes_lock(changes_mutex);
+    if (changes_fd != -1) close(changes_fd);
+    // Without snapshots no restore will read what changed so far
+    int trunc = snapshots.empty() ? O_TRUNC : 0;
+    changes_fd = open((snapshot_dir + "/changes").c_str(), O_WRONLY | O_APPEND | O_CREAT | trunc, 0644);
+
+    lock_guard<mutex> moves_lock(moves_mutex);
+    moves.clear();
+    if (snapshots.empty()) unlink((snapshot_dir + "/moves").c_str());
+    else load_moves();
+    moves_pending = moves.size();
+}
+
+void TreeSnapshots::start() {
+    lock_guard<mutex> lock(moves_mutex);
+    if (walker.joinable()) return;
+    walker_stop = false;
+    walker = thread(walker_loop);
+}
+
+void TreeSnapshots::stop() {
+    {
+        lock_guard<mutex> lock(moves_mutex);
+        if (!walker.joinable()) return;
+        walker_stop = true;
+        moves_cv.notify_all();
+    }
+    walker.join();
+}
+
+uint64_t TreeSnapshots::current_epoch() {
+    return epoch.load();
+}
+
+bool TreeSnapshots::active() {
+    return any_snapshot.load();
+}
+
+bool TreeSnapshots::create(const string& name, TreeSnapshot& snapshot) {
+    if (!valid_name(name)) {
+        errno = EINVAL;
+        return false;
+    }
+
+    lock_guard<mutex> lock(snapshots_mutex);
+    for (const TreeSnapshot& s : snapshots) {
+        if (s.name == name) {
+            errno = EEXIST;
+            return false;
+        }
+    }
+
+    snapshot.id = next_id;
+    snapshot.epoch = epoch.load();
+    snapshot.timestamp = time(nullptr);
+    snapshot.name = name;
+
+    vector<TreeSnapshot> updated = snapshots;
+    updated.push_back(snapshot);
+    if (!save_list(updated, snapshot.epoch + 1)) {
+        errno = EIO;
+        return false;
+    }
+
+    // From here on, the first change to any path preserves it
+    snapshots.swap(updated);
+    next_id++;
+    any_snapshot = true;
+    epoch = snapshot.epoch + 1;
+
+    cerr << "[VFS] ✓ Tree snapshot " << name << " taken (epoch " << snapshot.epoch << ")" << endl;
+    return true;
+}
+
+bool TreeSnapshots::remove(const string& name) {
+    uint64_t oldest_epoch = UINT64_MAX;
+    bool any_left;
+    {
+        lock_guard<mutex> lock(snapshots_mutex);
+        vector<TreeSnapshot> updated;
+        for (const TreeSnapshot& s : snapshots) {
+            if (s.name != name) updated.push_back(s);
+        }
+        if (updated.size() == snapshots.size()) {
+            errno = ENOENT;
+            return false;
+        }
+        if (!save_list(updated, epoch.load())) {
+            errno = EIO;
+            return false;
+        }
+        snapshots.swap(updated);
+        any_left = !snapshots.empty();
+        any_snapshot = any_left;
+        for (const TreeSnapshot& s : snapshots) oldest_epoch = min(oldest_epoch, s.epoch);
+    }
+    cerr << "[VFS] ✓ Tree snapshot " << name << " removed" << endl;
+
+    compact_changes(any_left, oldest_epoch);
+
+    // A move only matters to snapshots taken before it
+    lock_guard<mutex> lock(moves_mutex);
+    vector<shared_ptr<DirMove>> current = moves;
+    for (const shared_ptr<DirMove>& m : current) {
+        if (m->confirmed && (!any_left || m->epoch <= oldest_epoch)) finish_move(m);
+    }
+    return true;
+}
+
+vector<TreeSnapshot> TreeSnapshots::list() {
+    lock_guard<mutex> lock(snapshots_mutex);
+    return snapshots;
+}
+
+bool TreeSnapshots::preserve(const string& backend_path) {
+    if (!any_snapshot.load()) return false;
+    if (moves_pending.load() > 0) settle_path(backend_path);
+
+    uint64_t now = epoch.load();
+    {
+        lock_guard<mutex> lock(preserved_mutex);
+        if (preserved.size() >= PRESERVED_SWEEP_SIZE) {
+            for (auto it = preserved.begin(); it != preserved.end();) {
+                it = it->second < now ? preserved.erase(it) : next(it);
+            }
+        }
+        auto [it, inserted] = preserved.emplace(backend_path, now);
+        if (!inserted && it->second == now) return false;
+        it->second = now;
+    }
+
+    struct stat st;
+    bool took = false;
+    bool recorded;
+    if (lstat(backend_path.c_str(), &st) == 0) {
+        if (S_ISDIR(st.st_mode)) {
+            // Everything below changes its path along with the directory
+            DIR* dir = opendir(backend_path.c_str());
+            if (!dir) return false;
+            struct dirent* entry;
+            while ((entry = readdir(dir)) != nullptr) {
+                if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) continue;
+                preserve(backend_path + "/" + entry->d_name);
+            }
+            closedir(dir);
+            return false;
+        }
+        if (!S_ISREG(st.st_mode)) return false;
+        recorded = took = VersionManager::create_version_async(backend_path);
+    } else if (errno == ENOENT) {
+        recorded = VersionManager::record_absence(backend_path);
+    } else {
+        return false;
+    }
+
+    // Logged with the epoch as it is now, which is never older than the
+    // epoch the version was stamped with
+    if (recorded) log_change(epoch.load(), backend_path);
+    return took;
+}
+
+bool TreeSnapshots::preserve_rename(const string& from, const string& to, bool exchange, int& move) {
+    move = 0;
+    if (!any_snapshot.load()) return false;
+
+    struct stat st;
+    if (lstat(from.c_str(), &st) == 0 && S_ISDIR(st.st_mode)) {
+        // Both sides of an exchange change, and journals are rebuilt from
+        // the version after them by name: those are preserved right away
+        if (exchange || WriteJournal::enabled()) {
+            preserve_tree(from, to);
+            return false;
+        }
+
+        // Otherwise the move is recorded once and its files preserved later
+        settle_overlapping(from);
+        settle_overlapping(to);
+        auto m = make_shared<DirMove>();
+        m->epoch = epoch.load();
+        clock_gettime(CLOCK_REALTIME, &m->when);
+        m->from = from;
+        m->to = to;
+
+        lock_guard<mutex> lock(moves_mutex);
+        m->id = next_move_id++;
+        moves.push_back(m);
+        moves_pending = moves.size();
+        move = m->id;
+        return false;
+    }
+
+    bool took = preserve(from);
+    preserve(to);
+    return took;
+}
+
+void TreeSnapshots::moved(int move) {
+    lock_guard<mutex> lock(moves_mutex);
+    for (const shared_ptr<DirMove>& m : moves) {
+        if (m->id != move) continue;
+        m->confirmed = true;
+        save_moves();
+        moves_cv.notify_all();
+        return;
+    }
+}
+
+void TreeSnapshots::move_failed(int move) {
+    lock_guard<mutex> lock(moves_mutex);
+    for (const shared_ptr<DirMove>& m : moves) {
+        if (m->id == move) {
+            finish_move(m);
+            return;
+        }
+    }
+}
+
+vector<bool> TreeSnapshots::pinned(const vector<FileVersion>& versions) {
+    vector<bool> pins(versions.size(), false);
+    lock_guard<mutex> lock(snapshots_mutex);
+    for (const TreeSnapshot& s : snapshots) {
+        for (size_t i = 0; i < versions.size(); i++) {
+            if (versions[i].epoch > s.epoch) {
+                pins[i] = true;
+                break;
+            }
+        }
+    }
+    return pins;
+}
+
+bool TreeSnapshots::restore(const string& name, TreeRestoreResult& result) {
+    lock_guard<mutex> restore_lock(restore_mutex);
+
+    TreeSnapshot target;
+    bool found = false;
+    for (const TreeSnapshot& s : list()) {
+        if (s.name == name) {
+            target = s;
+            found = true;
+        }
+    }
+    if (!found) {
+        errno = ENOENT;
+        return false;
+    }
+
+    // Undo point: everything the restore overwrites is preserved under it
+    TreeSnapshot undo;
+    int suffix = 0;
+    do {
+        result.undo_name = "before-restore-" + to_string(target.id) + (suffix ? "-" + to_string(suffix) : "");
+        suffix++;
+    } while (!create(result.undo_name, undo) && errno == EEXIST);
+    if (undo.name != result.undo_name) {
+        errno = EIO;
+        return false;
+    }
+
+    // Moved directories must be preserved, and versions captured after the
+    // snapshot may still be queued
+    vector<shared_ptr<DirMove>> pending;
+    {
+        lock_guard<mutex> lock(moves_mutex);
+        for (const shared_ptr<DirMove>& m : moves) {
+            if (m->confirmed) pending.push_back(m);
+        }
+    }
+    for (const shared_ptr<DirMove>& m : pending) walk_move(m);
+    SnapshotQueue::flush();
+
+    set<string> changed;
+    {
+        lock_guard<mutex> lock(changes_mutex);
+        ifstream in(snapshot_dir + "/changes");
+        string line;
+        while (getline(in, line)) {
+            size_t space = line.find(' ');
+            if (space == string::npos) continue;
+            if (strtoull(line.c_str(), nullptr, 10) > target.epoch) changed.insert(line.substr(space + 1));
+        }
+    }
+
+    for (const string& rel : changed) {
+        string path = root_dir + rel;
+        vector<FileVersion> versions = VersionManager::get_versions(path);
+        const FileVersion* then = nullptr;
+        for (const FileVersion& v : versions) {
+            if (v.epoch > target.epoch) {
+                then = &v;
+                break;
+            }
+        }
+        if (!then) continue;
+
+        if (then->flags & VERSION_FLAG_ABSENT) {
+            struct stat st;
+            if (lstat(path.c_str(), &st) != 0) continue;
+            preserve(path);
+            if (unlink(path.c_str()) == 0) result.removed++;
+            else result.failed++;
+            continue;
+        }
+
+        // Parents may have gone since
+        for (size_t slash = root_dir.size() + 1; (slash = path.find('/', slash)) != string::npos; slash++) {
+            mkdir(path.substr(0, slash).c_str(), 0755);
+        }
+        if (VersionManager::restore_version(path, then->version_number)) result.restored++;
+        else result.failed++;
+    }
+
+    cerr << "[VFS] ✓ Restored tree snapshot " << name << ": " << result.restored << " files restored, "
+         << result.removed << " removed, " << result.failed << " failed (undo with " << result.undo_name << ")" << endl;
+    return true;
+}
+
+string TreeSnapshots::render() {
+    string out;
+    char line[512];
+    snprintf(line, sizeof(line), "%-4s %-32s %-8s %s\n", "id", "name", "epoch", "created");
+    out += line;
+    for (const TreeSnapshot& s : list()) {
+        char when[32];
+        struct tm tm;
+        localtime_r(&s.timestamp, &tm);
+        strftime(when, sizeof(when), "%Y-%m-%d %H:%M:%S", &tm);
+        snprintf(line, sizeof(line), "%-4d %-32s %-8llu %s\n", s.id, s.name.c_str(),
+                 (unsigned long long)s.epoch, when);
+        out += line;
+    }
+    return out;
+}
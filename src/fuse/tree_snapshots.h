@@ -0,0 +1,91 @@
+#pragma once
+
+#include <cstdint>
+#include <ctime>
+#include <string>
+#include <vector>
+#include "version_manager.h"
+
+using namespace std;
+
+// A point-in-time view of the whole tree
+struct TreeSnapshot {
+    int id = 0;
+    uint64_t epoch = 0;     // Epoch the snapshot closed
+    time_t timestamp = 0;
+    string name;
+};
+
+struct TreeRestoreResult {
+    int restored = 0;       // Files put back to their snapshot content
+    int removed = 0;        // Files that did not exist at the snapshot
+    int failed = 0;
+    string undo_name;       // Snapshot taken just before the restore
+};
+
+// Whole-tree snapshots by epoch, copy-on-write over the per-file histories.
+//
+// Taking a snapshot only records the current epoch and starts the next one,
+// so it costs the same whatever the size of the tree. Every version carries
+// the epoch it was captured in, and the first change to a path in an epoch
+// preserves the path's state first (its content, or the fact that it did
+// not exist) and notes the path in a change log. The tree as of snapshot S
+// is then: for each path changed since S, the first version captured after
+// S; everything else is as it is now. Restoring a snapshot walks only the
+// paths changed since it.
+//
+// Directories themselves are not versioned: a restore recreates the parent
+// directories it needs but leaves directories created since in place.
+//
+// Moving a directory changes the path of every file below it, but not their
+// content. The move is recorded once, and its files are preserved under both
+// names afterwards: by a background walk, or before their first change if
+// that comes sooner. A restore, and unmounting, finish the walks first.
+class TreeSnapshots {
+public:
+    // Load the snapshot list and epoch from `dir`; paths in the change log are
+    // relative to `backend_root`
+    static void init(const string& dir, const string& backend_root);
+
+    // Walk the directory moves left over from the last mount (the snapshot
+    // workers must be running), and finish every walk before stopping
+    static void start();
+    static void stop();
+
+    // Epoch new versions are captured in
+    static uint64_t current_epoch();
+
+    // Whether any snapshot exists (otherwise nothing needs preserving)
+    static bool active();
+
+    // Take a snapshot; false with errno set (EINVAL bad name, EEXIST taken, EIO)
+    static bool create(const string& name, TreeSnapshot& snapshot);
+
+    // Forget a snapshot (its versions become prunable); false with errno set
+    static bool remove(const string& name);
+
+    static vector<TreeSnapshot> list();
+
+    // Put every path changed since the snapshot back as it was. A snapshot
+    // of the current state is taken first, so the restore can be undone.
+    // False with errno set if the snapshot does not exist.
+    static bool restore(const string& name, TreeRestoreResult& result);
+
+    // Before the first change to a path in this epoch, capture its state.
+    // Returns true if a version of the current content was taken (so the
+    // caller need not take one of its own).
+    static bool preserve(const string& backend_path);
+
+    // Before a rename: both names change (every file below, for a directory).
+    // A directory move is only announced here (its id in `move`, 0 if none):
+    // pass that to moved() once the rename happened, or to move_failed()
+    static bool preserve_rename(const string& from, const string& to, bool exchange, int& move);
+    static void moved(int move);
+    static void move_failed(int move);
+
+    // Versions some snapshot still reads; retention must keep them
+    static vector<bool> pinned(const vector<FileVersion>& versions);
+
+    // Human-readable list (served as /.vertext/snapshots)
+    static string render();
+};
@@ -0,0 +1,152 @@
+#include "version_cache.h"
+#include <algorithm>
+#include <list>
+#include <unordered_map>
+#include <mutex>
+
+using namespace std;
+
+struct CacheEntry {
+    string meta_path;
+    ino_t ino;
+    off_t size;
+    struct timespec mtime;
+    vector<FileVersion> versions;
+};
+
+static mutex cache_mutex;
+static list<CacheEntry> lru;  // Most recently used at the front
+static unordered_map<string, list<CacheEntry>::iterator> index_by_path;
+static size_t capacity = 1024;
+static uint64_t hits = 0, misses = 0, evictions = 0;
+
+static bool matches(const CacheEntry& entry, const struct stat& st) {
+    return entry.ino == st.st_ino && entry.size == st.st_size &&
+           entry.mtime.tv_sec == st.st_mtim.tv_sec && entry.mtime.tv_nsec == st.st_mtim.tv_nsec;
+}
+
+static void stamp(CacheEntry& entry, const struct stat& st) {
+    entry.ino = st.st_ino;
+    entry.size = st.st_size;
+    entry.mtime = st.st_mtim;
+}
+
+// Caller holds cache_mutex
+static list<CacheEntry>::iterator lookup(const string& meta_path, const struct stat& st) {
+    auto it = index_by_path.find(meta_path);
+    if (it == index_by_path.end() || !matches(*it->second, st)) {
+        misses++;
+        return lru.end();
+    }
+    hits++;
+    lru.splice(lru.begin(), lru, it->second);
+    return it->second;
+}
+
+// Caller holds cache_mutex
+static void evict_to(size_t max_entries) {
+    while (lru.size() > max_entries) {
+        index_by_path.erase(lru.back().meta_path);
+        lru.pop_back();
+        evictions++;
+    }
+}
+
+void VersionCache::set_capacity(size_t max_entries) {
+    lock_guard<mutex> lock(cache_mutex);
+    capacity = max_entries;
+    evict_to(capacity);
+}
+
+bool VersionCache::get(const string& meta_path, const struct stat& meta_st, vector<FileVersion>& versions) {
+    lock_guard<mutex> lock(cache_mutex);
+    auto it = lookup(meta_path, meta_st);
+    if (it == lru.end()) return false;
+    versions = it->versions;
+    return true;
+}
+
+bool VersionCache::get_count(const string& meta_path, const struct stat& meta_st, int& count) {
+    lock_guard<mutex> lock(cache_mutex);
+    auto it = lookup(meta_path, meta_st);
+    if (it == lru.end()) return false;
+    count = it->versions.size();
+    return true;
+}
+
+bool VersionCache::get_last(const string& meta_path, const struct stat& meta_st, FileVersion& version) {
+    lock_guard<mutex> lock(cache_mutex);
+    auto it = lookup(meta_path, meta_st);
+    if (it == lru.end() || it->versions.empty()) return false;
+    version = it->versions.back();
+    return true;
+}
+
+bool VersionCache::get_around(const string& meta_path, const struct stat& meta_st, time_t when,
+                              VersionsAround& around) {
+    lock_guard<mutex> lock(cache_mutex);
+    auto it = lookup(meta_path, meta_st);
+    if (it == lru.end()) return false;
+
+    const vector<FileVersion>& versions = it->versions;
+    auto after = upper_bound(versions.begin(), versions.end(), when,
+        [](time_t t, const FileVersion& v) { return t < v.timestamp; });
+    around = VersionsAround();
+    if (after != versions.begin()) {
+        around.before = *prev(after);
+        around.has_before = true;
+    }
+    if (after != versions.end()) {
+        around.after = *after;
+        around.has_after = true;
+    }
+    return true;
+}
+
+void VersionCache::put(const string& meta_path, const struct stat& meta_st, const vector<FileVersion>& versions) {
+    lock_guard<mutex> lock(cache_mutex);
+    if (capacity == 0) return;
+
+    auto it = index_by_path.find(meta_path);
+    if (it != index_by_path.end()) {
+        lru.splice(lru.begin(), lru, it->second);
+    } else {
+        lru.push_front(CacheEntry());
+        lru.front().meta_path = meta_path;
+        index_by_path[meta_path] = lru.begin();
+    }
+
+    CacheEntry& entry = lru.front();
+    stamp(entry, meta_st);
+    entry.versions = versions;
+    evict_to(capacity);
+}
+
+void VersionCache::append(const string& meta_path, const struct stat& meta_st, const FileVersion& version) {
+    lock_guard<mutex> lock(cache_mutex);
+    auto it = index_by_path.find(meta_path);
+    if (it == index_by_path.end()) return;
+
+    CacheEntry& entry = *it->second;
+    entry.versions.push_back(version);
+    stamp(entry, meta_st);
+}
+
+void VersionCache::invalidate(const string& meta_path) {
+    lock_guard<mutex> lock(cache_mutex);
+    auto it = index_by_path.find(meta_path);
+    if (it == index_by_path.end()) return;
+    lru.erase(it->second);
+    index_by_path.erase(it);
+}
+
+VersionCacheStats VersionCache::get_stats() {
+    lock_guard<mutex> lock(cache_mutex);
+    VersionCacheStats stats;
+    stats.hits = hits;
+    stats.misses = misses;
+    stats.evictions = evictions;
+    stats.entries = lru.size();
+    stats.capacity = capacity;
+    return stats;
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <sys/stat.h>
+#include "version_manager.h"
+
+using namespace std;
+
+struct VersionCacheStats {
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t evictions;
+    size_t entries;
+    size_t capacity;
+};
+
+// Process-wide LRU cache of per-file version lists, keyed by metadata path.
+// Each entry remembers the identity (inode, size, mtime) of the metadata log
+// it was read from, so changes made by another process (e.g. the mount while
+// the TUI is open) are noticed with a single stat instead of a full re-read.
+class VersionCache {
+public:
+    // Maximum number of files kept in the cache
+    static void set_capacity(size_t max_entries);
+
+    // Look up a cached version list that still matches the file on disk
+    static bool get(const string& meta_path, const struct stat& meta_st, vector<FileVersion>& versions);
+
+    // Look up just the version count
+    static bool get_count(const string& meta_path, const struct stat& meta_st, int& count);
+
+    // Look up just the newest version (false if not cached or empty)
+    static bool get_last(const string& meta_path, const struct stat& meta_st, FileVersion& version);
+
+    // Look up the versions either side of `when` (false if not cached)
+    static bool get_around(const string& meta_path, const struct stat& meta_st, time_t when,
+                           VersionsAround& around);
+
+    // Insert or replace the version list for a file
+    static void put(const string& meta_path, const struct stat& meta_st, const vector<FileVersion>& versions);
+
+    // Extend a cached list after a version was appended on disk
+    // (no-op if the file is not cached)
+    static void append(const string& meta_path, const struct stat& meta_st, const FileVersion& version);
+
+    // Forget a file
+    static void invalidate(const string& meta_path);
+
+    static VersionCacheStats get_stats();
+};
@@ -0,0 +1,451 @@
+#include "version_hooks.h"
+#include "version_manager.h"
+#include "version_cache.h"
+#include "meta_wal.h"
+#include "open_file_table.h"
+#include "snapshot_queue.h"
+#include "write_journal.h"
+#include "gc_service.h"
+#include "burst_policy.h"
+#include "op_stats.h"
+#include "tree_snapshots.h"
+#include <sys/stat.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <iostream>
+
+using namespace std;
+
+void VersionHooks::start() {
+    cerr << "[VFS] ═══════════════════════════════════════" << endl;
+    cerr << "[VFS] Versioned Filesystem Initializing..." << endl;
+    cerr << "[VFS] ═══════════════════════════════════════" << endl;
+
+    char *env_root = getenv("VFS_BACKEND_ROOT");
+    string backend_root = env_root ? string(env_root) : "./runtime/data";
+
+    size_t pos = backend_root.rfind("/data");
+    string project_root = (pos != string::npos)
+        ? backend_root.substr(0, pos)
+        : backend_root + "/..";
+
+    string versions_dir = project_root + "/versions";
+    string meta_dir = project_root + "/meta";
+
+    VersionManager::init(versions_dir, meta_dir, backend_root);
+
+    // VFS_DURABILITY=none|batched|strict: how version commits are synced
+    // (batched syncs them in groups every VFS_WAL_BATCH_MS milliseconds).
+    // Recovery after a crash runs here, before anything is committed.
+    char *durability_env = getenv("VFS_DURABILITY");
+    char *batch_env = getenv("VFS_WAL_BATCH_MS");
+    Durability durability = Durability::BATCHED;
+    if (durability_env && !MetaWal::parse_durability(durability_env, durability)) {
+        cerr << "[VFS] ✗ Ignoring malformed VFS_DURABILITY: " << durability_env << endl;
+    }
+    unsigned batch_ms = batch_env ? strtoul(batch_env, nullptr, 10) : 50;
+    MetaWal::start(meta_dir, versions_dir + "/objects", durability, batch_ms);
+
+    // Whole-tree snapshots are taken and restored through /.vertext/snapshots
+    TreeSnapshots::init(meta_dir + "/snapshots", backend_root);
+
+    // VFS_DELTA_KEYFRAME=N stores versions as deltas with a keyframe every N versions
+    char *delta_env = getenv("VFS_DELTA_KEYFRAME");
+    if (delta_env) {
+        VersionManager::set_delta_mode(true, atoi(delta_env));
+        cerr << "[VFS] ✓ Delta Versions:    keyframe every " << atoi(delta_env) << endl;
+    }
+
+    // VFS_COMPRESSION=1 compresses stored versions; the newest VFS_COMPRESSION_RECENT
+    // versions of a file use the fast codec, older ones the high-ratio one
+    char *compress_env = getenv("VFS_COMPRESSION");
+    char *recent_env = getenv("VFS_COMPRESSION_RECENT");
+    if (compress_env && atoi(compress_env)) {
+        int recent = recent_env ? atoi(recent_env) : 5;
+        VersionManager::set_compression(true, recent);
+        cerr << "[VFS] ✓ Compression:       deflate (best after " << recent << " versions)" << endl;
+    }
+
+    // VFS_VERSION_CACHE_SIZE=N caps how many files' histories stay in memory
+    char *cache_env = getenv("VFS_VERSION_CACHE_SIZE");
+    if (cache_env) {
+        VersionCache::set_capacity(strtoul(cache_env, nullptr, 10));
+    }
+
+    // Pre-images are frozen on the write path and stored by background workers
+    // (VFS_SNAPSHOT_WORKERS=0 stores them synchronously instead)
+    char *workers_env = getenv("VFS_SNAPSHOT_WORKERS");
+    char *queue_env = getenv("VFS_SNAPSHOT_QUEUE");
+    int workers = workers_env ? atoi(workers_env) : 2;
+    size_t queue_size = queue_env ? strtoul(queue_env, nullptr, 10) : 64;
+    SnapshotQueue::start(workers, queue_size);
+
+    // VFS_JOURNAL_MODE=1 keeps only the blocks each write session overwrites
+    // instead of a full pre-image (VFS_JOURNAL_BLOCK sets the block size)
+    char *journal_env = getenv("VFS_JOURNAL_MODE");
+    char *journal_block_env = getenv("VFS_JOURNAL_BLOCK");
+    if (journal_env && atoi(journal_env)) {
+        size_t block = journal_block_env ? strtoul(journal_block_env, nullptr, 10) : 4096;
+        WriteJournal::set_enabled(true, block);
+        cerr << "[VFS] ✓ Write Journal:     " << block << "-byte blocks" << endl;
+    }
+
+    // Directory moves a previous mount had not finished preserving
+    TreeSnapshots::start();
+
+    // VFS_COALESCE_WINDOW=T folds saves of a file less than T seconds apart into one
+    // version; a burst is cut after VFS_COALESCE_MAX seconds (default 60)
+    char *window_env = getenv("VFS_COALESCE_WINDOW");
+    char *burst_env = getenv("VFS_COALESCE_MAX");
+    if (window_env && strtod(window_env, nullptr) > 0) {
+        double window = strtod(window_env, nullptr);
+        double max_burst = burst_env ? strtod(burst_env, nullptr) : 60;
+        BurstPolicy::configure(window, max_burst);
+        cerr << "[VFS] ✓ Save Coalescing:   " << window << "s window (bursts up to " << max_burst << "s)" << endl;
+    }
+
+    // VFS_RETENTION="all:1h,hourly:1d,daily:30d,max:100,max_bytes:1G" prunes old
+    // versions in the background every VFS_GC_INTERVAL seconds, moving at most
+    // VFS_GC_RATE bytes per second
+    char *retention_env = getenv("VFS_RETENTION");
+    if (retention_env) {
+        RetentionPolicy policy;
+        if (policy.parse(retention_env)) {
+            char *interval_env = getenv("VFS_GC_INTERVAL");
+            char *rate_env = getenv("VFS_GC_RATE");
+            unsigned interval = interval_env ? strtoul(interval_env, nullptr, 10) : 600;
+            uint64_t rate = rate_env ? strtoull(rate_env, nullptr, 10) : 8 << 20;
+            GarbageCollector::start(policy, backend_root, interval, rate);
+            cerr << "[VFS] ✓ Retention:         " << policy.describe() << " (every " << interval << "s)" << endl;
+        } else {
+            cerr << "[VFS] ✗ Ignoring malformed VFS_RETENTION: " << retention_env << endl;
+        }
+    }
+
+    // VFS_STATS_PROM=FILE keeps FILE updated with the Prometheus stats report
+    // every VFS_STATS_INTERVAL seconds (default 15), e.g. for a textfile collector
+    char *prom_env = getenv("VFS_STATS_PROM");
+    char *prom_interval_env = getenv("VFS_STATS_INTERVAL");
+    if (prom_env) {
+        unsigned interval = prom_interval_env ? strtoul(prom_interval_env, nullptr, 10) : 15;
+        OpStats::start_dump(prom_env, interval);
+        cerr << "[VFS] ✓ Stats Dump:        " << prom_env << " (every " << interval << "s)" << endl;
+    }
+
+    cerr << "[VFS] ✓ Versioning System: ACTIVE" << endl;
+    cerr << "[VFS] ✓ Backend Storage:   " << backend_root << endl;
+    cerr << "[VFS] ✓ Version Archive:   " << versions_dir << endl;
+    cerr << "[VFS] ✓ Metadata Storage:  " << meta_dir << endl;
+    cerr << "[VFS] ✓ Snapshot Workers:  " << workers << " (queue " << queue_size << ")" << endl;
+    cerr << "[VFS] ✓ Durability:        " << MetaWal::durability_name(MetaWal::level());
+    if (MetaWal::level() == Durability::BATCHED) cerr << " (synced every " << batch_ms << " ms)";
+    cerr << endl;
+    cerr << "[VFS] ═══════════════════════════════════════" << endl;
+    cerr << "[VFS] Ready! All file changes will be versioned." << endl;
+}
+
+void VersionHooks::stop() {
+    // A pass in progress is abandoned; it would only wait on the queue
+    GarbageCollector::stop();
+
+    // Finish preserving moved directories, then commit every pre-image
+    // that is still queued before going away
+    TreeSnapshots::stop();
+    SnapshotQueue::stop();
+
+    if (BurstPolicy::enabled()) {
+        BurstPolicyStats burst = BurstPolicy::get_stats();
+        cerr << "[VFS] Coalescing: " << burst.versions << " versions taken, " << burst.coalesced
+             << " saves coalesced" << endl;
+    }
+
+    // Everything is committed: sync it and leave an empty log behind
+    MetaWal::stop();
+
+    // Last dump after everything queued has been committed
+    OpStats::stop_dump();
+
+    GcStats gc = GarbageCollector::get_stats();
+    if (gc.passes > 0) {
+        cerr << "[VFS] GC: " << gc.passes << " passes, " << gc.versions_removed << " versions removed, "
+             << gc.bytes_reclaimed << " bytes reclaimed" << endl;
+    }
+
+    VersionCacheStats stats = VersionCache::get_stats();
+    cerr << "[VFS] Version cache: " << stats.hits << " hits, " << stats.misses << " misses, "
+         << stats.evictions << " evictions, " << stats.entries << "/" << stats.capacity << " entries" << endl;
+    cerr << "[VFS] Versioned Filesystem stopped." << endl;
+}
+
+static bool is_writing(int flags) {
+    return (flags & O_ACCMODE) == O_WRONLY || (flags & O_ACCMODE) == O_RDWR;
+}
+
+bool VersionHooks::before_open(const string& backend_path, int flags) {
+    bool writing = is_writing(flags);
+    bool journaled = writing && WriteJournal::enabled();
+    // A tree snapshot needs the content the truncate is about to drop
+    bool preserved = writing && (flags & O_TRUNC) && TreeSnapshots::preserve(backend_path);
+
+    if (journaled) {
+        // Join the file's write session BEFORE opening, so a truncating open is captured
+        WriteJournal::begin(backend_path);
+        if (flags & O_TRUNC) WriteJournal::record_truncate(backend_path, 0);
+    } else if ((flags & O_TRUNC) && writing && !preserved) {
+        // Create version BEFORE opening if truncate flag is set
+        struct stat st;
+        if (stat(backend_path.c_str(), &st) == 0 && st.st_size > 0 &&
+            BurstPolicy::should_version(backend_path)) {
+            cerr << "[VFS] Truncate on open detected: " << backend_path << endl;
+            VersionManager::create_version_async(backend_path);
+            cerr << "[VFS] ✓ Version created before truncate!" << endl;
+        }
+    }
+    return journaled;
+}
+
+void VersionHooks::opened(uint64_t fh, const string& backend_path, int flags, bool journaled) {
+    // Track this handle if opened for writing
+    if (!is_writing(flags)) return;
+
+    struct stat st;
+    off_t original_size = (fstat(fh, &st) == 0) ? st.st_size : 0;
+    // Already versioned if truncated; the journal versions journaled handles
+    bool version_created = (flags & O_TRUNC) || journaled;
+
+    shared_ptr<OpenFileInfo> info = OpenFileTable::insert(fh, backend_path, version_created, original_size);
+    info->journaled = journaled;
+    cerr << "[VFS] Opened for writing: " << backend_path << " (flags: " << flags << ", size: " << original_size << ")" << endl;
+}
+
+void VersionHooks::open_failed(const string& backend_path, bool journaled) {
+    if (journaled) WriteJournal::end(backend_path);
+}
+
+void VersionHooks::before_create(const string& backend_path) {
+    TreeSnapshots::preserve(backend_path);
+    // Another handle's write session must see the O_TRUNC of the create
+    if (WriteJournal::enabled()) WriteJournal::record_truncate(backend_path, 0);
+}
+
+void VersionHooks::created(uint64_t fh, const string& backend_path) {
+    // Track this new file
+    shared_ptr<OpenFileInfo> info = OpenFileTable::insert(fh, backend_path, false, 0);
+    if (WriteJournal::enabled()) {
+        WriteJournal::begin(backend_path);
+        info->journaled = true;
+    }
+    cerr << "[VFS] New file created: " << backend_path << endl;
+}
+
+void VersionHooks::before_write(uint64_t fh, off_t offset, size_t size) {
+    // Before first write, create version if file has content AND we haven't already versioned it.
+    // The handle's lock makes concurrent first writes wait until the version exists.
+    shared_ptr<OpenFileInfo> info = OpenFileTable::find(fh);
+    if (!info) return;
+
+    lock_guard<mutex> guard(info->lock);
+    // The first write since a tree snapshot preserves the file (the handle
+    // may predate the snapshot), which also serves as its pre-image
+    if (TreeSnapshots::preserve(info->backend_path) && !info->has_been_written) {
+        info->version_created = true;
+    }
+    if (!info->version_created && !info->has_been_written) {
+        struct stat st;
+        if (fstat(fh, &st) == 0 && st.st_size > 0) {
+            if (BurstPolicy::should_version(info->backend_path)) {
+                cerr << "[VFS] Creating version before first write: " << info->backend_path << endl;
+                VersionManager::create_version_async(info->backend_path);
+                cerr << "[VFS] ✓ Version created successfully!" << endl;
+            }
+            // Coalesced saves count as versioned: the burst's pre-image stands for them
+            info->version_created = true;
+        }
+        info->has_been_written = true;
+    }
+    // Save the blocks this write overwrites (a no-op once they are saved)
+    if (info->journaled) WriteJournal::record_write(info->backend_path, offset, size);
+}
+
+void VersionHooks::before_truncate(const string& backend_path, off_t size) {
+    // With a write session open the journal captures the dropped blocks;
+    // otherwise create version before truncating if file has content
+    struct stat st;
+    bool preserved = TreeSnapshots::preserve(backend_path);
+    if (WriteJournal::enabled() && WriteJournal::record_truncate(backend_path, size)) {
+        cerr << "[VFS] Truncate recorded in write journal: " << backend_path << endl;
+    } else if (!preserved && stat(backend_path.c_str(), &st) == 0 && st.st_size > 0 && size < st.st_size &&
+               BurstPolicy::should_version(backend_path)) {
+        cerr << "[VFS] Truncate detected, creating version: " << backend_path << endl;
+        VersionManager::create_version_async(backend_path);
+        cerr << "[VFS] ✓ Version saved before truncation" << endl;
+    }
+}
+
+void VersionHooks::before_release(uint64_t fh) {
+    // Check if file was modified but version wasn't created.
+    // The entry is dropped before close() so a reused fd number starts fresh.
+    shared_ptr<OpenFileInfo> info = OpenFileTable::remove(fh);
+    if (!info) return;
+
+    lock_guard<mutex> guard(info->lock);
+    if (info->has_been_written && !info->version_created) {
+        struct stat st;
+        if (fstat(fh, &st) == 0 && st.st_size > 0 && BurstPolicy::should_version(info->backend_path)) {
+            cerr << "[VFS] 💾 Creating version on close: " << info->backend_path << endl;
+            VersionManager::create_version_async(info->backend_path);
+            cerr << "[VFS] ✓ Final version saved!" << endl;
+        }
+    }
+    // The save that just ended keeps the file's burst going
+    if (info->has_been_written || info->version_created) BurstPolicy::touched(info->backend_path);
+    if (info->journaled) WriteJournal::end(info->backend_path);
+}
+
+UnlinkPlan VersionHooks::before_unlink(const string& backend_path) {
+    // Create final version before deletion (never coalesced: nothing follows it)
+    UnlinkPlan plan;
+    BurstPolicy::forget(backend_path);
+    if (TreeSnapshots::preserve(backend_path)) return plan;
+    struct stat st;
+    if (stat(backend_path.c_str(), &st) == 0 && st.st_size > 0) {
+        cerr << "[VFS] 🗑️ Creating final version before deletion: " << backend_path << endl;
+        // The unlink leaves a hard link in the store the file's only name,
+        // unless a handle could still write to it
+        if (OpenFileTable::is_open(backend_path)) {
+            VersionManager::create_version_async(backend_path);
+        } else {
+            VersionManager::freeze_replaced(backend_path, plan.removed);
+        }
+        cerr << "[VFS] ✓ Final version preserved!" << endl;
+    }
+    return plan;
+}
+
+void VersionHooks::unlinked(const UnlinkPlan& plan) {
+    if (!plan.removed.staged_path.empty()) SnapshotQueue::submit(plan.removed);
+}
+
+void VersionHooks::unlink_failed(const UnlinkPlan& plan) {
+    if (!plan.removed.staged_path.empty()) unlink(plan.removed.staged_path.c_str());
+}
+
+RenamePlan VersionHooks::before_rename(const string& from, const string& to, unsigned int flags) {
+    RenamePlan plan;
+    // rename(tmp, target) over another file: an atomic save of the target
+    struct stat from_st, to_st;
+    bool replaces = !(flags & (RENAME_EXCHANGE | RENAME_NOREPLACE)) &&
+                    lstat(from.c_str(), &from_st) == 0 && S_ISREG(from_st.st_mode) &&
+                    lstat(to.c_str(), &to_st) == 0 && S_ISREG(to_st.st_mode) &&
+                    !(from_st.st_dev == to_st.st_dev && from_st.st_ino == to_st.st_ino);
+
+    BurstPolicy::forget(from);
+    // A save keeps the target's burst going; any other rename ends it
+    if (!replaces) BurstPolicy::forget(to);
+
+    bool to_preserved = false;
+    if (TreeSnapshots::active()) {
+        // A tree snapshot restores each name from its own history, so while
+        // snapshots exist histories stay with their paths, and the source's
+        // last content is kept under its old name (unless it lives on as
+        // the file it replaces)
+        plan.follow = false;
+        if (replaces) {
+            TreeSnapshots::preserve(from);
+            to_preserved = TreeSnapshots::preserve(to);
+        } else {
+            bool exchange = flags & RENAME_EXCHANGE;
+            bool preserved = TreeSnapshots::preserve_rename(from, to, exchange, plan.snapshot_move);
+            int none;
+            if (exchange) TreeSnapshots::preserve_rename(to, from, true, none);
+            if (!preserved && stat(from.c_str(), &from_st) == 0 && S_ISREG(from_st.st_mode) &&
+                from_st.st_size > 0) {
+                cerr << "[VFS] Creating version before rename: " << from << endl;
+                VersionManager::create_version_async(from);
+            }
+        }
+    }
+    if (!replaces || to_st.st_size == 0) return plan;
+    if (to_preserved) {
+        BurstPolicy::touched(to);
+        return plan;
+    }
+    if (!BurstPolicy::should_version(to)) return plan;
+
+    // A handle still open on the target could write to the linked file
+    // after it has been stored, so that case takes a copy right away
+    cerr << "[VFS] Rename replaces a file, keeping its content: " << to << endl;
+    if (OpenFileTable::is_open(to)) {
+        VersionManager::create_version_async(to);
+    } else {
+        VersionManager::freeze_replaced(to, plan.replaced);
+    }
+    return plan;
+}
+
+// Every regular file below `dir`, as a path relative to it ("/a/b")
+static void for_each_file(const string& dir, const string& rel, const function<void(const string&)>& fn) {
+    DIR* dp = opendir((dir + rel).c_str());
+    if (!dp) return;
+    struct dirent* entry;
+    while ((entry = readdir(dp)) != nullptr) {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) continue;
+        struct stat st;
+        if (fstatat(dirfd(dp), entry->d_name, &st, AT_SYMLINK_NOFOLLOW) != 0) continue;
+        string child = rel + "/" + entry->d_name;
+        if (S_ISDIR(st.st_mode)) for_each_file(dir, child, fn);
+        else if (S_ISREG(st.st_mode)) fn(child);
+    }
+    closedir(dp);
+}
+
+static bool is_regular(const string& path) {
+    struct stat st;
+    return lstat(path.c_str(), &st) == 0 && S_ISREG(st.st_mode);
+}
+
+void VersionHooks::renamed(const string& from, const string& to, unsigned int flags, const RenamePlan& plan) {
+    // Queued ahead of the move, so it lands before the source's appended versions
+    if (!plan.replaced.staged_path.empty()) SnapshotQueue::submit(plan.replaced);
+    if (plan.snapshot_move) TreeSnapshots::moved(plan.snapshot_move);
+
+    bool exchange = flags & RENAME_EXCHANGE;
+    OpenFileTable::renamed(from, to, exchange);
+    if (WriteJournal::enabled()) WriteJournal::renamed(from, to, exchange);
+    if (!plan.follow) return;
+
+    // Whatever is at `to` now came from `from` (a directory moves every file below it)
+    if (is_regular(to)) {
+        VersionManager::move_history(from, to, exchange);
+    } else {
+        for_each_file(to, "", [&](const string& rel) {
+            VersionManager::move_history(from + rel, to + rel, exchange);
+        });
+    }
+    if (!exchange) return;
+
+    // ...and what is at `from` came from `to`; names present on both sides
+    // were swapped above
+    if (is_regular(from)) {
+        if (!is_regular(to)) VersionManager::move_history(to, from, false);
+    } else {
+        for_each_file(from, "", [&](const string& rel) {
+            if (!is_regular(to + rel)) VersionManager::move_history(to + rel, from + rel, false);
+        });
+    }
+}
+
+void VersionHooks::rename_failed(const RenamePlan& plan) {
+    if (!plan.replaced.staged_path.empty()) unlink(plan.replaced.staged_path.c_str());
+    if (plan.snapshot_move) TreeSnapshots::move_failed(plan.snapshot_move);
+}
+
+void VersionHooks::after_fsync(const string& backend_path) {
+    // Also a barrier for this file's pending versions, so callers can rely on
+    // its history being complete once fsync() returns
+    SnapshotQueue::flush(backend_path);
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <sys/types.h>
+#include <cstdint>
+#include <string>
+#include "snapshot_queue.h"
+
+using namespace std;
+
+// What before_rename() decided; pass it on to renamed() or rename_failed()
+struct RenamePlan {
+    bool follow = true;     // Histories follow the files
+    SnapshotJob replaced;   // Old content of a file the rename replaces (no staged_path: none)
+    int snapshot_move = 0;  // Directory move announced to the tree snapshots (0: none)
+};
+
+// What before_unlink() decided; pass it on to unlinked() or unlink_failed()
+struct UnlinkPlan {
+    SnapshotJob removed;    // Last content of the file (no staged_path: none)
+};
+
+// When to take versions, shared by the high-level and low-level mounts.
+// Each front-end resolves its request to a backend path (and handle) and
+// calls the matching hook around the backend syscall; the hooks decide
+// whether a pre-image must be frozen, journaled or committed.
+class VersionHooks {
+public:
+    // Configure the version store from the VFS_* environment and start the workers
+    static void start();
+
+    // Commit everything still queued
+    static void stop();
+
+    // Before opening an existing file; returns true if the handle joins a
+    // write journal session (pass it on to opened()/open_failed())
+    static bool before_open(const string& backend_path, int flags);
+
+    // After a successful open: start tracking writes on the handle
+    static void opened(uint64_t fh, const string& backend_path, int flags, bool journaled);
+
+    // The open announced by before_open() did not happen
+    static void open_failed(const string& backend_path, bool journaled);
+
+    // Before creating (or truncating through create) a file, and after
+    static void before_create(const string& backend_path);
+    static void created(uint64_t fh, const string& backend_path);
+
+    // Before writing through a tracked handle
+    static void before_write(uint64_t fh, off_t offset, size_t size);
+
+    // Before changing a file's size
+    static void before_truncate(const string& backend_path, off_t size);
+
+    // Before closing a handle (the handle is forgotten)
+    static void before_release(uint64_t fh);
+
+    // Before a file disappears. Its last content is frozen by a hard link
+    // into the store where nothing else can change it, a copy otherwise
+    static UnlinkPlan before_unlink(const string& backend_path);
+
+    // After a successful unlink: the frozen content becomes the final version
+    static void unlinked(const UnlinkPlan& plan);
+
+    // The unlink announced by before_unlink() did not happen
+    static void unlink_failed(const UnlinkPlan& plan);
+
+    // Before renaming `from` to `to` (`flags` as for renameat2). A rename
+    // over an existing file (the usual atomic save) freezes the file being
+    // replaced; the source is not versioned, its content lives on as `to`.
+    static RenamePlan before_rename(const string& from, const string& to, unsigned int flags);
+
+    // After a successful rename: the replaced file becomes a version, and
+    // handles, write sessions and (if plan.follow) histories move with the
+    // files, without copying any data
+    static void renamed(const string& from, const string& to, unsigned int flags, const RenamePlan& plan);
+
+    // The rename announced by before_rename() did not happen
+    static void rename_failed(const RenamePlan& plan);
+
+    // After fsync: wait until the file's pending versions are stored
+    static void after_fsync(const string& backend_path);
+};
@@ -1,109 +1,535 @@
 #include "version_manager.h"
+#include "object_store.h"
+#include "delta.h"
+#include "meta_log.h"
+#include "meta_wal.h"
+#include "tree_snapshots.h"
+#include "version_cache.h"
+#include "snapshot_queue.h"
+#include "write_journal.h"
+#include "op_stats.h"
+#include "../common/sha256.h"
+#include "../common/paths.h"
+#include "../common/file_copy.h"
 #include <sys/stat.h>
 #include <dirent.h>
+#include <fcntl.h>
 #include <unistd.h>
+#include <cstdio>
 #include <fstream>
 #include <sstream>
 #include <algorithm>
 #include <cstring>
 #include <iostream>
+#include <climits>
+#include <stdexcept>
+#include <cstdlib>
 
 using namespace std;
 
 string VersionManager::versions_root;
 string VersionManager::meta_root;
+string VersionManager::backend_root;
+string VersionManager::backend_root_real;
+bool VersionManager::legacy_meta = false;
+bool VersionManager::delta_enabled = false;
+int VersionManager::keyframe_interval = 10;
+bool VersionManager::compression_enabled = false;
+int VersionManager::recent_versions = 5;
+function<void(const string&)> VersionManager::restore_listener;
+function<void(const string&)> VersionManager::history_listener;
 
-void VersionManager::init(const string& versions_dir, const string& meta_dir) {
+// Deltas are computed in memory, so larger files are always stored in full
+static const off_t DELTA_MAX_FILE_SIZE = 256L * 1024 * 1024;
+
+// Per-file locks are striped: files hashing to the same stripe share a lock
+static const size_t FILE_LOCK_STRIPES = 256;
+static recursive_mutex file_locks[FILE_LOCK_STRIPES];
+
+static bool read_file(const string& path, string& out) {
+    ifstream in(path, ios::binary);
+    if (!in) return false;
+    ostringstream oss;
+    oss << in.rdbuf();
+    out = oss.str();
+    return true;
+}
+
+void VersionManager::init(const string& versions_dir, const string& meta_dir, const string& root) {
     versions_root = versions_dir;
     meta_root = meta_dir;
     
+    // Callers may spell the root differently (relative, through symlinks);
+    // both spellings map a file to the same identity
+    backend_root = normalize_path(root);
+    char real[PATH_MAX];
+    backend_root_real = realpath(backend_root.c_str(), real) ? string(real) : backend_root;
+    
     // Create directories if they don't exist
     mkdir(versions_root.c_str(), 0755);
     mkdir(meta_root.c_str(), 0755);
+    
+    // Histories used to be keyed by basename, flat in meta/; those still
+    // there are moved to their hashed place the first time they are used
+    legacy_meta = false;
+    DIR* dir = opendir(meta_root.c_str());
+    if (dir) {
+        struct dirent* entry;
+        while (!legacy_meta && (entry = readdir(dir)) != nullptr) {
+            size_t len = strlen(entry->d_name);
+            legacy_meta = len > 5 && strcmp(entry->d_name + len - 5, ".meta") == 0;
+        }
+        closedir(dir);
+    }
+    
+    ObjectStore::init(versions_root + "/objects");
+}
+
+recursive_mutex& VersionManager::file_lock(const string& backend_path) {
+    // By history identity: the mount and the GC spell the root differently
+    return file_locks[hash<string>()(relative_path(backend_path)) % FILE_LOCK_STRIPES];
+}
+
+void VersionManager::set_delta_mode(bool enabled, int interval) {
+    delta_enabled = enabled;
+    keyframe_interval = max(interval, 1);
+}
+
+void VersionManager::set_compression(bool enabled, int recent) {
+    compression_enabled = enabled;
+    recent_versions = max(recent, 0);
+}
+
+string VersionManager::relative_path(const string& backend_path) {
+    string path = normalize_path(backend_path);
+    string rel;
+    for (const string* root : {&backend_root, &backend_root_real}) {
+        if (path_below(path, *root, rel) && rel != "/") return rel;
+    }
+    return path;
+}
+
+string VersionManager::get_meta_path(const string& backend_path) {
+    string rel = relative_path(backend_path);
+    string key = Sha256::hex(rel.data(), rel.size());
+    string meta_path = meta_root + "/" + key.substr(0, 2) + "/" + key.substr(2, 2) + "/" + key + ".meta";
+    
+    if (legacy_meta) {
+        struct stat st;
+        size_t last_slash = backend_path.find_last_of('/');
+        string legacy_path = meta_root + "/" + backend_path.substr(last_slash + 1) + ".meta";
+        if (stat(meta_path.c_str(), &st) != 0 && stat(legacy_path.c_str(), &st) == 0) {
+            // The first file with this basename to be asked for takes over
+            // the history it shared with the others
+            make_meta_dirs(meta_path);
+            if (rename(legacy_path.c_str(), meta_path.c_str()) == 0) {
+                VersionCache::invalidate(legacy_path);
+                cerr << "[VFS] ✓ Moved history of " << backend_path << " to " << meta_path << endl;
+            }
+        }
+    }
+    return meta_path;
+}
+
+void VersionManager::make_meta_dirs(const string& meta_path) {
+    size_t leaf = meta_path.find_last_of('/');
+    size_t shard = meta_path.find_last_of('/', leaf - 1);
+    mkdir(meta_path.substr(0, shard).c_str(), 0755);
+    mkdir(meta_path.substr(0, leaf).c_str(), 0755);
+}
+
+// <key>.meta -> <key>.path
+static string history_name_path(const string& meta_path) {
+    return meta_path.substr(0, meta_path.size() - 5) + ".path";
+}
+
+void VersionManager::record_history_name(const string& meta_path, const string& backend_path) {
+    string name_path = history_name_path(meta_path);
+    struct stat st;
+    if (stat(name_path.c_str(), &st) == 0) return;
+    
+    string rel = relative_path(backend_path);
+    int fd = open(name_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd == -1) return;
+    if (write(fd, rel.data(), rel.size()) != (ssize_t)rel.size()) {
+        cerr << "[VFS] ✗ Cannot name history of " << backend_path << endl;
+    }
+    close(fd);
+}
+
+void VersionManager::forget_history_name(const string& meta_path) {
+    unlink(history_name_path(meta_path).c_str());
+}
+
+void VersionManager::for_each_history(const function<bool(const string&)>& fn) {
+    // meta/ab/cd/<key>.meta
+    vector<string> shards = {meta_root};
+    for (int depth = 0; depth < 2; depth++) {
+        vector<string> below;
+        for (const string& dir : shards) {
+            DIR* dp = opendir(dir.c_str());
+            if (!dp) continue;
+            struct dirent* entry;
+            while ((entry = readdir(dp)) != nullptr) {
+                if (strlen(entry->d_name) == 2 && entry->d_name[0] != '.') below.push_back(dir + "/" + entry->d_name);
+            }
+            closedir(dp);
+        }
+        shards.swap(below);
+    }
+    
+    for (const string& dir : shards) {
+        DIR* dp = opendir(dir.c_str());
+        if (!dp) continue;
+        vector<string> keys;
+        struct dirent* entry;
+        while ((entry = readdir(dp)) != nullptr) {
+            string name = entry->d_name;
+            if (name.size() > 5 && name.compare(name.size() - 5, 5, ".meta") == 0) {
+                keys.push_back(name.substr(0, name.size() - 5));
+            }
+        }
+        closedir(dp);
+        
+        for (const string& key : keys) {
+            string rel;
+            if (!read_file(dir + "/" + key + ".path", rel)) continue;
+            // A torn name (or none yet) leaves the history to the live tree
+            if (rel.empty() || rel[0] != '/' || Sha256::hex(rel.data(), rel.size()) != key) continue;
+            if (!fn(backend_root + rel)) return;
+        }
+    }
+}
+
+bool VersionManager::read_stored_content(const FileVersion& version, string& data) {
+    return ObjectStore::read_object(version.object_id, data);
 }
 
-string VersionManager::get_version_dir(const string& backend_path) {
-    string version_dir = versions_root;
+bool VersionManager::reconstruct(const string& backend_path, const vector<FileVersion>& versions,
+                                 size_t index, string& content) {
+    // A journal holds only what its session overwrote: start from the state
+    // after it (the next full version, or the live file) and put blocks back
+    if (versions[index].flags & VERSION_FLAG_JOURNAL) {
+        size_t next = index + 1;
+        while (next < versions.size() && (versions[next].flags & VERSION_FLAG_JOURNAL)) next++;
+        
+        if (next < versions.size()) {
+            if (!reconstruct(backend_path, versions, next, content)) return false;
+        } else {
+            if (!read_file(backend_path, content)) return false;
+            WriteJournal::overlay_active(backend_path, content);
+        }
+        
+        for (size_t i = next; i-- > index;) {
+            string journal;
+            if (!read_stored_content(versions[i], journal)) return false;
+            if (!WriteJournal::apply(journal, content)) return false;
+        }
+        return true;
+    }
     
-    size_t last_slash = backend_path.find_last_of('/');
-    string filename = (last_slash != string::npos) 
-        ? backend_path.substr(last_slash + 1) 
-        : backend_path;
+    // Walk back to the nearest keyframe, then replay the deltas forwards
+    vector<size_t> chain;
+    size_t cur = index;
+    while (true) {
+        chain.push_back(cur);
+        if (versions[cur].base_version == 0) break;
+        if (chain.size() > versions.size()) return false;
+        
+        int base = versions[cur].base_version;
+        auto it = find_if(versions.begin(), versions.end(),
+            [base](const FileVersion& v) { return v.version_number == base; });
+        if (it == versions.end()) return false;
+        cur = it - versions.begin();
+    }
     
-    version_dir += "/" + filename + "_versions";
+    if (!read_stored_content(versions[chain.back()], content)) return false;
     
-    return version_dir;
+    for (size_t i = chain.size() - 1; i-- > 0;) {
+        string delta, next;
+        if (!read_stored_content(versions[chain[i]], delta)) return false;
+        if (!delta_apply(content, delta, next)) return false;
+        content.swap(next);
+    }
+    return true;
 }
 
-string VersionManager::get_meta_path(const string& backend_path) {
-    size_t last_slash = backend_path.find_last_of('/');
-    string filename = (last_slash != string::npos) 
-        ? backend_path.substr(last_slash + 1) 
-        : backend_path;
+bool VersionManager::apply_stored_journal(const FileVersion& version, int fd) {
+    // Raw journals are read in place, compressed ones inflated to staging first
+    string staged;
+    int journal_fd = ObjectStore::open_raw(version.object_id);
+    if (journal_fd == -1) {
+        journal_fd = ObjectStore::open_staging(staged);
+        if (journal_fd == -1) return false;
+        close(journal_fd);
+        if (!ObjectStore::restore_object(version.object_id, staged) ||
+            (journal_fd = open(staged.c_str(), O_RDONLY)) == -1) {
+            unlink(staged.c_str());
+            return false;
+        }
+    }
     
-    return meta_root + "/" + filename + ".meta";
+    struct stat st;
+    bool ok = fstat(journal_fd, &st) == 0 && WriteJournal::apply_file(journal_fd, st.st_size, fd);
+    close(journal_fd);
+    if (!staged.empty()) unlink(staged.c_str());
+    return ok;
 }
 
-string VersionManager::get_version_filename(int version_num, time_t timestamp) {
-    ostringstream oss;
-    oss << "v" << version_num << "_" << timestamp;
-    return oss.str();
+bool VersionManager::write_version(const string& backend_path, const vector<FileVersion>& versions,
+                                   size_t index, const string& dst_path) {
+    const FileVersion& ver = versions[index];
+    if (ver.flags & VERSION_FLAG_JOURNAL) {
+        size_t next = index + 1;
+        while (next < versions.size() && (versions[next].flags & VERSION_FLAG_JOURNAL)) next++;
+        
+        // The live file can be the starting point only when it is not the destination
+        if (next < versions.size()) {
+            if (!write_version(backend_path, versions, next, dst_path)) return false;
+        } else if (dst_path == backend_path || copy_file_path(backend_path, dst_path) == CopyMethod::FAILED) {
+            return false;
+        }
+        
+        int fd = open(dst_path.c_str(), O_RDWR);
+        if (fd == -1) return false;
+        if (next == versions.size()) WriteJournal::overlay_active(backend_path, fd);
+        
+        bool ok = true;
+        for (size_t i = next; ok && i-- > index;) {
+            ok = apply_stored_journal(versions[i], fd);
+        }
+        if (close(fd) != 0) ok = false;
+        return ok;
+    }
+    
+    // Full versions: the copy engine (a reflink where possible) for raw
+    // objects, inflated chunk by chunk otherwise
+    if (ver.base_version == 0) return ObjectStore::restore_object(ver.object_id, dst_path);
+    
+    // Deltas are only taken of files up to DELTA_MAX_FILE_SIZE
+    string content;
+    if (!reconstruct(backend_path, versions, index, content)) return false;
+    
+    ofstream dst(dst_path, ios::binary | ios::trunc);
+    if (!dst) return false;
+    dst.write(content.data(), content.size());
+    dst.close();
+    return (bool)dst;
 }
 
-bool VersionManager::parse_version_filename(const string& filename, int& version_num, time_t& timestamp) {
-    if (filename.size() < 3 || filename[0] != 'v') return false;
+void VersionManager::age_versions(const string& meta_path, vector<FileVersion>& versions) {
+    // Each new version pushes exactly one older version out of the window
+    if ((int)versions.size() <= recent_versions) return;
+    size_t index = versions.size() - 1 - recent_versions;
+    FileVersion& old = versions[index];
     
-    size_t underscore = filename.find('_');
-    if (underscore == string::npos) return false;
+    if (ObjectStore::object_codec(old.object_id) != Codec::DEFLATE_FAST) return;
+    if (!ObjectStore::recompress(old.object_id, Codec::DEFLATE_BEST)) return;
     
-    try {
-        version_num = stoi(filename.substr(1, underscore - 1));
-        timestamp = stol(filename.substr(underscore + 1));
-        return true;
-    } catch (...) {
-        return false;
+    old.stored_size = ObjectStore::stored_size(old.object_id);
+    if (!MetaLog::update(meta_path, index, old)) {
+        VersionCache::invalidate(meta_path);
+        return;
+    }
+    
+    struct stat meta_st;
+    if (stat(meta_path.c_str(), &meta_st) == 0) {
+        VersionCache::put(meta_path, meta_st, versions);
     }
 }
 
-bool VersionManager::create_version(const string& backend_path) {
+off_t VersionManager::release_version_content(const FileVersion& version) {
+    return ObjectStore::release(version.object_id);
+}
+
+bool VersionManager::freeze_preimage(const string& backend_path, string& staged_path, off_t& size) {
     struct stat st;
     if (stat(backend_path.c_str(), &st) != 0) {
         return false;
     }
     
-    string version_dir = get_version_dir(backend_path);
-    mkdir(version_dir.c_str(), 0755);
+    // A reflink where the filesystem supports it, otherwise an in-kernel copy.
+    // That copy is of the whole file and the caller (a FUSE thread, for the
+    // hooks) waits for it: on ext4 and the like the first write to a large
+    // file costs a full read and write of it. Journal mode saves only the
+    // blocks a session overwrites instead; the bench's freeze scenario
+    // shows which way the backend goes and what it costs.
+    staged_path = ObjectStore::stage_file(backend_path);
+    if (staged_path.empty()) {
+        cerr << "[VFS] ✗ Failed to freeze pre-image: " << backend_path << endl;
+        return false;
+    }
+    size = st.st_size;
+    return true;
+}
+
+bool VersionManager::create_version(const string& backend_path) {
+    StatTimer timer(StatOp::CREATE_VERSION);
+    // Close the open journal first: its "after" state is this version
+    if (WriteJournal::enabled()) WriteJournal::cut(backend_path);
+    
+    // Keep this file's versions in order behind any queued background snapshots
+    SnapshotQueue::flush(backend_path);
     
-    int version_count = get_version_count(backend_path);
-    int new_version = version_count + 1;
+    string staged_path;
+    off_t size;
+    if (!freeze_preimage(backend_path, staged_path, size)) return false;
+    return commit_staged_version(backend_path, staged_path, time(nullptr), size, 0,
+                                 TreeSnapshots::current_epoch());
+}
+
+bool VersionManager::create_version_async(const string& backend_path) {
+    StatTimer timer(StatOp::CREATE_VERSION_ASYNC);
+    if (WriteJournal::enabled()) WriteJournal::cut(backend_path);
     
-    time_t now = time(nullptr);
-    string version_filename = get_version_filename(new_version, now);
-    string version_path = version_dir + "/" + version_filename;
+    SnapshotJob job;
+    job.backend_path = backend_path;
+    if (!freeze_preimage(backend_path, job.staged_path, job.size)) return false;
+    job.timestamp = time(nullptr);
+    job.epoch = TreeSnapshots::current_epoch();
     
-    ifstream src(backend_path, ios::binary);
-    ofstream dst(version_path, ios::binary);
+    SnapshotQueue::submit(job);
+    return true;
+}
+
+bool VersionManager::freeze_replaced(const string& backend_path, SnapshotJob& job) {
+    StatTimer timer(StatOp::CREATE_VERSION_ASYNC);
+    struct stat st;
+    if (lstat(backend_path.c_str(), &st) != 0 || !S_ISREG(st.st_mode)) return false;
+    if (WriteJournal::enabled()) WriteJournal::cut(backend_path);
     
-    if (!src || !dst) {
-        cerr << "[VFS] ✗ Failed to create version: " << version_path << endl;
+    job.backend_path = backend_path;
+    job.size = st.st_size;
+    // Another name would keep the linked file live after the rename
+    if (st.st_nlink == 1) job.staged_path = ObjectStore::stage_link(backend_path);
+    if (job.staged_path.empty() && !freeze_preimage(backend_path, job.staged_path, job.size)) {
         return false;
     }
+    job.timestamp = time(nullptr);
+    job.epoch = TreeSnapshots::current_epoch();
+    return true;
+}
+
+bool VersionManager::record_absence(const string& backend_path, uint64_t epoch) {
+    SnapshotJob job;
+    job.backend_path = backend_path;
+    int fd = ObjectStore::open_staging(job.staged_path);
+    if (fd == -1) return false;
+    close(fd);
+    job.timestamp = time(nullptr);
+    job.size = 0;
+    job.flags = VERSION_FLAG_ABSENT;
+    job.epoch = epoch ? epoch : TreeSnapshots::current_epoch();
     
-    dst << src.rdbuf();
-    src.close();
-    dst.close();
+    SnapshotQueue::submit(job);
+    return true;
+}
+
+bool VersionManager::create_moved_version(const string& backend_path, const string& src_path, uint64_t epoch) {
+    StatTimer timer(StatOp::CREATE_VERSION_ASYNC);
+    SnapshotJob job;
+    job.backend_path = backend_path;
+    if (!freeze_preimage(src_path, job.staged_path, job.size)) return false;
+    job.timestamp = time(nullptr);
+    job.epoch = epoch;
+    
+    SnapshotQueue::submit(job);
+    return true;
+}
+
+bool VersionManager::commit_staged_version(const string& backend_path, const string& staged_path,
+                                           time_t timestamp, off_t size, int flags, uint64_t epoch) {
+    StatTimer timer(StatOp::COMMIT_VERSION);
+    lock_guard<recursive_mutex> guard(file_lock(backend_path));
     
+    // Delta mode needs the whole chain, and compression the versions leaving
+    // the recent window; otherwise only the newest record matters
+    string meta_path = get_meta_path(backend_path);
     vector<FileVersion> versions;
-    load_metadata(backend_path, versions);
+    FileVersion last;
+    if (delta_enabled || compression_enabled) {
+        if (!load_metadata(backend_path, versions)) {
+            unlink(staged_path.c_str());
+            return false;
+        }
+    } else if (load_last_version(backend_path, last)) {
+        versions.push_back(last);
+    }
+    
+    string object_id;
+    int base_version = 0;
+    Codec codec = compression_enabled ? codec_for_file(backend_path) : Codec::NONE;
+    
+    // Journals are stored as captured; a journal is never a delta base
+    // (rebuilding one needs the version being committed right now)
+    bool journal = flags & VERSION_FLAG_JOURNAL;
+    if (delta_enabled && !journal && !versions.empty() && size <= DELTA_MAX_FILE_SIZE &&
+        !(versions.back().flags & VERSION_FLAG_JOURNAL)) {
+        // Count the deltas since the last keyframe
+        int chain_length = 0;
+        for (auto it = versions.rbegin(); it != versions.rend() && it->base_version != 0; ++it) {
+            chain_length++;
+        }
+        
+        string base, target;
+        if (chain_length + 1 < keyframe_interval &&
+            reconstruct(backend_path, versions, versions.size() - 1, base) &&
+            read_file(staged_path, target)) {
+            string delta = delta_encode(base, target);
+            // Only worth it if the delta is clearly smaller than the content
+            if (delta.size() < target.size() / 2) {
+                object_id = ObjectStore::put_data(delta, codec);
+                if (!object_id.empty()) {
+                    base_version = versions.back().version_number;
+                    unlink(staged_path.c_str());
+                }
+            }
+        }
+    }
+    
+    if (object_id.empty()) {
+        // Moves the staged copy into the store; no further data copy
+        object_id = ObjectStore::put_staged(staged_path, codec);
+    }
+    if (object_id.empty()) {
+        cerr << "[VFS] ✗ Failed to create version: " << backend_path << endl;
+        unlink(staged_path.c_str());
+        return false;
+    }
+    
+    int new_version = versions.empty() ? 1 : versions.back().version_number + 1;
     
     FileVersion new_ver;
-    new_ver.version_path = version_path;
-    new_ver.timestamp = now;
-    new_ver.size = st.st_size;
+    new_ver.object_id = object_id;
+    new_ver.timestamp = timestamp;
+    new_ver.size = size;
     new_ver.version_number = new_version;
+    new_ver.base_version = base_version;
+    new_ver.flags = flags;
+    new_ver.epoch = epoch;
+    new_ver.stored_size = ObjectStore::stored_size(object_id);
     
-    versions.push_back(new_ver);
-    save_metadata(backend_path, versions);
+    if (versions.empty()) make_meta_dirs(meta_path);
+    
+    // Logged (and, depending on the durability level, synced) before the append
+    if (!MetaWal::commit(meta_path, new_ver, [&] { return MetaLog::append(meta_path, new_ver); })) {
+        cerr << "[VFS] ✗ Failed to save metadata: " << meta_path << endl;
+        VersionCache::invalidate(meta_path);
+        release_version_content(new_ver);
+        return false;
+    }
+    // Names it for the GC once the file is gone (older logs lack the name)
+    record_history_name(meta_path, backend_path);
+    
+    struct stat meta_st;
+    if (stat(meta_path.c_str(), &meta_st) == 0) {
+        VersionCache::append(meta_path, meta_st, new_ver);
+    }
+    
+    if (compression_enabled) {
+        versions.push_back(new_ver);
+        age_versions(meta_path, versions);
+    }
     
     cout << "[VFS] ✓ Version " << new_version << " created for " << backend_path << endl;
     
@@ -111,61 +537,424 @@ bool VersionManager::create_version(const string& backend_path) {
 }
 
 vector<FileVersion> VersionManager::get_versions(const string& backend_path) {
+    StatTimer timer(StatOp::GET_VERSIONS);
+    lock_guard<recursive_mutex> guard(file_lock(backend_path));
+    
     vector<FileVersion> versions;
     load_metadata(backend_path, versions);
     return versions;
 }
 
 int VersionManager::get_version_count(const string& backend_path) {
+    StatTimer timer(StatOp::GET_VERSION_COUNT);
+    lock_guard<recursive_mutex> guard(file_lock(backend_path));
+    
+    string meta_path = get_meta_path(backend_path);
+    struct stat meta_st;
+    if (stat(meta_path.c_str(), &meta_st) != 0) return 0;
+    
+    int count;
+    if (VersionCache::get_count(meta_path, meta_st, count)) return count;
+    
+    count = MetaLog::read_count(meta_path);
+    if (count >= 0) return count;
+    
+    // Still in the old text format: loading it migrates the file
     vector<FileVersion> versions;
     load_metadata(backend_path, versions);
     return versions.size();
 }
 
-bool VersionManager::restore_version(const string& backend_path, int version_number) {
+void VersionManager::move_history(const string& from, const string& to, bool exchange) {
+    // Queued versions land in the history before it moves
+    SnapshotQueue::flush(from);
+    SnapshotQueue::flush(to);
+    
+    string from_meta = get_meta_path(from);
+    string to_meta = get_meta_path(to);
+    if (from_meta == to_meta) return;
+    
+    {
+        scoped_lock guard(file_lock(from), file_lock(to));
+        struct stat st;
+        bool from_exists = stat(from_meta.c_str(), &st) == 0;
+        bool to_exists = stat(to_meta.c_str(), &st) == 0;
+        // Without a history of its own, the file takes over the one at its new path
+        if (!from_exists && !(exchange && to_exists)) return;
+        
+        // Versions logged under the old names must not be replayed there after a crash
+        MetaWal::barrier();
+        
+        if (from_exists && to_exists && !exchange) {
+            append_history(from, to);
+        } else {
+            bool moved;
+            if (from_exists && to_exists) {
+                moved = renameat2(AT_FDCWD, from_meta.c_str(), AT_FDCWD, to_meta.c_str(), RENAME_EXCHANGE) == 0;
+            } else if (from_exists) {
+                make_meta_dirs(to_meta);
+                moved = rename(from_meta.c_str(), to_meta.c_str()) == 0;
+                if (moved) {
+                    forget_history_name(from_meta);
+                    record_history_name(to_meta, to);
+                }
+            } else {
+                make_meta_dirs(from_meta);
+                moved = rename(to_meta.c_str(), from_meta.c_str()) == 0;
+                if (moved) {
+                    forget_history_name(to_meta);
+                    record_history_name(from_meta, from);
+                }
+            }
+            VersionCache::invalidate(from_meta);
+            VersionCache::invalidate(to_meta);
+            
+            if (!moved) {
+                cerr << "[VFS] ✗ Cannot move history of " << from << " to " << to << ": " << strerror(errno) << endl;
+            }
+        }
+    }
+    
+    // Outside the file locks: the listener may wait for the kernel
+    if (history_listener) {
+        history_listener(from);
+        history_listener(to);
+    }
+}
+
+void VersionManager::append_history(const string& from, const string& to) {
+    string from_meta = get_meta_path(from);
+    string to_meta = get_meta_path(to);
+    vector<FileVersion> merged, moved;
+    if (!load_metadata(to, merged) || !load_metadata(from, moved)) {
+        cerr << "[VFS] ✗ Cannot append history of " << from << " to " << to << endl;
+        return;
+    }
+    
+    // A journal is rebuilt from the version after it, so nothing may follow
+    // one that ends the target's history; the source's versions are dropped
+    bool keep = merged.empty() || !(merged.back().flags & VERSION_FLAG_JOURNAL);
+    if (keep) {
+        int offset = merged.empty() ? 0 : merged.back().version_number;
+        time_t last = merged.empty() ? 0 : merged.back().timestamp;
+        for (FileVersion ver : moved) {
+            ver.version_number += offset;
+            if (ver.base_version != 0) ver.base_version += offset;
+            // Lookups by time expect a log in timestamp order; at this path
+            // the moved content only appeared with the rename
+            ver.timestamp = max(ver.timestamp, last);
+            merged.push_back(ver);
+        }
+        
+        // Both logs name the moved objects until the source's is gone; an
+        // extra reference in between means a crash leaks them rather than
+        // letting one log release what the other still uses
+        for (const FileVersion& ver : moved) ObjectStore::add_ref(ver.object_id);
+        if (!save_metadata(to, merged)) {
+            for (const FileVersion& ver : moved) ObjectStore::release(ver.object_id);
+            cerr << "[VFS] ✗ Cannot append history of " << from << " to " << to << endl;
+            return;
+        }
+    }
+    
+    bool removed = unlink(from_meta.c_str()) == 0;
+    VersionCache::invalidate(from_meta);
+    if (removed) forget_history_name(from_meta);
+    if (removed && MetaWal::level() != Durability::NONE) {
+        int dir_fd = open(from_meta.substr(0, from_meta.find_last_of('/')).c_str(), O_RDONLY | O_DIRECTORY);
+        if (dir_fd != -1) {
+            fsync(dir_fd);
+            close(dir_fd);
+        }
+    }
+    if (!removed) {
+        cerr << "[VFS] ✗ Cannot remove history of " << from << ": " << strerror(errno) << endl;
+        return;
+    }
+    for (const FileVersion& ver : moved) release_version_content(ver);
+}
+
+bool VersionManager::versions_around(const string& backend_path, time_t when, VersionsAround& around) {
+    StatTimer timer(StatOp::VERSIONS_AROUND);
+    lock_guard<recursive_mutex> guard(file_lock(backend_path));
+    
+    string meta_path = get_meta_path(backend_path);
+    struct stat meta_st;
+    if (stat(meta_path.c_str(), &meta_st) != 0) return false;
+    
+    if (VersionCache::get_around(meta_path, meta_st, when, around)) return true;
+    if (MetaLog::read_around(meta_path, when, around)) return true;
+    if (MetaLog::maybe_log(meta_path)) return false;
+    
+    // Old text format: a full load migrates it (and caches the result)
     vector<FileVersion> versions;
     load_metadata(backend_path, versions);
+    return stat(meta_path.c_str(), &meta_st) == 0 &&
+           VersionCache::get_around(meta_path, meta_st, when, around);
+}
+
+bool VersionManager::restore_version(const string& backend_path, int version_number) {
+    StatTimer timer(StatOp::RESTORE_VERSION);
+    // A restore is a change like any other to the tree snapshots
+    TreeSnapshots::preserve(backend_path);
+    if (WriteJournal::enabled()) WriteJournal::cut(backend_path);
+    SnapshotQueue::flush(backend_path);
     
-    for (const auto& ver : versions) {
-        if (ver.version_number == version_number) {
-            ifstream src(ver.version_path, ios::binary);
-            ofstream dst(backend_path, ios::binary | ios::trunc);
-            
-            if (!src || !dst) return false;
-            
-            dst << src.rdbuf();
-            cout << "[VFS] ✓ Restored version " << version_number << " to " << backend_path << endl;
-            return true;
+    // The newest journal is defined by the live file; pin it with a full
+    // version before the restore overwrites it
+    FileVersion last;
+    bool pin = false;
+    {
+        lock_guard<recursive_mutex> guard(file_lock(backend_path));
+        pin = load_last_version(backend_path, last) && (last.flags & VERSION_FLAG_JOURNAL);
+    }
+    if (pin && !create_version(backend_path)) return false;
+    
+    {
+        lock_guard<recursive_mutex> guard(file_lock(backend_path));
+        
+        vector<FileVersion> versions;
+        load_metadata(backend_path, versions);
+        
+        size_t i = 0;
+        while (i < versions.size() && versions[i].version_number != version_number) i++;
+        if (i == versions.size()) return false;
+        if (versions[i].flags & VERSION_FLAG_ABSENT) {
+            // Only records that the file did not exist; a tree snapshot
+            // restore removes the file for it instead
+            cerr << "[VFS] ✗ Version " << version_number << " has no content: " << backend_path << endl;
+            return false;
+        }
+        
+        // A journal is rebuilt from the version after it, never the live file:
+        // the newest one was pinned above
+        if (!write_version(backend_path, versions, i, backend_path)) {
+            cerr << "[VFS] ✗ Failed to write restored version: " << backend_path << endl;
+            return false;
         }
     }
     
+    cout << "[VFS] ✓ Restored version " << version_number << " to " << backend_path << endl;
+    
+    // Outside the file lock: the listener may wait for the kernel
+    if (restore_listener) restore_listener(backend_path);
+    return true;
+}
+
+void VersionManager::set_restore_listener(function<void(const string& backend_path)> listener) {
+    restore_listener = listener;
+}
+
+void VersionManager::set_history_listener(function<void(const string& backend_path)> listener) {
+    history_listener = listener;
+}
+
+bool VersionManager::read_version_content(const string& backend_path, int version_number, string& content) {
+    StatTimer timer(StatOp::READ_VERSION);
+    // Journals may be rebuilt from the live file; it must not be ahead of the log
+    SnapshotQueue::flush(backend_path);
+    
+    lock_guard<recursive_mutex> guard(file_lock(backend_path));
+    
+    vector<FileVersion> versions;
+    load_metadata(backend_path, versions);
+    
+    for (size_t i = 0; i < versions.size(); i++) {
+        if (versions[i].version_number == version_number) {
+            return reconstruct(backend_path, versions, i, content);
+        }
+    }
     return false;
 }
 
-void VersionManager::cleanup_old_versions(const string& backend_path, int keep_count) {
+bool VersionManager::export_version(const string& backend_path, int version_number, const string& dst_path) {
+    StatTimer timer(StatOp::READ_VERSION);
+    // Journals may be rebuilt from the live file; it must not be ahead of the log
+    SnapshotQueue::flush(backend_path);
+    
+    lock_guard<recursive_mutex> guard(file_lock(backend_path));
+    
     vector<FileVersion> versions;
     load_metadata(backend_path, versions);
     
+    for (size_t i = 0; i < versions.size(); i++) {
+        if (versions[i].version_number == version_number) {
+            return write_version(backend_path, versions, i, dst_path);
+        }
+    }
+    return false;
+}
+
+void VersionManager::cleanup_old_versions(const string& backend_path, int keep_count) {
+    vector<FileVersion> versions = get_versions(backend_path);
     if ((int)versions.size() <= keep_count) return;
     
-    sort(versions.begin(), versions.end(), 
-        [](const FileVersion& a, const FileVersion& b) {
-            return a.timestamp < b.timestamp;
-        });
+    vector<int> doomed;
+    for (size_t i = 0; i < versions.size() - max(keep_count, 0); i++) {
+        doomed.push_back(versions[i].version_number);
+    }
+    delete_versions(backend_path, doomed);
+}
+
+bool VersionManager::depends_on_doomed(const vector<FileVersion>& versions, const vector<bool>& doomed,
+                                       size_t index) {
+    // A journal is rebuilt from every version up to the next full one
+    if (versions[index].flags & VERSION_FLAG_JOURNAL) {
+        for (size_t next = index + 1; next < versions.size(); next++) {
+            if (doomed[next]) return true;
+            if (!(versions[next].flags & VERSION_FLAG_JOURNAL)) break;
+        }
+        return false;
+    }
+    
+    // A delta from every base down to its keyframe
+    size_t cur = index;
+    for (size_t steps = 0; versions[cur].base_version != 0; steps++) {
+        int base = versions[cur].base_version;
+        auto it = find_if(versions.begin(), versions.end(),
+            [base](const FileVersion& v) { return v.version_number == base; });
+        if (it == versions.end() || steps > versions.size()) return false;
+        cur = it - versions.begin();
+        if (doomed[cur]) return true;
+    }
+    return false;
+}
+
+PruneResult VersionManager::delete_versions(const string& backend_path, const vector<int>& version_numbers) {
+    StatTimer timer(StatOp::DELETE_VERSIONS);
+    PruneResult result;
+    if (version_numbers.empty()) return result;
+    
+    // Journals may be rebuilt from the live file; it must not be ahead of the log
+    if (WriteJournal::enabled()) WriteJournal::cut(backend_path);
+    SnapshotQueue::flush(backend_path);
+    
+    unique_lock<recursive_mutex> guard(file_lock(backend_path));
+    
+    vector<FileVersion> versions;
+    if (!load_metadata(backend_path, versions)) return result;
+    
+    vector<bool> doomed(versions.size(), false);
+    bool any = false;
+    for (size_t i = 0; i < versions.size(); i++) {
+        if (find(version_numbers.begin(), version_numbers.end(), versions[i].version_number) != version_numbers.end()) {
+            doomed[i] = any = true;
+        }
+    }
+    if (!any) return result;
+    
+    // Rebuild every survivor that reads through a doomed version. All of them
+    // are rebuilt from the intact history before anything is released, and
+    // the history stays untouched if any rebuild fails.
+    vector<pair<size_t, string>> rebuilt;
+    auto abandon = [&](size_t i) {
+        cerr << "[VFS] ✗ Cannot rebuild version " << versions[i].version_number
+             << ", keeping history of " << backend_path << endl;
+        for (auto& r : rebuilt) ObjectStore::release(r.second);
+        return PruneResult();
+    };
     
-    int to_delete = versions.size() - keep_count;
-    for (int i = 0; i < to_delete; i++) {
-        unlink(versions[i].version_path.c_str());
+    for (size_t i = 0; i < versions.size(); i++) {
+        if (doomed[i] || !depends_on_doomed(versions, doomed, i)) continue;
+        
+        string content;
+        if (!reconstruct(backend_path, versions, i, content)) return abandon(i);
+        
+        // Old enough to be rekeyed means old enough for the high-ratio codec
+        Codec codec = Codec::NONE;
+        if (compression_enabled && codec_for_file(backend_path) != Codec::NONE) codec = Codec::DEFLATE_BEST;
+        string object_id = ObjectStore::put_data(content, codec);
+        if (object_id.empty()) return abandon(i);
+        
+        rebuilt.emplace_back(i, object_id);
+        result.rewritten += content.size();
     }
     
-    versions.erase(versions.begin(), versions.begin() + to_delete);
-    save_metadata(backend_path, versions);
+    // The new history goes to disk before anything it no longer uses is
+    // released, so a crash in between leaks objects instead of losing them
+    vector<FileVersion> kept;
+    vector<FileVersion> released;
+    size_t next_rebuilt = 0;
+    for (size_t i = 0; i < versions.size(); i++) {
+        if (doomed[i]) {
+            released.push_back(versions[i]);
+            result.removed++;
+            continue;
+        }
+        FileVersion ver = versions[i];
+        if (next_rebuilt < rebuilt.size() && rebuilt[next_rebuilt].first == i) {
+            released.push_back(ver);
+            ver.object_id = rebuilt[next_rebuilt].second;
+            ver.base_version = 0;
+            ver.flags = 0;
+            ver.stored_size = ObjectStore::stored_size(ver.object_id);
+            next_rebuilt++;
+        }
+        kept.push_back(ver);
+    }
+    if (!save_metadata(backend_path, kept)) {
+        for (auto& r : rebuilt) ObjectStore::release(r.second);
+        return PruneResult();
+    }
+    
+    for (const FileVersion& ver : released) {
+        result.reclaimed += release_version_content(ver);
+    }
+    
+    // Outside the file lock: the listener may wait for the kernel
+    guard.unlock();
+    if (history_listener) history_listener(backend_path);
+    return result;
+}
+
+bool VersionManager::load_last_version(const string& backend_path, FileVersion& last) {
+    string meta_path = get_meta_path(backend_path);
+    struct stat meta_st;
+    if (stat(meta_path.c_str(), &meta_st) != 0) return false;
+    
+    if (VersionCache::get_last(meta_path, meta_st, last)) return true;
+    if (MetaLog::read_last(meta_path, last)) return true;
+    if (MetaLog::maybe_log(meta_path)) return false;
+    
+    // Old text format: a full load migrates it
+    vector<FileVersion> versions;
+    load_metadata(backend_path, versions);
+    if (versions.empty()) return false;
+    last = versions.back();
+    return true;
 }
 
-void VersionManager::load_metadata(const string& backend_path, vector<FileVersion>& versions) {
+bool VersionManager::load_metadata(const string& backend_path, vector<FileVersion>& versions) {
+    StatTimer timer(StatOp::LOAD_METADATA);
     versions.clear();
     
     string meta_path = get_meta_path(backend_path);
+    struct stat meta_st;
+    if (stat(meta_path.c_str(), &meta_st) != 0) {
+        VersionCache::invalidate(meta_path);
+        return true;
+    }
+    
+    if (VersionCache::get(meta_path, meta_st, versions)) return true;
+    
+    if (!MetaLog::read_all(meta_path, versions)) {
+        // A torn or half-created binary log must not be mistaken for the
+        // old text format: migrating it would write back an empty history
+        if (MetaLog::maybe_log(meta_path)) {
+            cerr << "[VFS] ✗ Unreadable metadata log, left as is: " << meta_path << endl;
+            versions.clear();
+            return false;
+        }
+        migrate_text_metadata(meta_path, versions);
+        if (stat(meta_path.c_str(), &meta_st) != 0) return true;
+    }
+    
+    VersionCache::put(meta_path, meta_st, versions);
+    return true;
+}
+
+void VersionManager::migrate_text_metadata(const string& meta_path, vector<FileVersion>& versions) {
+    versions.clear();
     ifstream meta_file(meta_path);
     
     if (!meta_file) return;
@@ -180,30 +969,54 @@ void VersionManager::load_metadata(const string& backend_path, vector<FileVersio
             parts.push_back(part);
         }
         
-        if (parts.size() == 4) {
+        if (parts.size() >= 4) {
             FileVersion ver;
-            ver.version_number = stoi(parts[0]);
-            ver.timestamp = stol(parts[1]);
-            ver.size = stoull(parts[2]);
-            ver.version_path = parts[3];
+            try {
+                ver.version_number = stoi(parts[0]);
+                ver.timestamp = stol(parts[1]);
+                ver.size = stoull(parts[2]);
+                ver.object_id = parts[3];
+                ver.base_version = parts.size() >= 5 ? stoi(parts[4]) : 0;
+            } catch (const exception&) {
+                cerr << "[VFS] ✗ Skipping malformed line in " << meta_path << endl;
+                continue;
+            }
+            
+            // The oldest format kept a full copy per version; move it into the object store
+            if (!ver.object_id.empty() && ver.object_id[0] == '/') {
+                string legacy_path = ver.object_id;
+                ver.object_id = ObjectStore::put_file(legacy_path);
+                if (ver.object_id.empty()) {
+                    cerr << "[VFS] ✗ Dropping unreadable legacy version: " << legacy_path << endl;
+                    continue;
+                }
+                unlink(legacy_path.c_str());
+                rmdir(legacy_path.substr(0, legacy_path.find_last_of('/')).c_str());
+            }
             versions.push_back(ver);
         }
     }
+    meta_file.close();
+    
+    if (MetaLog::write_all(meta_path, versions)) {
+        cerr << "[VFS] ✓ Migrated " << meta_path << " to the binary log (" << versions.size() << " versions)" << endl;
+    }
 }
 
-void VersionManager::save_metadata(const string& backend_path, const vector<FileVersion>& versions) {
+bool VersionManager::save_metadata(const string& backend_path, const vector<FileVersion>& versions) {
+    StatTimer timer(StatOp::SAVE_METADATA);
     string meta_path = get_meta_path(backend_path);
-    ofstream meta_file(meta_path, ios::trunc);
-    
-    if (!meta_file) {
+    // Rewrites are rare (pruning); unless durability is off they are synced
+    // right away, since the objects they drop are released next
+    if (!MetaLog::write_all(meta_path, versions, MetaWal::level() != Durability::NONE)) {
         cerr << "[VFS] ✗ Failed to save metadata: " << meta_path << endl;
-        return;
+        VersionCache::invalidate(meta_path);
+        return false;
     }
     
-    for (const auto& ver : versions) {
-        meta_file << ver.version_number << "|" 
-                  << ver.timestamp << "|" 
-                  << ver.size << "|" 
-                  << ver.version_path << "\n";
+    struct stat meta_st;
+    if (stat(meta_path.c_str(), &meta_st) == 0) {
+        VersionCache::put(meta_path, meta_st, versions);
     }
-}
\ No newline at end of file
+    return true;
+}
@@ -3,56 +3,217 @@
 #include <string>
 #include <vector>
 #include <ctime>
+#include <cstdint>
+#include <mutex>
+#include <functional>
+#include <sys/types.h>
 
 using namespace std;
 
+struct SnapshotJob;
+
 struct FileVersion {
-    string version_path;  // Path to the versioned file
+    string object_id;     // Content id in the object store
     time_t timestamp;     // When this version was created
     size_t size;          // File size
+    size_t stored_size = 0;  // Bytes used in the object store (after delta/compression)
     int version_number;   // Version number (1, 2, 3, ...)
+    int base_version;     // Version this one is a delta against (0 = full keyframe)
+    int flags = 0;        // VERSION_FLAG_*
+    uint64_t epoch = 0;   // Tree snapshot epoch the content was captured in
+};
+
+// The stored object is a write journal: only the blocks a write session
+// overwrote. The content is the next version's with those blocks put back.
+const int VERSION_FLAG_JOURNAL = 1;
+
+// The path did not exist (stored as empty content). Recorded when a path is
+// created after a tree snapshot, so the snapshot knows it was not there.
+const int VERSION_FLAG_ABSENT = 2;
+
+// The versions either side of a point in time
+struct VersionsAround {
+    bool has_before = false;  // Some version has timestamp <= the time
+    bool has_after = false;   // Some version has timestamp > the time
+    FileVersion before;       // Newest version at or before the time
+    FileVersion after;        // Oldest version after it
+};
+
+// What a prune of one file's history did
+struct PruneResult {
+    int removed = 0;         // Versions deleted
+    off_t reclaimed = 0;     // Object store bytes freed
+    off_t rewritten = 0;     // Bytes written rebuilding survivors as keyframes
 };
 
 class VersionManager {
 public:
-    // Initialize versioning system
-    static void init(const string& versions_dir, const string& meta_dir);
+    // Initialize versioning system; histories are keyed by each file's
+    // path relative to `backend_root`
+    static void init(const string& versions_dir, const string& meta_dir, const string& backend_root);
+    
+    // Store new versions as deltas against the previous one,
+    // with a full keyframe every `keyframe_interval` versions
+    static void set_delta_mode(bool enabled, int keyframe_interval);
+    
+    // Compress stored versions (codec chosen by file type); the newest
+    // `recent_versions` of each file use the fast codec, older ones are
+    // recompressed with the high-ratio one
+    static void set_compression(bool enabled, int recent_versions);
     
     // Create a new version of a file before it's modified
     // Returns true if version was created successfully
     static bool create_version(const string& backend_path);
     
+    // Freeze the current content (cheaply, via reflink where possible) and
+    // let the snapshot workers store it; returns once the pre-image is safe
+    static bool create_version_async(const string& backend_path);
+    
+    // Freeze a file a rename is about to replace (or an unlink to remove). A
+    // hard link is enough (the rename leaves the store the only name of the
+    // old content), so no data is copied; a copy is taken where the file has
+    // other names or the store is on another filesystem. Submit `job` once
+    // the rename succeeded, or unlink its staged_path if it failed.
+    static bool freeze_replaced(const string& backend_path, SnapshotJob& job);
+    
+    // Turn a frozen pre-image into a version (used by the snapshot workers)
+    static bool commit_staged_version(const string& backend_path, const string& staged_path,
+                                      time_t timestamp, off_t size, int flags = 0, uint64_t epoch = 0);
+    
+    // Record that the path does not exist (a VERSION_FLAG_ABSENT version),
+    // queued behind the file's other versions; `epoch` 0 is the current one
+    static bool record_absence(const string& backend_path, uint64_t epoch = 0);
+    
+    // Freeze the content now at `src_path` as a version of `backend_path`
+    // captured in `epoch`: the file lived at backend_path then and was moved
+    // (with its directory) without changing since
+    static bool create_moved_version(const string& backend_path, const string& src_path, uint64_t epoch);
+    
     // Get all versions of a file
     static vector<FileVersion> get_versions(const string& backend_path);
     
-    // Restore a specific version
+    // Restore a specific version (false for a record that the file did not exist)
     static bool restore_version(const string& backend_path, int version_number);
     
+    // Called after a restore rewrote a live file, so the mount can drop
+    // what the kernel has cached of it
+    static void set_restore_listener(function<void(const string& backend_path)> listener);
+    
+    // Called after versions of a file were removed or its history moved by a
+    // rename: what a version number names may have changed, so the mount must
+    // drop what the kernel has cached of the file's history
+    static void set_history_listener(function<void(const string& backend_path)> listener);
+    
+    // Read the full content of a specific version (rebuilding deltas)
+    static bool read_version_content(const string& backend_path, int version_number, string& content);
+    
+    // Write the content of a specific version to dst_path (created or truncated)
+    // without holding it in memory; only deltas, which exist for small files
+    // alone, are rebuilt in memory
+    static bool export_version(const string& backend_path, int version_number, const string& dst_path);
+    
     // Get version count for a file
     static int get_version_count(const string& backend_path);
     
+    // Find the versions either side of `when` by binary search (versions are
+    // appended in timestamp order); false if the file has no history
+    static bool versions_around(const string& backend_path, time_t when, VersionsAround& around);
+    
+    // Path of a file relative to the backend root (its history's identity)
+    static string relative_path(const string& backend_path);
+    
+    // After a rename of `from` to `to`, move the history along with the
+    // file (metadata only). A history already at `to` (one being replaced,
+    // or left by a deleted file) stays there and the moved versions are
+    // appended to it; with `exchange` the two histories simply swap.
+    static void move_history(const string& from, const string& to, bool exchange);
+    
+    // Call fn with the path of every file that has a history, including files
+    // gone from the tree, until it returns false. Found through the name
+    // stored beside each log: a history that predates those is found once
+    // its file gets another version.
+    static void for_each_history(const function<bool(const string& backend_path)>& fn);
+    
     // Delete old versions (keep only last N versions)
     static void cleanup_old_versions(const string& backend_path, int keep_count);
+    
+    // Delete the given versions; survivors whose deltas or journals depend on
+    // a deleted version are rebuilt as keyframes first. All or nothing.
+    static PruneResult delete_versions(const string& backend_path, const vector<int>& version_numbers);
 
 private:
     static string versions_root;
     static string meta_root;
+    static string backend_root;
+    static string backend_root_real;
+    static bool legacy_meta;
+    static bool delta_enabled;
+    static int keyframe_interval;
+    static bool compression_enabled;
+    static int recent_versions;
+    static function<void(const string&)> restore_listener;
+    static function<void(const string&)> history_listener;
     
-    // Helper: Get version directory for a file
-    static string get_version_dir(const string& backend_path);
+    // Helper: Lock serializing all history operations on one file
+    static recursive_mutex& file_lock(const string& backend_path);
     
-    // Helper: Get metadata file path
+    // Helper: Append the history of `from` to the one at `to` (a rename
+    // replaced the file at `to`) and remove the source's log
+    static void append_history(const string& from, const string& to);
+    
+    // Helper: Copy the current content of a file to a private staging file
+    // (synchronously, and in full where the filesystem cannot reflink)
+    static bool freeze_preimage(const string& backend_path, string& staged_path, off_t& size);
+    
+    // Helper: Get metadata file path (meta/ab/cd/<hash of the relative path>.meta)
     static string get_meta_path(const string& backend_path);
     
-    // Helper: Generate version filename
-    static string get_version_filename(int version_num, time_t timestamp);
+    // Helper: Create the fan-out directories a metadata file lives in
+    static void make_meta_dirs(const string& meta_path);
+    
+    // Helper: Store the relative path a history belongs to beside its log
+    // (<key>.path; the key is its hash, so a torn file is recognised)
+    static void record_history_name(const string& meta_path, const string& backend_path);
+    
+    // Helper: Remove the name of a history whose log is gone
+    static void forget_history_name(const string& meta_path);
+    
+    // Helper: Read a version's stored data (a delta for non-keyframes)
+    static bool read_stored_content(const FileVersion& version, string& data);
+    
+    // Helper: Rebuild the content of versions[index] from its keyframe
+    // (journal versions are rebuilt from the version after them, or the live file)
+    static bool reconstruct(const string& backend_path, const vector<FileVersion>& versions,
+                            size_t index, string& content);
+    
+    // Helper: Write the content of versions[index] to dst_path: full versions
+    // are streamed out of the store, journals put back into the file in place
+    static bool write_version(const string& backend_path, const vector<FileVersion>& versions,
+                              size_t index, const string& dst_path);
+    
+    // Helper: Put a stored journal's blocks back into the file behind fd
+    static bool apply_stored_journal(const FileVersion& version, int fd);
+    
+    // Helper: Move the version that just left the recent window to the high-ratio codec
+    static void age_versions(const string& meta_path, vector<FileVersion>& versions);
+    
+    // Helper: Drop a version's reference on its stored object; returns the bytes freed
+    static off_t release_version_content(const FileVersion& version);
+    
+    // Helper: Whether versions[index] can only be rebuilt through a doomed version
+    static bool depends_on_doomed(const vector<FileVersion>& versions, const vector<bool>& doomed,
+                                  size_t index);
+    
+    // Helper: Load only the newest version record of a file
+    static bool load_last_version(const string& backend_path, FileVersion& last);
     
-    // Helper: Parse version filename to get number and timestamp
-    static bool parse_version_filename(const string& filename, int& version_num, time_t& timestamp);
+    // Helper: Load metadata for a file (served from the version cache when
+    // possible); false if a log exists but cannot be read (left untouched)
+    static bool load_metadata(const string& backend_path, vector<FileVersion>& versions);
     
-    // Helper: Load metadata for a file
-    static void load_metadata(const string& backend_path, vector<FileVersion>& versions);
+    // Helper: Rewrite the whole metadata log for a file
+    static bool save_metadata(const string& backend_path, const vector<FileVersion>& versions);
     
-    // Helper: Save metadata for a file
-    static void save_metadata(const string& backend_path, const vector<FileVersion>& versions);
+    // Helper: Convert an old pipe-delimited .meta file to the binary log
+    static void migrate_text_metadata(const string& meta_path, vector<FileVersion>& versions);
 };
\ No newline at end of file
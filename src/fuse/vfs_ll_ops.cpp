@@ -0,0 +1,859 @@
+#include "vfs_ll_ops.h"
+#include "inode_table.h"
+#include "version_hooks.h"
+#include "dir_stream.h"
+#include "cache_options.h"
+#include "version_manager.h"
+#include "history_view.h"
+#include "op_stats.h"
+#include "../common/paths.h"
+#include <sys/statvfs.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <errno.h>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <atomic>
+#include <iostream>
+#include <mutex>
+#include <vector>
+
+using namespace std;
+
+struct fuse_lowlevel_ops vfs_ll_ops = {};
+
+static struct fuse_session *session = nullptr;  // For cache invalidations
+
+// Handles open for writing on the snapshot control file; while there are
+// none, writes need not check whether they target the history namespace
+static atomic<int> view_writers{0};
+
+// A history directory listed at opendir (the namespace has no directory fds)
+struct HistoryListing {
+    string view_path;
+    vector<pair<string, struct stat>> entries;
+};
+
+// Error replies also mark the request as failed in the stats
+static void reply_err(fuse_req_t req, int err) {
+    if (err) StatTimer::fail_current();
+    fuse_reply_err(req, err);
+}
+
+void setup_ll_operations() {
+    vfs_ll_ops.init         = vfs_ll_init;
+    vfs_ll_ops.destroy      = vfs_ll_destroy;
+    vfs_ll_ops.lookup       = Timed<StatOp::LOOKUP, vfs_ll_lookup>::call;
+    vfs_ll_ops.forget       = Timed<StatOp::FORGET, vfs_ll_forget>::call;
+    vfs_ll_ops.forget_multi = Timed<StatOp::FORGET, vfs_ll_forget_multi>::call;
+    vfs_ll_ops.getattr      = Timed<StatOp::GETATTR, vfs_ll_getattr>::call;
+    vfs_ll_ops.setattr      = Timed<StatOp::SETATTR, vfs_ll_setattr>::call;
+    vfs_ll_ops.readlink     = Timed<StatOp::READLINK, vfs_ll_readlink>::call;
+    vfs_ll_ops.mkdir        = Timed<StatOp::MKDIR, vfs_ll_mkdir>::call;
+    vfs_ll_ops.unlink       = Timed<StatOp::UNLINK, vfs_ll_unlink>::call;
+    vfs_ll_ops.rmdir        = Timed<StatOp::RMDIR, vfs_ll_rmdir>::call;
+    vfs_ll_ops.rename       = Timed<StatOp::RENAME, vfs_ll_rename>::call;
+    vfs_ll_ops.open         = Timed<StatOp::OPEN, vfs_ll_open>::call;
+    vfs_ll_ops.create       = Timed<StatOp::CREATE, vfs_ll_create>::call;
+    vfs_ll_ops.read         = Timed<StatOp::READ, vfs_ll_read>::call;
+    vfs_ll_ops.write_buf    = Timed<StatOp::WRITE, vfs_ll_write_buf>::call;
+    vfs_ll_ops.flush        = Timed<StatOp::FLUSH, vfs_ll_flush>::call;
+    vfs_ll_ops.fsync        = Timed<StatOp::FSYNC, vfs_ll_fsync>::call;
+    vfs_ll_ops.release      = Timed<StatOp::RELEASE, vfs_ll_release>::call;
+    vfs_ll_ops.opendir      = Timed<StatOp::OPENDIR, vfs_ll_opendir>::call;
+    vfs_ll_ops.readdir      = Timed<StatOp::READDIR, vfs_ll_readdir>::call;
+    vfs_ll_ops.readdirplus  = Timed<StatOp::READDIRPLUS, vfs_ll_readdirplus>::call;
+    vfs_ll_ops.releasedir   = Timed<StatOp::RELEASEDIR, vfs_ll_releasedir>::call;
+    vfs_ll_ops.statfs       = Timed<StatOp::STATFS, vfs_ll_statfs>::call;
+}
+
+// Open the object behind an O_PATH handle for real I/O
+static int reopen(const Inode& inode, int flags) {
+    char proc_path[64];
+    snprintf(proc_path, sizeof(proc_path), "/proc/self/fd/%d", inode.fd);
+    return open(proc_path, flags & ~O_NOFOLLOW);
+}
+
+// Flags for the backend open of a kernel open. With writeback caching the
+// kernel reads pages of files opened write-only and handles O_APPEND itself.
+static int backend_flags(int flags) {
+    if (!CacheOptions::get().writeback_cache) return flags;
+    if ((flags & O_ACCMODE) == O_WRONLY) flags = (flags & ~O_ACCMODE) | O_RDWR;
+    return flags & ~O_APPEND;
+}
+
+static void reply_entry(fuse_req_t req, const shared_ptr<Inode>& inode, const struct stat& st) {
+    struct fuse_entry_param e;
+    memset(&e, 0, sizeof(e));
+    e.ino = inode->nodeid;
+    e.attr = st;
+    e.attr_timeout = CacheOptions::get().attr_timeout;
+    e.entry_timeout = CacheOptions::get().entry_timeout;
+
+    // If the kernel never sees the entry it will never forget it either
+    if (fuse_reply_entry(req, &e) != 0) InodeTable::forget(inode->nodeid, 1);
+}
+
+// Look `name` up after creating it and reply with the new entry
+static void reply_new_entry(fuse_req_t req, fuse_ino_t parent, const char *name) {
+    struct stat st;
+    shared_ptr<Inode> inode = InodeTable::lookup(parent, name, st);
+    if (!inode) {
+        reply_err(req, errno);
+        return;
+    }
+    reply_entry(req, inode, st);
+}
+
+// Path of `name` in the history namespace, if `dir`/`name` lies inside it
+static bool view_child(const shared_ptr<Inode>& dir, const char *name, string& view_path) {
+    if (!dir->view_path.empty()) {
+        view_path = dir->view_path + "/" + name;
+        return true;
+    }
+    if (dir->nodeid == FUSE_ROOT_ID && strcmp(name, HISTORY_TOP_NAME) == 0) {
+        view_path = HISTORY_TOP;
+        return true;
+    }
+    return false;
+}
+
+// The history namespace is read-only; replies EROFS if `dir`/`name` is in it
+static bool refuse_in_view(fuse_req_t req, const shared_ptr<Inode>& dir, const char *name) {
+    string view_path;
+    if (!view_child(dir, name, view_path)) return false;
+    reply_err(req, EROFS);
+    return true;
+}
+
+// Versions only change when their history is rewritten, which invalidates
+// them (see vfs_ll_init), so the kernel may keep them much longer
+static double view_timeout(const HistoryNode& node, double configured) {
+    return node.kind == HistoryKind::VERSION ? HISTORY_VERSION_TIMEOUT : configured;
+}
+
+// Entry for a path in the history namespace (takes a lookup reference)
+static bool view_entry(const string& view_path, struct fuse_entry_param& e) {
+    HistoryNode node;
+    memset(&e, 0, sizeof(e));
+    if (!HistoryView::resolve(view_path.c_str(), node, e.attr)) return false;
+
+    shared_ptr<Inode> inode = InodeTable::lookup_view(view_path);
+    e.ino = inode->nodeid;
+    e.attr.st_ino = inode->nodeid;
+    e.attr_timeout = view_timeout(node, CacheOptions::get().attr_timeout);
+    e.entry_timeout = view_timeout(node, CacheOptions::get().entry_timeout);
+    return true;
+}
+
+void vfs_ll_init(void *userdata, struct fuse_conn_info *conn) {
+    (void) userdata;
+
+    // Let file data move between the FUSE device and backend fds with splice()
+    conn->want |= conn->capable & (FUSE_CAP_SPLICE_READ | FUSE_CAP_SPLICE_WRITE | FUSE_CAP_SPLICE_MOVE);
+    // Let the kernel choose between plain readdir and readdirplus per listing
+    conn->want |= conn->capable & (FUSE_CAP_READDIRPLUS | FUSE_CAP_READDIRPLUS_AUTO);
+    if (CacheOptions::get().writeback_cache) conn->want |= conn->capable & FUSE_CAP_WRITEBACK_CACHE;
+    VersionHooks::start();
+
+    // A restore rewrites the file behind the kernel's back
+    VersionManager::set_restore_listener([](const string& backend_path) {
+        uint64_t nodeid = InodeTable::find(backend_path);
+        if (nodeid && session) fuse_lowlevel_notify_inval_inode(session, nodeid, 0, 0);
+    });
+
+    // Pruning or a rename changes what a history's entries show; drop their
+    // cached data and attributes (lookups resolve the names again)
+    VersionManager::set_history_listener([](const string& backend_path) {
+        if (!session) return;
+        string live_path = VersionManager::relative_path(backend_path);
+        auto shows = [&live_path](const string& view_path) {
+            return HistoryView::shows_history_of(view_path, live_path);
+        };
+        for (uint64_t nodeid : InodeTable::find_views(shows)) {
+            fuse_lowlevel_notify_inval_inode(session, nodeid, 0, 0);
+        }
+    });
+}
+
+void vfs_ll_destroy(void *userdata) {
+    (void) userdata;
+    VersionManager::set_restore_listener(nullptr);
+    VersionManager::set_history_listener(nullptr);
+    VersionHooks::stop();
+    InodeTable::clear();
+}
+
+void vfs_ll_lookup(fuse_req_t req, fuse_ino_t parent, const char *name) {
+    shared_ptr<Inode> dir = InodeTable::get(parent);
+    string view_path;
+    if (dir && view_child(dir, name, view_path)) {
+        struct fuse_entry_param e;
+        if (!view_entry(view_path, e)) {
+            reply_err(req, errno);
+        } else if (fuse_reply_entry(req, &e) != 0) {
+            InodeTable::forget(e.ino, 1);
+        }
+        return;
+    }
+
+    struct stat st;
+    shared_ptr<Inode> inode = InodeTable::lookup(parent, name, st);
+    if (!inode && errno == ENOENT && CacheOptions::get().negative_timeout > 0) {
+        // Nodeid 0 lets the kernel remember that the name does not exist
+        struct fuse_entry_param e;
+        memset(&e, 0, sizeof(e));
+        e.entry_timeout = CacheOptions::get().negative_timeout;
+        fuse_reply_entry(req, &e);
+        return;
+    }
+    if (!inode) {
+        reply_err(req, errno);
+        return;
+    }
+    reply_entry(req, inode, st);
+}
+
+void vfs_ll_forget(fuse_req_t req, fuse_ino_t ino, uint64_t nlookup) {
+    InodeTable::forget(ino, nlookup);
+    fuse_reply_none(req);
+}
+
+void vfs_ll_forget_multi(fuse_req_t req, size_t count, struct fuse_forget_data *forgets) {
+    for (size_t i = 0; i < count; i++) {
+        InodeTable::forget(forgets[i].ino, forgets[i].nlookup);
+    }
+    fuse_reply_none(req);
+}
+
+void vfs_ll_getattr(fuse_req_t req, fuse_ino_t ino, struct fuse_file_info *fi) {
+    (void) fi;
+    shared_ptr<Inode> inode = InodeTable::get(ino);
+    if (!inode) {
+        reply_err(req, ESTALE);
+        return;
+    }
+
+    struct stat st;
+    if (!inode->view_path.empty()) {
+        HistoryNode node;
+        if (!HistoryView::resolve(inode->view_path.c_str(), node, st)) {
+            reply_err(req, errno);
+            return;
+        }
+        st.st_ino = ino;
+        fuse_reply_attr(req, &st, view_timeout(node, CacheOptions::get().attr_timeout));
+        return;
+    }
+
+    if (fstatat(inode->fd, "", &st, AT_EMPTY_PATH | AT_SYMLINK_NOFOLLOW) != 0) {
+        reply_err(req, errno);
+        return;
+    }
+    fuse_reply_attr(req, &st, CacheOptions::get().attr_timeout);
+}
+
+void vfs_ll_setattr(fuse_req_t req, fuse_ino_t ino, struct stat *attr, int to_set,
+                    struct fuse_file_info *fi) {
+    shared_ptr<Inode> inode = InodeTable::get(ino);
+    if (!inode) {
+        reply_err(req, ESTALE);
+        return;
+    }
+    if (!inode->view_path.empty()) {
+        // The snapshot control file may be truncated on the way to a write
+        HistoryNode node;
+        struct stat st;
+        bool control = HistoryView::resolve(inode->view_path.c_str(), node, st) &&
+                       node.kind == HistoryKind::SNAPSHOTS && to_set == FUSE_SET_ATTR_SIZE;
+        if (!control) {
+            reply_err(req, EROFS);
+            return;
+        }
+        fuse_reply_attr(req, &st, CacheOptions::get().attr_timeout);
+        return;
+    }
+
+    char proc_path[64];
+    snprintf(proc_path, sizeof(proc_path), "/proc/self/fd/%d", inode->fd);
+    int res = 0;
+
+    if (to_set & FUSE_SET_ATTR_MODE) {
+        res = fi ? fchmod(fi->fh, attr->st_mode) : chmod(proc_path, attr->st_mode);
+    }
+    if (res == 0 && (to_set & (FUSE_SET_ATTR_UID | FUSE_SET_ATTR_GID))) {
+        uid_t uid = (to_set & FUSE_SET_ATTR_UID) ? attr->st_uid : (uid_t)-1;
+        gid_t gid = (to_set & FUSE_SET_ATTR_GID) ? attr->st_gid : (gid_t)-1;
+        res = fchownat(inode->fd, "", uid, gid, AT_EMPTY_PATH | AT_SYMLINK_NOFOLLOW);
+    }
+    if (res == 0 && (to_set & FUSE_SET_ATTR_SIZE)) {
+        VersionHooks::before_truncate(InodeTable::backend_path(ino), attr->st_size);
+        res = fi ? ftruncate(fi->fh, attr->st_size) : truncate(proc_path, attr->st_size);
+    }
+    if (res == 0 && (to_set & (FUSE_SET_ATTR_ATIME | FUSE_SET_ATTR_MTIME))) {
+        struct timespec tv[2];
+        tv[0].tv_sec = 0;
+        tv[1].tv_sec = 0;
+        tv[0].tv_nsec = UTIME_OMIT;
+        tv[1].tv_nsec = UTIME_OMIT;
+
+        if (to_set & FUSE_SET_ATTR_ATIME_NOW) tv[0].tv_nsec = UTIME_NOW;
+        else if (to_set & FUSE_SET_ATTR_ATIME) tv[0] = attr->st_atim;
+        if (to_set & FUSE_SET_ATTR_MTIME_NOW) tv[1].tv_nsec = UTIME_NOW;
+        else if (to_set & FUSE_SET_ATTR_MTIME) tv[1] = attr->st_mtim;
+
+        res = fi ? futimens(fi->fh, tv) : utimensat(AT_FDCWD, proc_path, tv, 0);
+    }
+
+    if (res != 0) {
+        reply_err(req, errno);
+        return;
+    }
+    vfs_ll_getattr(req, ino, fi);
+}
+
+void vfs_ll_readlink(fuse_req_t req, fuse_ino_t ino) {
+    shared_ptr<Inode> inode = InodeTable::get(ino);
+    if (!inode) {
+        reply_err(req, ESTALE);
+        return;
+    }
+
+    if (!inode->view_path.empty()) {
+        reply_err(req, EINVAL);
+        return;
+    }
+
+    char buf[PATH_MAX + 1];
+    ssize_t n = readlinkat(inode->fd, "", buf, sizeof(buf) - 1);
+    if (n == -1) {
+        reply_err(req, errno);
+        return;
+    }
+    buf[n] = '\0';
+    fuse_reply_readlink(req, buf);
+}
+
+void vfs_ll_mkdir(fuse_req_t req, fuse_ino_t parent, const char *name, mode_t mode) {
+    shared_ptr<Inode> dir = InodeTable::get(parent);
+    if (!dir) {
+        reply_err(req, ESTALE);
+        return;
+    }
+    if (refuse_in_view(req, dir, name)) return;
+
+    if (mkdirat(dir->fd, name, mode) == -1) {
+        reply_err(req, errno);
+        return;
+    }
+    reply_new_entry(req, parent, name);
+}
+
+void vfs_ll_unlink(fuse_req_t req, fuse_ino_t parent, const char *name) {
+    shared_ptr<Inode> dir = InodeTable::get(parent);
+    if (!dir) {
+        reply_err(req, ESTALE);
+        return;
+    }
+    if (refuse_in_view(req, dir, name)) return;
+
+    UnlinkPlan plan = VersionHooks::before_unlink(InodeTable::backend_path(parent, name));
+
+    if (unlinkat(dir->fd, name, 0) == -1) {
+        int err = errno;
+        VersionHooks::unlink_failed(plan);
+        reply_err(req, err);
+        return;
+    }
+    VersionHooks::unlinked(plan);
+    reply_err(req, 0);
+}
+
+void vfs_ll_rmdir(fuse_req_t req, fuse_ino_t parent, const char *name) {
+    shared_ptr<Inode> dir = InodeTable::get(parent);
+    if (!dir) {
+        reply_err(req, ESTALE);
+        return;
+    }
+    if (refuse_in_view(req, dir, name)) return;
+    reply_err(req, unlinkat(dir->fd, name, AT_REMOVEDIR) == -1 ? errno : 0);
+}
+
+void vfs_ll_rename(fuse_req_t req, fuse_ino_t parent, const char *name,
+                   fuse_ino_t newparent, const char *newname, unsigned int flags) {
+    // RENAME_WHITEOUT is for overlay filesystems only
+    if (flags & ~(RENAME_EXCHANGE | RENAME_NOREPLACE)) {
+        reply_err(req, EINVAL);
+        return;
+    }
+
+    shared_ptr<Inode> from_dir = InodeTable::get(parent);
+    shared_ptr<Inode> to_dir = InodeTable::get(newparent);
+    if (!from_dir || !to_dir) {
+        reply_err(req, ESTALE);
+        return;
+    }
+    string view_path;
+    if (view_child(from_dir, name, view_path) || view_child(to_dir, newname, view_path)) {
+        reply_err(req, EROFS);
+        return;
+    }
+
+    string real_from = InodeTable::backend_path(parent, name);
+    string real_to = InodeTable::backend_path(newparent, newname);
+    RenamePlan plan = VersionHooks::before_rename(real_from, real_to, flags);
+
+    if (renameat2(from_dir->fd, name, to_dir->fd, newname, flags) == -1) {
+        int err = errno;
+        VersionHooks::rename_failed(plan);
+        reply_err(req, err);
+        return;
+    }
+    InodeTable::renamed(newparent, newname);
+    // An exchange moved the destination too
+    if (flags & RENAME_EXCHANGE) InodeTable::renamed(parent, name);
+    VersionHooks::renamed(real_from, real_to, flags, plan);
+    reply_err(req, 0);
+}
+
+// Open a version in the history namespace; the handle is a plain fd.
+// Only the snapshot control file may be opened for writing.
+static void open_view(fuse_req_t req, const Inode& inode, struct fuse_file_info *fi) {
+    HistoryNode node;
+    struct stat st;
+    if (!HistoryView::resolve(inode.view_path.c_str(), node, st)) {
+        reply_err(req, errno);
+        return;
+    }
+    bool writing = (fi->flags & O_ACCMODE) != O_RDONLY || (fi->flags & O_TRUNC);
+    if (writing && node.kind != HistoryKind::SNAPSHOTS) {
+        reply_err(req, EROFS);
+        return;
+    }
+
+    int fd = HistoryView::open(node);
+    if (fd == -1) {
+        reply_err(req, errno);
+        return;
+    }
+
+    fi->fh = fd;
+    // Versions are cached until their history is rewritten; a report is a
+    // fresh rendering of unknown size
+    if (node.kind == HistoryKind::STATS || node.kind == HistoryKind::SNAPSHOTS) fi->direct_io = 1;
+    else fi->keep_cache = 1;
+    if (writing) view_writers++;
+    if (fuse_reply_open(req, fi) != 0) {
+        if (writing) view_writers--;
+        close(fd);
+    }
+}
+
+// A write to the snapshot control file runs its commands
+static void write_view(fuse_req_t req, const Inode& inode, struct fuse_bufvec *in_buf) {
+    HistoryNode node;
+    struct stat st;
+    if (!HistoryView::resolve(inode.view_path.c_str(), node, st)) {
+        reply_err(req, errno);
+        return;
+    }
+
+    // Commands are small; gather them from the request into memory
+    size_t size = fuse_buf_size(in_buf);
+    string data(size, '\0');
+    struct fuse_bufvec mem;
+    memset(&mem, 0, sizeof(mem));
+    mem.count = 1;
+    mem.buf[0].size = size;
+    mem.buf[0].mem = &data[0];
+    ssize_t res = fuse_buf_copy(&mem, in_buf, FUSE_BUF_NO_SPLICE);
+    if (res >= 0) res = HistoryView::write(node, data.data(), res);
+    if (res < 0) {
+        reply_err(req, -res);
+        return;
+    }
+    fuse_reply_write(req, res);
+}
+
+void vfs_ll_open(fuse_req_t req, fuse_ino_t ino, struct fuse_file_info *fi) {
+    shared_ptr<Inode> inode = InodeTable::get(ino);
+    if (!inode) {
+        reply_err(req, ESTALE);
+        return;
+    }
+
+    if (!inode->view_path.empty()) {
+        open_view(req, *inode, fi);
+        return;
+    }
+
+    // Versions (or journal sessions) start BEFORE opening, so O_TRUNC is covered
+    string real = InodeTable::backend_path(ino);
+    bool journaled = VersionHooks::before_open(real, fi->flags);
+
+    int fd = reopen(*inode, backend_flags(fi->flags));
+    if (fd == -1) {
+        int err = errno;
+        VersionHooks::open_failed(real, journaled);
+        reply_err(req, err);
+        return;
+    }
+
+    fi->fh = fd;
+    VersionHooks::opened(fi->fh, real, fi->flags, journaled);
+
+    const CacheConfig& cache = CacheOptions::get();
+    struct stat st;
+    if (cache.kernel_cache) {
+        fi->keep_cache = 1;
+    } else if (cache.auto_cache && fstat(fd, &st) == 0) {
+        fi->keep_cache = InodeTable::data_unchanged(ino, st);
+    }
+    fuse_reply_open(req, fi);
+}
+
+void vfs_ll_create(fuse_req_t req, fuse_ino_t parent, const char *name, mode_t mode,
+                   struct fuse_file_info *fi) {
+    shared_ptr<Inode> dir = InodeTable::get(parent);
+    if (!dir) {
+        reply_err(req, ESTALE);
+        return;
+    }
+    if (refuse_in_view(req, dir, name)) return;
+
+    string real = InodeTable::backend_path(parent, name);
+    VersionHooks::before_create(real);
+
+    int fd = openat(dir->fd, name, backend_flags(fi->flags | O_CREAT) & ~O_NOFOLLOW, mode);
+    if (fd == -1) {
+        reply_err(req, errno);
+        return;
+    }
+
+    struct stat st;
+    shared_ptr<Inode> inode = InodeTable::lookup(parent, name, st);
+    if (!inode) {
+        int err = errno;
+        close(fd);
+        reply_err(req, err);
+        return;
+    }
+
+    fi->fh = fd;
+    VersionHooks::created(fi->fh, real);
+
+    struct fuse_entry_param e;
+    memset(&e, 0, sizeof(e));
+    e.ino = inode->nodeid;
+    e.attr = st;
+    e.attr_timeout = CacheOptions::get().attr_timeout;
+    e.entry_timeout = CacheOptions::get().entry_timeout;
+    if (fuse_reply_create(req, &e, fi) != 0) {
+        // Interrupted: the kernel will neither forget the entry nor release the handle
+        VersionHooks::before_release(fi->fh);
+        close(fd);
+        InodeTable::forget(inode->nodeid, 1);
+    }
+}
+
+// A one-buffer vector over `size` bytes of `fd` at `pos`
+// (FUSE_BUFVEC_INIT is a C compound literal)
+static void init_fd_bufvec(struct fuse_bufvec *v, int fd, size_t size, off_t pos) {
+    memset(v, 0, sizeof(*v));
+    v->count = 1;
+    v->buf[0].size = size;
+    v->buf[0].flags = (enum fuse_buf_flags)(FUSE_BUF_IS_FD | FUSE_BUF_FD_SEEK);
+    v->buf[0].fd = fd;
+    v->buf[0].pos = pos;
+}
+
+void vfs_ll_read(fuse_req_t req, fuse_ino_t ino, size_t size, off_t off,
+                 struct fuse_file_info *fi) {
+    (void) ino;
+    // Reply with the backend fd itself: libfuse splices from it straight into
+    // the FUSE device, so the data never passes through this process
+    struct fuse_bufvec buf;
+    init_fd_bufvec(&buf, fi->fh, size, off);
+
+    OpStats::add_bytes(StatBytes::READ, size);
+    fuse_reply_data(req, &buf, FUSE_BUF_SPLICE_MOVE);
+}
+
+void vfs_ll_write_buf(fuse_req_t req, fuse_ino_t ino, struct fuse_bufvec *in_buf, off_t off,
+                      struct fuse_file_info *fi) {
+    if (view_writers > 0) {
+        shared_ptr<Inode> inode = InodeTable::get(ino);
+        if (inode && !inode->view_path.empty()) {
+            write_view(req, *inode, in_buf);
+            return;
+        }
+    }
+
+    size_t size = fuse_buf_size(in_buf);
+    VersionHooks::before_write(fi->fh, off, size);
+
+    // Copy from the request (pipe or memory) into the backend fd; with a
+    // spliced request the data moves kernel-to-kernel
+    struct fuse_bufvec out_buf;
+    init_fd_bufvec(&out_buf, fi->fh, size, off);
+
+    ssize_t res = fuse_buf_copy(&out_buf, in_buf, FUSE_BUF_SPLICE_NONBLOCK);
+    if (res < 0) {
+        reply_err(req, -res);
+        return;
+    }
+    OpStats::add_bytes(StatBytes::WRITTEN, res);
+    fuse_reply_write(req, res);
+}
+
+void vfs_ll_flush(fuse_req_t req, fuse_ino_t ino, struct fuse_file_info *fi) {
+    (void) ino;
+    (void) fi;
+    reply_err(req, 0);
+}
+
+void vfs_ll_fsync(fuse_req_t req, fuse_ino_t ino, int datasync, struct fuse_file_info *fi) {
+    shared_ptr<Inode> inode = InodeTable::get(ino);
+    if (inode && !inode->view_path.empty()) {
+        reply_err(req, 0);
+        return;
+    }
+
+    int res = datasync ? fdatasync(fi->fh) : fsync(fi->fh);
+    if (res == -1) {
+        reply_err(req, errno);
+        return;
+    }
+    VersionHooks::after_fsync(InodeTable::backend_path(ino));
+    reply_err(req, 0);
+}
+
+void vfs_ll_release(fuse_req_t req, fuse_ino_t ino, struct fuse_file_info *fi) {
+    bool writing = (fi->flags & O_ACCMODE) != O_RDONLY || (fi->flags & O_TRUNC);
+    if (writing && view_writers > 0) {
+        shared_ptr<Inode> inode = InodeTable::get(ino);
+        if (inode && !inode->view_path.empty()) view_writers--;
+    }
+    VersionHooks::before_release(fi->fh);
+    close(fi->fh);
+    reply_err(req, 0);
+}
+
+// Snapshot a history directory; readdir serves it by index
+static void opendir_view(fuse_req_t req, const Inode& inode, struct fuse_file_info *fi) {
+    HistoryNode node;
+    struct stat st;
+    if (!HistoryView::resolve(inode.view_path.c_str(), node, st)) {
+        reply_err(req, errno);
+        return;
+    }
+
+    HistoryListing *listing = new HistoryListing;
+    listing->view_path = inode.view_path;
+    bool listed = HistoryView::list(node, [listing](const char *name, const struct stat& entry) {
+        listing->entries.emplace_back(name, entry);
+        return true;
+    });
+    if (!listed) {
+        int err = errno;
+        delete listing;
+        reply_err(req, err);
+        return;
+    }
+
+    fi->fh = (uint64_t)listing;
+    fuse_reply_open(req, fi);
+}
+
+void vfs_ll_opendir(fuse_req_t req, fuse_ino_t ino, struct fuse_file_info *fi) {
+    shared_ptr<Inode> inode = InodeTable::get(ino);
+    if (!inode) {
+        reply_err(req, ESTALE);
+        return;
+    }
+
+    if (!inode->view_path.empty()) {
+        opendir_view(req, *inode, fi);
+        return;
+    }
+
+    int fd = openat(inode->fd, ".", O_RDONLY | O_DIRECTORY);
+    DIR *dp = (fd == -1) ? nullptr : fdopendir(fd);
+    if (!dp) {
+        int err = errno;
+        if (fd != -1) close(fd);
+        reply_err(req, err);
+        return;
+    }
+
+    DirStream *d = new DirStream;
+    d->dp = dp;
+    fi->fh = (uint64_t)d;
+    fuse_reply_open(req, fi);
+}
+
+static bool is_dot_or_dotdot(const char *name) {
+    return name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'));
+}
+
+// Fill one reply from a history listing; offsets are entry indices + 1
+static void readdir_view(fuse_req_t req, HistoryListing *listing, size_t size, off_t off, bool plus) {
+    vector<char> buf(size);
+    size_t used = 0;
+    for (size_t i = off; i < listing->entries.size(); i++) {
+        const string& name = listing->entries[i].first;
+        const struct stat& st = listing->entries[i].second;
+
+        size_t len;
+        if (plus && !is_dot_or_dotdot(name.c_str())) {
+            struct fuse_entry_param e;
+            if (!view_entry(listing->view_path + "/" + name, e)) continue;
+            len = fuse_add_direntry_plus(req, buf.data() + used, size - used, name.c_str(), &e, i + 1);
+            if (len > size - used) InodeTable::forget(e.ino, 1);
+        } else if (plus) {
+            struct fuse_entry_param e;
+            memset(&e, 0, sizeof(e));
+            e.attr = st;
+            len = fuse_add_direntry_plus(req, buf.data() + used, size - used, name.c_str(), &e, i + 1);
+        } else {
+            len = fuse_add_direntry(req, buf.data() + used, size - used, name.c_str(), &st, i + 1);
+        }
+        if (len > size - used) break;
+        used += len;
+    }
+    fuse_reply_buf(req, buf.data(), used);
+}
+
+// Fill one reply from the stream. Plain readdir only needs the inode number
+// and file type (from d_type); readdirplus also looks every entry up, which
+// gives the kernel a reference it will forget later.
+static void do_readdir(fuse_req_t req, fuse_ino_t ino, size_t size, off_t off,
+                       struct fuse_file_info *fi, bool plus) {
+    shared_ptr<Inode> inode = InodeTable::get(ino);
+    if (inode && !inode->view_path.empty()) {
+        readdir_view(req, (HistoryListing *)fi->fh, size, off, plus);
+        return;
+    }
+
+    DirStream *d = (DirStream *)fi->fh;
+    lock_guard<mutex> guard(d->lock);
+    d->seek(off);
+
+    vector<char> buf(size);
+    size_t used = 0;
+    struct dirent *de;
+    while ((de = d->peek()) != nullptr) {
+        size_t len;
+        if (plus) {
+            struct fuse_entry_param e;
+            memset(&e, 0, sizeof(e));
+            shared_ptr<Inode> inode;
+            if (!is_dot_or_dotdot(de->d_name)) inode = InodeTable::lookup(ino, de->d_name, e.attr);
+            if (inode) {
+                e.ino = inode->nodeid;
+                e.attr_timeout = CacheOptions::get().attr_timeout;
+                e.entry_timeout = CacheOptions::get().entry_timeout;
+            } else {
+                // "." and "..", or an entry that vanished: no lookup reference
+                e.attr.st_ino = de->d_ino;
+                e.attr.st_mode = de->d_type << 12;
+            }
+
+            len = fuse_add_direntry_plus(req, buf.data() + used, size - used, de->d_name, &e, de->d_off);
+            if (len > size - used && inode) InodeTable::forget(inode->nodeid, 1);
+        } else {
+            struct stat st;
+            memset(&st, 0, sizeof(st));
+            st.st_ino = de->d_ino;
+            st.st_mode = de->d_type << 12;
+
+            len = fuse_add_direntry(req, buf.data() + used, size - used, de->d_name, &st, de->d_off);
+        }
+        if (len > size - used) break;  // Keep the entry for the next call
+
+        used += len;
+        d->consume();
+    }
+
+    if (!de && errno != 0 && used == 0) {
+        reply_err(req, errno);
+        return;
+    }
+    fuse_reply_buf(req, buf.data(), used);
+}
+
+void vfs_ll_readdir(fuse_req_t req, fuse_ino_t ino, size_t size, off_t off,
+                    struct fuse_file_info *fi) {
+    do_readdir(req, ino, size, off, fi, false);
+}
+
+void vfs_ll_readdirplus(fuse_req_t req, fuse_ino_t ino, size_t size, off_t off,
+                        struct fuse_file_info *fi) {
+    do_readdir(req, ino, size, off, fi, true);
+}
+
+void vfs_ll_releasedir(fuse_req_t req, fuse_ino_t ino, struct fuse_file_info *fi) {
+    shared_ptr<Inode> inode = InodeTable::get(ino);
+    if (inode && !inode->view_path.empty()) {
+        delete (HistoryListing *)fi->fh;
+    } else {
+        delete (DirStream *)fi->fh;
+    }
+    reply_err(req, 0);
+}
+
+void vfs_ll_statfs(fuse_req_t req, fuse_ino_t ino) {
+    shared_ptr<Inode> inode = InodeTable::get(ino);
+    if (inode && !inode->view_path.empty()) inode = InodeTable::get(FUSE_ROOT_ID);
+    struct statvfs st;
+    if (!inode || fstatvfs(inode->fd, &st) != 0) {
+        reply_err(req, inode ? errno : ESTALE);
+        return;
+    }
+    fuse_reply_statfs(req, &st);
+}
+
+int vfs_ll_main(int argc, char *argv[]) {
+    struct fuse_args args = FUSE_ARGS_INIT(argc, argv);
+    struct fuse_cmdline_opts opts;
+    if (fuse_parse_cmdline(&args, &opts) != 0) return 1;
+
+    int ret = 1;
+    if (opts.show_help) {
+        cout << "usage: " << argv[0] << " [options] <mountpoint>" << endl << endl;
+        fuse_cmdline_help();
+        fuse_lowlevel_help();
+        CacheOptions::help();
+        ret = 0;
+    } else if (opts.show_version) {
+        fuse_lowlevel_version();
+        ret = 0;
+    } else if (!opts.mountpoint) {
+        cerr << "usage: " << argv[0] << " [options] <mountpoint>" << endl;
+    } else if (!InodeTable::init(vfs_backend_path("/"))) {
+        cerr << "[VFS] ✗ Cannot open backend root " << vfs_backend_path("/") << endl;
+    } else {
+        setup_ll_operations();
+        struct fuse_session *se = fuse_session_new(&args, &vfs_ll_ops, sizeof(vfs_ll_ops), nullptr);
+        if (se) {
+            if (fuse_set_signal_handlers(se) == 0) {
+                if (fuse_session_mount(se, opts.mountpoint) == 0) {
+                    fuse_daemonize(opts.foreground);
+                    session = se;
+                    ret = opts.singlethread ? fuse_session_loop(se)
+                                            : fuse_session_loop_mt(se, opts.clone_fd);
+                    session = nullptr;
+                    fuse_session_unmount(se);
+                }
+                fuse_remove_signal_handlers(se);
+            }
+            fuse_session_destroy(se);
+        }
+    }
+
+    free(opts.mountpoint);
+    fuse_opt_free_args(&args);
+    return ret ? 1 : 0;
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#define FUSE_USE_VERSION 30
+
+#include <fuse3/fuse_lowlevel.h>
+#include <sys/stat.h>
+#include <string>
+
+using namespace std;
+
+// Low-level (inode based) implementation of the mount. Requests name
+// files by nodeid; InodeTable maps those to O_PATH handles on the backend,
+// so nothing rebuilds or re-walks absolute paths on the hot path.
+
+extern struct fuse_lowlevel_ops vfs_ll_ops;
+void setup_ll_operations();
+
+// Run the low-level mount (parses the usual FUSE command line)
+int vfs_ll_main(int argc, char *argv[]);
+
+void vfs_ll_init(void *userdata, struct fuse_conn_info *conn);
+
+void vfs_ll_destroy(void *userdata);
+
+void vfs_ll_lookup(fuse_req_t req, fuse_ino_t parent, const char *name);
+
+void vfs_ll_forget(fuse_req_t req, fuse_ino_t ino, uint64_t nlookup);
+
+void vfs_ll_forget_multi(fuse_req_t req, size_t count, struct fuse_forget_data *forgets);
+
+void vfs_ll_getattr(fuse_req_t req, fuse_ino_t ino, struct fuse_file_info *fi);
+
+void vfs_ll_setattr(fuse_req_t req, fuse_ino_t ino, struct stat *attr, int to_set,
+                    struct fuse_file_info *fi);
+
+void vfs_ll_readlink(fuse_req_t req, fuse_ino_t ino);
+
+void vfs_ll_mkdir(fuse_req_t req, fuse_ino_t parent, const char *name, mode_t mode);
+
+void vfs_ll_unlink(fuse_req_t req, fuse_ino_t parent, const char *name);
+
+void vfs_ll_rmdir(fuse_req_t req, fuse_ino_t parent, const char *name);
+
+void vfs_ll_rename(fuse_req_t req, fuse_ino_t parent, const char *name,
+                   fuse_ino_t newparent, const char *newname, unsigned int flags);
+
+void vfs_ll_open(fuse_req_t req, fuse_ino_t ino, struct fuse_file_info *fi);
+
+void vfs_ll_create(fuse_req_t req, fuse_ino_t parent, const char *name, mode_t mode,
+                   struct fuse_file_info *fi);
+
+void vfs_ll_read(fuse_req_t req, fuse_ino_t ino, size_t size, off_t off,
+                 struct fuse_file_info *fi);
+
+void vfs_ll_write_buf(fuse_req_t req, fuse_ino_t ino, struct fuse_bufvec *in_buf, off_t off,
+                      struct fuse_file_info *fi);
+
+void vfs_ll_flush(fuse_req_t req, fuse_ino_t ino, struct fuse_file_info *fi);
+
+void vfs_ll_fsync(fuse_req_t req, fuse_ino_t ino, int datasync, struct fuse_file_info *fi);
+
+void vfs_ll_release(fuse_req_t req, fuse_ino_t ino, struct fuse_file_info *fi);
+
+void vfs_ll_opendir(fuse_req_t req, fuse_ino_t ino, struct fuse_file_info *fi);
+
+void vfs_ll_readdir(fuse_req_t req, fuse_ino_t ino, size_t size, off_t off,
+                    struct fuse_file_info *fi);
+
+void vfs_ll_readdirplus(fuse_req_t req, fuse_ino_t ino, size_t size, off_t off,
+                        struct fuse_file_info *fi);
+
+void vfs_ll_releasedir(fuse_req_t req, fuse_ino_t ino, struct fuse_file_info *fi);
+
+void vfs_ll_statfs(fuse_req_t req, fuse_ino_t ino);
@@ -1,8 +1,11 @@
 #define FUSE_USE_VERSION 30
 
 #include <fuse3/fuse.h>
+#include <cstdlib>
 #include <iostream>
 #include "vfs_ops.h"
+#include "vfs_ll_ops.h"
+#include "cache_options.h"
 
 using namespace std;
 
@@ -15,7 +18,20 @@ int main(int argc, char *argv[]) {
     cout << "╚═══════════════════════════════════════╝" << endl;
     cout << endl;
 
-    setup_operations();
+    // Caching options apply to both mounts; everything else goes to libfuse
+    struct fuse_args args = FUSE_ARGS_INIT(argc, argv);
+    if (!CacheOptions::parse(&args)) return 1;
 
-    return fuse_main(argc, argv, &vfs_ops, nullptr);
-}
\ No newline at end of file
+    // VFS_HIGH_LEVEL=1 keeps the original path-based mount
+    int ret;
+    char *high_level_env = getenv("VFS_HIGH_LEVEL");
+    if (high_level_env && atoi(high_level_env)) {
+        setup_operations();
+        ret = fuse_main(args.argc, args.argv, &vfs_ops, nullptr);
+    } else {
+        ret = vfs_ll_main(args.argc, args.argv);
+    }
+
+    fuse_opt_free_args(&args);
+    return ret;
+}
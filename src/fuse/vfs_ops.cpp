@@ -9,116 +9,240 @@
 #include <dirent.h>
 #include <errno.h>
 #include <string>
-#include <map>
+#include <cstdlib>
+#include <cstdio>
+#include <climits>
 
 #include "vfs_ops.h"
+#include "version_hooks.h"
+#include "dir_cache.h"
+#include "dir_stream.h"
+#include "cache_options.h"
+#include "history_view.h"
 #include "version_manager.h"
+#include "op_stats.h"
 #include "../common/paths.h"
 
 using namespace std;
 
-struct OpenFileInfo {
-    bool has_been_written;
-    bool version_created;
-    off_t original_size;
-};
-
-static map<string, OpenFileInfo> open_files;
-
 struct fuse_operations vfs_ops = {};
 
 void setup_operations() {
     vfs_ops.init    = vfs_init;
-    vfs_ops.getattr = vfs_getattr;
-    vfs_ops.readdir = vfs_readdir;
-    vfs_ops.open    = vfs_open;
-    vfs_ops.read    = vfs_read;
-    vfs_ops.write   = vfs_write;
-    vfs_ops.create  = vfs_create;
-    vfs_ops.unlink  = vfs_unlink;
-    vfs_ops.mkdir   = vfs_mkdir;
-    vfs_ops.rmdir   = vfs_rmdir;
-    vfs_ops.rename  = vfs_rename;
-    vfs_ops.truncate = vfs_truncate;
-    vfs_ops.flush   = vfs_flush;
-    vfs_ops.release = vfs_release;
+    vfs_ops.destroy = vfs_destroy;
+    vfs_ops.getattr = Timed<StatOp::GETATTR, vfs_getattr>::call;
+    vfs_ops.opendir = Timed<StatOp::OPENDIR, vfs_opendir>::call;
+    vfs_ops.readdir = Timed<StatOp::READDIR, vfs_readdir>::call;
+    vfs_ops.releasedir = Timed<StatOp::RELEASEDIR, vfs_releasedir>::call;
+    vfs_ops.open    = Timed<StatOp::OPEN, vfs_open>::call;
+    vfs_ops.read    = Timed<StatOp::READ, vfs_read>::call;
+    vfs_ops.write   = Timed<StatOp::WRITE, vfs_write>::call;
+    vfs_ops.read_buf  = Timed<StatOp::READ, vfs_read_buf>::call;
+    vfs_ops.write_buf = Timed<StatOp::WRITE, vfs_write_buf>::call;
+    vfs_ops.create  = Timed<StatOp::CREATE, vfs_create>::call;
+    vfs_ops.unlink  = Timed<StatOp::UNLINK, vfs_unlink>::call;
+    vfs_ops.mkdir   = Timed<StatOp::MKDIR, vfs_mkdir>::call;
+    vfs_ops.rmdir   = Timed<StatOp::RMDIR, vfs_rmdir>::call;
+    vfs_ops.rename  = Timed<StatOp::RENAME, vfs_rename>::call;
+    vfs_ops.truncate = Timed<StatOp::TRUNCATE, vfs_truncate>::call;
+    vfs_ops.flush   = Timed<StatOp::FLUSH, vfs_flush>::call;
+    vfs_ops.fsync   = Timed<StatOp::FSYNC, vfs_fsync>::call;
+    vfs_ops.release = Timed<StatOp::RELEASE, vfs_release>::call;
 }
 
 void* vfs_init(struct fuse_conn_info *conn, struct fuse_config *cfg) {
-    (void) conn;
-    (void) cfg;
-    
-    cerr << "[VFS] ═══════════════════════════════════════" << endl;
-    cerr << "[VFS] Versioned Filesystem Initializing..." << endl;
-    cerr << "[VFS] ═══════════════════════════════════════" << endl;
-    
-    char *env_root = getenv("VFS_BACKEND_ROOT");
-    string backend_root = env_root ? string(env_root) : "./runtime/data";
-    
-    size_t pos = backend_root.rfind("/data");
-    string project_root = (pos != string::npos) 
-        ? backend_root.substr(0, pos) 
-        : backend_root + "/..";
-    
-    string versions_dir = project_root + "/versions";
-    string meta_dir = project_root + "/meta";
-    
-    VersionManager::init(versions_dir, meta_dir);
-    
-    cerr << "[VFS] ✓ Versioning System: ACTIVE" << endl;
-    cerr << "[VFS] ✓ Backend Storage:   " << backend_root << endl;
-    cerr << "[VFS] ✓ Version Archive:   " << versions_dir << endl;
-    cerr << "[VFS] ✓ Metadata Storage:  " << meta_dir << endl;
-    cerr << "[VFS] ═══════════════════════════════════════" << endl;
-    cerr << "[VFS] Ready! All file changes will be versioned." << endl;
-    
+    // Let file data move between the FUSE device and backend fds with splice()
+    conn->want |= conn->capable & (FUSE_CAP_SPLICE_READ | FUSE_CAP_SPLICE_WRITE | FUSE_CAP_SPLICE_MOVE);
+
+    const CacheConfig& cache = CacheOptions::get();
+    cfg->attr_timeout = cache.attr_timeout;
+    cfg->entry_timeout = cache.entry_timeout;
+    cfg->negative_timeout = cache.negative_timeout;
+    cfg->kernel_cache = cache.kernel_cache;
+    cfg->auto_cache = cache.auto_cache;
+    if (cache.writeback_cache) conn->want |= conn->capable & FUSE_CAP_WRITEBACK_CACHE;
+
+    vfs_start_backend();
+
+    // A restore rewrites the file behind the kernel's back. Its path may
+    // spell the root differently (a tree snapshot restore uses the root the
+    // version store was configured with), so compare normalized paths.
+    struct fuse *fuse = fuse_get_context()->fuse;
+    string root = normalize_path(vfs_backend_path("/"));
+    char real[PATH_MAX];
+    string root_real = realpath(root.c_str(), real) ? string(real) : root;
+    VersionManager::set_restore_listener([fuse, root, root_real](const string& backend_path) {
+        string path = normalize_path(backend_path);
+        string virtual_path;
+        if (path_below(path, root, virtual_path) || path_below(path, root_real, virtual_path)) {
+            fuse_invalidate_path(fuse, virtual_path.c_str());
+        }
+    });
     return nullptr;
 }
 
+void vfs_start_backend() {
+    VersionHooks::start();
+
+    // VFS_DIR_CACHE_SIZE=N caps how many directory handles stay open
+    char *dir_cache_env = getenv("VFS_DIR_CACHE_SIZE");
+    if (dir_cache_env) {
+        DirCache::set_capacity(strtoul(dir_cache_env, nullptr, 10));
+    }
+    if (!DirCache::init(vfs_backend_path("/"))) {
+        cerr << "[VFS] ✗ Cannot open backend root " << vfs_backend_path("/") << endl;
+    }
+}
+
+void vfs_destroy(void *private_data) {
+    (void) private_data;
+    VersionManager::set_restore_listener(nullptr);
+    vfs_stop_backend();
+}
+
+void vfs_stop_backend() {
+    VersionHooks::stop();
+
+    DirCacheStats stats = DirCache::get_stats();
+    cerr << "[VFS] Directory cache: " << stats.hits << " hits, " << stats.misses << " misses, "
+         << stats.evictions << " evictions" << endl;
+    DirCache::clear();
+}
+
 int vfs_getattr(const char *path, struct stat *stbuf, struct fuse_file_info *fi) {
     (void) fi;
     memset(stbuf, 0, sizeof(struct stat));
-    string real = vfs_backend_path(path);
 
-    if (string(path) == "/") {
-        struct stat s;
-        if (stat(real.c_str(), &s) == -1) {
+    if (HistoryView::contains(path)) {
+        HistoryNode node;
+        return HistoryView::resolve(path, node, *stbuf) ? 0 : -errno;
+    }
+
+    const char *name;
+    shared_ptr<CachedDir> dir = DirCache::parent_of(path, name);
+    if (!dir || fstatat(dir->fd, name, stbuf, 0) == -1) {
+        if (string(path) == "/") {
+            string real = vfs_backend_path(path);
             mkdir(real.c_str(), 0755);
             stbuf->st_mode = S_IFDIR | 0755;
             stbuf->st_nlink = 2;
             return 0;
         }
+        return -errno;
+    }
+    return 0;
+}
+
+int vfs_opendir(const char *path, struct fuse_file_info *fi) {
+    // History listings are produced in full by readdir (no handle)
+    if (HistoryView::contains(path)) {
+        HistoryNode node;
+        struct stat st;
+        if (!HistoryView::resolve(path, node, st)) return -errno;
+        if (!S_ISDIR(st.st_mode)) return -ENOTDIR;
+        fi->fh = 0;
+        return 0;
     }
 
-    if (stat(real.c_str(), stbuf) == -1) return -errno;
+    const char *name;
+    shared_ptr<CachedDir> dir = DirCache::parent_of(path, name);
+    if (!dir) return -errno;
+
+    int fd = openat(dir->fd, name, O_RDONLY | O_DIRECTORY);
+    if (fd == -1) return -errno;
+    DIR *dp = fdopendir(fd);
+    if (!dp) {
+        int err = errno;
+        close(fd);
+        return -err;
+    }
+
+    DirStream *d = new DirStream;
+    d->dp = dp;
+    fi->fh = (uint64_t)d;
     return 0;
 }
 
 int vfs_readdir(const char *path, void *buf, fuse_fill_dir_t filler,
                 off_t offset, struct fuse_file_info *fi, enum fuse_readdir_flags flags) {
-    (void) offset; (void) fi; (void) flags;
-    string real = vfs_backend_path(path);
+    if (HistoryView::contains(path)) {
+        HistoryNode node;
+        struct stat st;
+        if (!HistoryView::resolve(path, node, st)) return -errno;
+        bool listed = HistoryView::list(node, [&](const char *name, const struct stat& entry) {
+            return filler(buf, name, &entry, 0, FUSE_FILL_DIR_PLUS) == 0;
+        });
+        return listed ? 0 : -errno;
+    }
 
-    DIR *dp = opendir(real.c_str());
-    if (!dp) return -errno;
+    DirStream *d = (DirStream *)fi->fh;
+    lock_guard<mutex> guard(d->lock);
+    d->seek(offset);
 
+    // Entries carry their real offsets, so a listing that does not fit in one
+    // reply resumes where it stopped instead of being produced again
     struct dirent *de;
-    filler(buf, ".", nullptr, 0, FUSE_FILL_DIR_PLUS);
-    filler(buf, "..", nullptr, 0, FUSE_FILL_DIR_PLUS);
-
-    while ((de = readdir(dp)) != nullptr) {
-        if (strcmp(de->d_name, ".") == 0 || strcmp(de->d_name, "..") == 0) continue;
+    while ((de = d->peek()) != nullptr) {
         struct stat st;
-        string child = real + "/" + de->d_name;
-        if (stat(child.c_str(), &st) == -1) continue;
-        filler(buf, de->d_name, &st, 0, FUSE_FILL_DIR_PLUS);
+        memset(&st, 0, sizeof(st));
+        enum fuse_fill_dir_flags fill_flags = (enum fuse_fill_dir_flags) 0;
+
+        // Full attributes only for readdirplus; plain readdir needs just the type
+        if ((flags & FUSE_READDIR_PLUS) && fstatat(dirfd(d->dp), de->d_name, &st, 0) == 0) {
+            fill_flags = FUSE_FILL_DIR_PLUS;
+        } else {
+            st.st_ino = de->d_ino;
+            st.st_mode = de->d_type << 12;
+        }
+
+        if (filler(buf, de->d_name, &st, de->d_off, fill_flags)) break;  // Reply is full
+        d->consume();
     }
-    closedir(dp);
+
+    if (!de && errno != 0) return -errno;
+    return 0;
+}
+
+int vfs_releasedir(const char *path, struct fuse_file_info *fi) {
+    (void) path;
+    delete (DirStream *)fi->fh;
+    return 0;
+}
+
+// Open a version in the history namespace (read-only);
+// only the snapshot control file may be opened for writing
+static int open_history(const char *path, struct fuse_file_info *fi) {
+    HistoryNode node;
+    struct stat st;
+    if (!HistoryView::resolve(path, node, st)) return -errno;
+    bool writing = (fi->flags & O_ACCMODE) != O_RDONLY || (fi->flags & O_TRUNC);
+    if (writing && node.kind != HistoryKind::SNAPSHOTS) return -EROFS;
+
+    int fd = HistoryView::open(node);
+    if (fd == -1) return -errno;
+
+    fi->fh = fd;
+    // A report is a fresh rendering of unknown size. Versions change when
+    // their history is pruned or moved by a rename, and this API can only
+    // invalidate paths by name, so nothing is kept across opens.
+    if (node.kind == HistoryKind::STATS || node.kind == HistoryKind::SNAPSHOTS) fi->direct_io = 1;
     return 0;
 }
 
+// A write to the snapshot control file runs its commands
+static int write_history(const char *path, const char *buf, size_t size) {
+    HistoryNode node;
+    struct stat st;
+    if (!HistoryView::resolve(path, node, st)) return -errno;
+    return HistoryView::write(node, buf, size);
+}
+
 int vfs_open(const char *path, struct fuse_file_info *fi) {
-    string real = vfs_backend_path(path);
+    if (HistoryView::contains(path)) return open_history(path, fi);
+
+    const char *name;
+    shared_ptr<CachedDir> dir = DirCache::parent_of(path, name);
+    if (!dir) return -errno;
 
     int flags = 0;
     if (fi->flags & O_RDONLY) flags = O_RDONLY;
@@ -127,54 +251,54 @@ int vfs_open(const char *path, struct fuse_file_info *fi) {
     if (fi->flags & O_APPEND) flags |= O_APPEND;
     if (fi->flags & O_TRUNC)  flags |= O_TRUNC;
 
-    // Create version BEFORE opening if truncate flag is set
-    if ((fi->flags & O_TRUNC) && (fi->flags & (O_WRONLY | O_RDWR))) {
-        struct stat st;
-        if (stat(real.c_str(), &st) == 0 && st.st_size > 0) {
-            cerr << "[VFS] Truncate on open detected: " << path << endl;
-            VersionManager::create_version(real);
-            cerr << "[VFS] ✓ Version created before truncate!" << endl;
-        }
+    // With writeback caching the kernel reads pages of files opened
+    // write-only and handles O_APPEND itself
+    if (CacheOptions::get().writeback_cache) {
+        if ((flags & O_ACCMODE) == O_WRONLY) flags = (flags & ~O_ACCMODE) | O_RDWR;
+        flags &= ~O_APPEND;
     }
 
-    int fd = open(real.c_str(), flags);
-    if (fd == -1) return -errno;
+    // Only writers need the backend path (it keys the file's history)
+    bool writing = (fi->flags & O_ACCMODE) != O_RDONLY;
+    string real = writing ? vfs_backend_path(path) : "";
+
+    // Versions (or journal sessions) start BEFORE opening, so O_TRUNC is covered
+    bool journaled = writing && VersionHooks::before_open(real, fi->flags);
+
+    int fd = openat(dir->fd, name, flags);
+    if (fd == -1) {
+        int err = errno;
+        if (writing) VersionHooks::open_failed(real, journaled);
+        return -err;
+    }
     
     fi->fh = fd;
-    
-    // Track this file if opened for writing
-    if ((fi->flags & O_WRONLY) || (fi->flags & O_RDWR)) {
-        OpenFileInfo info;
-        info.has_been_written = false;
-        info.version_created = (fi->flags & O_TRUNC) ? true : false; // Already versioned if truncated
-        
-        struct stat st;
-        if (stat(real.c_str(), &st) == 0) {
-            info.original_size = st.st_size;
-        } else {
-            info.original_size = 0;
-        }
-        
-        open_files[real] = info;
-        cerr << "[VFS] Opened for writing: " << path << " (flags: " << fi->flags << ", size: " << info.original_size << ")" << endl;
-    }
+    if (writing) VersionHooks::opened(fi->fh, real, fi->flags, journaled);
 
     return 0;
 }
 
+// Open `path` for a request that came without a file handle
+static int open_unattached(const char *path, int flags) {
+    const char *name;
+    shared_ptr<CachedDir> dir = DirCache::parent_of(path, name);
+    if (!dir) return -1;
+    return openat(dir->fd, name, flags);
+}
+
 int vfs_read(const char *path, char *buf, size_t size, off_t offset, struct fuse_file_info *fi) {
-    string real = vfs_backend_path(path);
     int fd;
     
     if (fi && fi->fh) {
         fd = fi->fh;
     } else {
-        fd = open(real.c_str(), O_RDONLY);
+        fd = open_unattached(path, O_RDONLY);
         if (fd == -1) return -errno;
     }
     
     ssize_t res = pread(fd, buf, size, offset);
     if (res == -1) res = -errno;
+    else OpStats::add_bytes(StatBytes::READ, res);
     
     if (!fi || !fi->fh) close(fd);
     
@@ -182,50 +306,130 @@ int vfs_read(const char *path, char *buf, size_t size, off_t offset, struct fuse
 }
 
 int vfs_write(const char *path, const char *buf, size_t size, off_t offset, struct fuse_file_info *fi) {
-    string real = vfs_backend_path(path);
+    if (HistoryView::contains(path)) return write_history(path, buf, size);
+
     int fd;
     
     if (fi && fi->fh) {
         fd = fi->fh;
     } else {
-        fd = open(real.c_str(), O_WRONLY);
+        fd = open_unattached(path, O_WRONLY);
         if (fd == -1) return -errno;
     }
     
-    // Before first write, create version if file has content AND we haven't already versioned it
-    auto it = open_files.find(real);
-    if (it != open_files.end() && !it->second.version_created && !it->second.has_been_written) {
-        struct stat st;
-        if (stat(real.c_str(), &st) == 0 && st.st_size > 0) {
-            cerr << "[VFS] Creating version before first write: " << path << endl;
-            VersionManager::create_version(real);
-            it->second.version_created = true;
-            cerr << "[VFS] ✓ Version created successfully!" << endl;
-        }
-        it->second.has_been_written = true;
-    }
+    if (fi) VersionHooks::before_write(fi->fh, offset, size);
     
     ssize_t res = pwrite(fd, buf, size, offset);
     if (res == -1) res = -errno;
+    else OpStats::add_bytes(StatBytes::WRITTEN, res);
     
     if (!fi || !fi->fh) close(fd);
     
     return res;
 }
 
+// A one-buffer vector over `size` bytes of `fd` at `pos`
+// (FUSE_BUFVEC_INIT is a C compound literal)
+static void init_fd_bufvec(struct fuse_bufvec *v, int fd, size_t size, off_t pos) {
+    memset(v, 0, sizeof(*v));
+    v->count = 1;
+    v->buf[0].size = size;
+    v->buf[0].flags = (enum fuse_buf_flags)(FUSE_BUF_IS_FD | FUSE_BUF_FD_SEEK);
+    v->buf[0].fd = fd;
+    v->buf[0].pos = pos;
+}
+
+int vfs_read_buf(const char *path, struct fuse_bufvec **bufp, size_t size, off_t offset,
+                 struct fuse_file_info *fi) {
+    // Without an open handle there is no fd to hand back; go through a buffer
+    if (!fi || !fi->fh) {
+        struct fuse_bufvec *mem = (struct fuse_bufvec *)malloc(sizeof(struct fuse_bufvec));
+        char *data = (char *)malloc(size);
+        if (!mem || !data) {
+            free(mem);
+            free(data);
+            return -ENOMEM;
+        }
+        int res = vfs_read(path, data, size, offset, fi);
+        if (res < 0) {
+            free(mem);
+            free(data);
+            return res;
+        }
+        memset(mem, 0, sizeof(*mem));
+        mem->count = 1;
+        mem->buf[0].size = res;
+        mem->buf[0].mem = data;
+        *bufp = mem;
+        return 0;
+    }
+
+    // Reply with the backend fd itself: libfuse splices from it straight into
+    // the FUSE device, so the data never passes through this process
+    struct fuse_bufvec *src = (struct fuse_bufvec *)malloc(sizeof(struct fuse_bufvec));
+    if (!src) return -ENOMEM;
+
+    init_fd_bufvec(src, fi->fh, size, offset);
+    *bufp = src;
+    OpStats::add_bytes(StatBytes::READ, size);
+    return 0;
+}
+
+int vfs_write_buf(const char *path, struct fuse_bufvec *buf, off_t offset,
+                  struct fuse_file_info *fi) {
+    if (HistoryView::contains(path)) {
+        // Commands are small; gather them from the request into memory
+        size_t size = fuse_buf_size(buf);
+        string data(size, '\0');
+        struct fuse_bufvec mem;
+        memset(&mem, 0, sizeof(mem));
+        mem.count = 1;
+        mem.buf[0].size = size;
+        mem.buf[0].mem = &data[0];
+        ssize_t res = fuse_buf_copy(&mem, buf, FUSE_BUF_NO_SPLICE);
+        return res < 0 ? res : write_history(path, data.data(), res);
+    }
+
+    int fd;
+
+    if (fi && fi->fh) {
+        fd = fi->fh;
+    } else {
+        fd = open_unattached(path, O_WRONLY);
+        if (fd == -1) return -errno;
+    }
+
+    size_t size = fuse_buf_size(buf);
+    if (fi) VersionHooks::before_write(fi->fh, offset, size);
+
+    // Copy from the request (pipe or memory) into the backend fd; with a
+    // spliced request the data moves kernel-to-kernel
+    struct fuse_bufvec dst;
+    init_fd_bufvec(&dst, fd, size, offset);
+
+    ssize_t res = fuse_buf_copy(&dst, buf, FUSE_BUF_SPLICE_NONBLOCK);
+    if (res > 0) OpStats::add_bytes(StatBytes::WRITTEN, res);
+
+    if (!fi || !fi->fh) close(fd);
+
+    return res;
+}
+
 int vfs_truncate(const char *path, off_t size, struct fuse_file_info *fi) {
-    (void) fi;
+    if (HistoryView::contains(path)) {
+        // The snapshot control file may be truncated on the way to a write
+        HistoryNode node;
+        struct stat st;
+        if (!HistoryView::resolve(path, node, st)) return -errno;
+        return node.kind == HistoryKind::SNAPSHOTS ? 0 : -EROFS;
+    }
+
     string real = vfs_backend_path(path);
     
-    // Create version before truncating if file has content
-    struct stat st;
-    if (stat(real.c_str(), &st) == 0 && st.st_size > 0 && size < st.st_size) {
-        cerr << "[VFS] Truncate detected, creating version: " << path << endl;
-        VersionManager::create_version(real);
-        cerr << "[VFS] ✓ Version saved before truncation" << endl;
-    }
+    VersionHooks::before_truncate(real, size);
     
-    if (truncate(real.c_str(), size) == -1) return -errno;
+    int res = (fi && fi->fh) ? ftruncate(fi->fh, size) : truncate(real.c_str(), size);
+    if (res == -1) return -errno;
     return 0;
 }
 
@@ -235,23 +439,25 @@ int vfs_flush(const char *path, struct fuse_file_info *fi) {
     return 0;
 }
 
-int vfs_release(const char *path, struct fuse_file_info *fi) {
+int vfs_fsync(const char *path, int datasync, struct fuse_file_info *fi) {
+    if (HistoryView::contains(path)) return 0;
+
     string real = vfs_backend_path(path);
     
-    // Check if file was modified but version wasn't created
-    auto it = open_files.find(real);
-    if (it != open_files.end()) {
-        if (it->second.has_been_written && !it->second.version_created) {
-            struct stat st;
-            if (stat(real.c_str(), &st) == 0 && st.st_size > 0) {
-                cerr << "[VFS] 💾 Creating version on close: " << path << endl;
-                VersionManager::create_version(real);
-                cerr << "[VFS] ✓ Final version saved!" << endl;
-            }
-        }
-        open_files.erase(it);
+    if (fi && fi->fh) {
+        int res = datasync ? fdatasync(fi->fh) : fsync(fi->fh);
+        if (res == -1) return -errno;
     }
     
+    VersionHooks::after_fsync(real);
+    return 0;
+}
+
+int vfs_release(const char *path, struct fuse_file_info *fi) {
+    (void) path;
+    
+    if (fi) VersionHooks::before_release(fi->fh);
+    
     if (fi && fi->fh) {
         close(fi->fh);
     }
@@ -259,66 +465,92 @@ int vfs_release(const char *path, struct fuse_file_info *fi) {
 }
 
 int vfs_create(const char *path, mode_t mode, struct fuse_file_info *fi) {
+    if (HistoryView::contains(path)) return -EROFS;
+
     string real = vfs_backend_path(path);
-    string parent = real.substr(0, real.find_last_of('/'));
-    struct stat s;
-    if (stat(parent.c_str(), &s) == -1) mkdir(parent.c_str(), 0755);
+    const char *name;
+    shared_ptr<CachedDir> dir = DirCache::parent_of(path, name);
+    if (!dir && errno == ENOENT) {
+        string parent = real.substr(0, real.find_last_of('/'));
+        mkdir(parent.c_str(), 0755);
+        dir = DirCache::parent_of(path, name);
+    }
+    if (!dir) return -errno;
     
-    int fd = open(real.c_str(), O_CREAT | O_WRONLY | O_TRUNC, mode);
+    VersionHooks::before_create(real);
+    
+    int access = CacheOptions::get().writeback_cache ? O_RDWR : O_WRONLY;
+    int fd = openat(dir->fd, name, O_CREAT | access | O_TRUNC, mode);
     if (fd == -1) return -errno;
     
     fi->fh = fd;
-    
-    // Track this new file
-    OpenFileInfo info;
-    info.has_been_written = false;
-    info.version_created = false;
-    info.original_size = 0;
-    open_files[real] = info;
-    
-    cerr << "[VFS] New file created: " << path << endl;
+    VersionHooks::created(fi->fh, real);
     return 0;
 }
 
 int vfs_unlink(const char *path) {
-    string real = vfs_backend_path(path);
+    if (HistoryView::contains(path)) return -EROFS;
+
+    const char *name;
+    shared_ptr<CachedDir> dir = DirCache::parent_of(path, name);
+    if (!dir) return -errno;
     
-    // Create final version before deletion
-    struct stat st;
-    if (stat(real.c_str(), &st) == 0 && st.st_size > 0) {
-        cerr << "[VFS] 🗑️ Creating final version before deletion: " << path << endl;
-        VersionManager::create_version(real);
-        cerr << "[VFS] ✓ Final version preserved!" << endl;
-    }
+    UnlinkPlan plan = VersionHooks::before_unlink(vfs_backend_path(path));
     
-    if (unlink(real.c_str()) == -1) return -errno;
+    if (unlinkat(dir->fd, name, 0) == -1) {
+        int err = errno;
+        VersionHooks::unlink_failed(plan);
+        return -err;
+    }
+    VersionHooks::unlinked(plan);
     return 0;
 }
 
 int vfs_mkdir(const char *path, mode_t mode) {
-    string real = vfs_backend_path(path);
-    if (mkdir(real.c_str(), mode) == -1) return -errno;
+    if (HistoryView::contains(path)) return -EROFS;
+
+    const char *name;
+    shared_ptr<CachedDir> dir = DirCache::parent_of(path, name);
+    if (!dir) return -errno;
+
+    if (mkdirat(dir->fd, name, mode) == -1) return -errno;
     return 0;
 }
 
 int vfs_rmdir(const char *path) {
-    string real = vfs_backend_path(path);
-    if (rmdir(real.c_str()) == -1) return -errno;
+    if (HistoryView::contains(path)) return -EROFS;
+
+    const char *name;
+    shared_ptr<CachedDir> dir = DirCache::parent_of(path, name);
+    if (!dir) return -errno;
+
+    if (unlinkat(dir->fd, name, AT_REMOVEDIR) == -1) return -errno;
+    DirCache::invalidate(path);
     return 0;
 }
 
 int vfs_rename(const char *from, const char *to, unsigned int flags) {
-    (void) flags;
+    if (HistoryView::contains(from) || HistoryView::contains(to)) return -EROFS;
+
+    const char *from_name, *to_name;
+    shared_ptr<CachedDir> from_dir = DirCache::parent_of(from, from_name);
+    if (!from_dir) return -errno;
+    shared_ptr<CachedDir> to_dir = DirCache::parent_of(to, to_name);
+    if (!to_dir) return -errno;
+    
     string real_from = vfs_backend_path(from);
     string real_to = vfs_backend_path(to);
+    RenamePlan plan = VersionHooks::before_rename(real_from, real_to, flags);
     
-    // Create version of the source file before rename
-    struct stat st;
-    if (stat(real_from.c_str(), &st) == 0 && st.st_size > 0) {
-        cerr << "[VFS] Creating version before rename: " << from << " -> " << to << endl;
-        VersionManager::create_version(real_from);
+    if (renameat2(from_dir->fd, from_name, to_dir->fd, to_name, flags) == -1) {
+        int err = errno;
+        VersionHooks::rename_failed(plan);
+        return -err;
     }
-    
-    if (rename(real_from.c_str(), real_to.c_str()) == -1) return -errno;
+    VersionHooks::renamed(real_from, real_to, flags, plan);
+
+    // Cached handles below either name now point somewhere else
+    DirCache::invalidate(from);
+    DirCache::invalidate(to);
     return 0;
-}
\ No newline at end of file
+}
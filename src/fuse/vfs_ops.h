@@ -13,12 +13,23 @@ void setup_operations();
 
 void* vfs_init(struct fuse_conn_info *conn, struct fuse_config *cfg);
 
+void vfs_destroy(void *private_data);
+
+// The mount-independent half of init/destroy: version store and directory
+// cache. Lets vfs_bench drive the vfs_* operations without a kernel mount.
+void vfs_start_backend();
+void vfs_stop_backend();
+
 int vfs_getattr(const char *path, struct stat *stbuf, struct fuse_file_info *fi);
 
+int vfs_opendir(const char *path, struct fuse_file_info *fi);
+
 int vfs_readdir(const char *path, void *buf, fuse_fill_dir_t filler,
                 off_t offset, struct fuse_file_info *fi,
                 enum fuse_readdir_flags flags);
 
+int vfs_releasedir(const char *path, struct fuse_file_info *fi);
+
 int vfs_open(const char *path, struct fuse_file_info *fi);
 
 int vfs_read(const char *path, char *buf, size_t size, off_t offset,
@@ -27,6 +38,14 @@ int vfs_read(const char *path, char *buf, size_t size, off_t offset,
 int vfs_write(const char *path, const char *buf, size_t size, off_t offset,
               struct fuse_file_info *fi);
 
+// Zero-copy variants of read/write: data is spliced between the FUSE
+// device and the backend fd when the kernel supports it
+int vfs_read_buf(const char *path, struct fuse_bufvec **bufp, size_t size, off_t offset,
+                 struct fuse_file_info *fi);
+
+int vfs_write_buf(const char *path, struct fuse_bufvec *buf, off_t offset,
+                  struct fuse_file_info *fi);
+
 int vfs_create(const char *path, mode_t mode, struct fuse_file_info *fi);
 
 int vfs_unlink(const char *path);
@@ -41,4 +60,6 @@ int vfs_truncate(const char *path, off_t size, struct fuse_file_info *fi);
 
 int vfs_flush(const char *path, struct fuse_file_info *fi);
 
+int vfs_fsync(const char *path, int datasync, struct fuse_file_info *fi);
+
 int vfs_release(const char *path, struct fuse_file_info *fi);
\ No newline at end of file
@@ -0,0 +1,304 @@
+#include "write_journal.h"
+#include "object_store.h"
+#include "snapshot_queue.h"
+#include "version_manager.h"
+#include "tree_snapshots.h"
+#include "../common/paths.h"
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cstring>
+#include <cstdint>
+#include <ctime>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include <iostream>
+
+using namespace std;
+
+static const char JOURNAL_MAGIC[4] = {'V', 'T', 'J', '1'};
+
+struct JournalHeader {
+    char magic[4];
+    uint32_t block_size;
+    uint64_t original_size;
+};
+
+struct JournalEntry {
+    uint64_t block;
+    uint32_t length;
+} __attribute__((packed));
+
+struct JournalSession {
+    mutex lock;
+    int writers = 0;
+    int src_fd = -1;          // Read-only view of the live file
+    struct stat src_st = {};
+    int journal_fd = -1;
+    string journal_path;
+    off_t journal_end = 0;
+    off_t original_size = 0;
+    time_t started = 0;
+    uint64_t epoch = 0;       // Tree snapshot epoch when this journal was opened
+    bool modified = false;
+    unordered_set<uint64_t> saved;
+};
+
+static mutex sessions_mutex;
+static unordered_map<string, shared_ptr<JournalSession>> sessions;
+static bool journal_enabled = false;
+static size_t journal_block_size = 4096;
+
+void WriteJournal::set_enabled(bool enabled, size_t block_size) {
+    journal_enabled = enabled;
+    if (block_size > 0) journal_block_size = block_size;
+}
+
+bool WriteJournal::enabled() {
+    return journal_enabled;
+}
+
+// Caller holds session.lock
+static bool open_journal(JournalSession& session) {
+    struct stat st;
+    session.original_size = (fstat(session.src_fd, &st) == 0) ? st.st_size : 0;
+    session.started = time(nullptr);
+    session.epoch = TreeSnapshots::current_epoch();
+    session.modified = false;
+    session.saved.clear();
+
+    session.journal_fd = ObjectStore::open_staging(session.journal_path);
+    if (session.journal_fd == -1) return false;
+
+    JournalHeader header;
+    memcpy(header.magic, JOURNAL_MAGIC, sizeof(JOURNAL_MAGIC));
+    header.block_size = journal_block_size;
+    header.original_size = session.original_size;
+    session.journal_end = sizeof(header);
+    return pwrite(session.journal_fd, &header, sizeof(header), 0) == (ssize_t)sizeof(header);
+}
+
+// Caller holds session.lock. Hands the captured journal over as a job (or
+// discards it if nothing changed); the caller submits it after unlocking.
+static bool close_journal(JournalSession& session, const string& backend_path, SnapshotJob& job) {
+    if (session.journal_fd == -1) return false;
+    close(session.journal_fd);
+    session.journal_fd = -1;
+
+    // Versions of empty files are never kept, as with full versions
+    if (!session.modified || session.original_size == 0) {
+        unlink(session.journal_path.c_str());
+        return false;
+    }
+
+    job.backend_path = backend_path;
+    job.staged_path = session.journal_path;
+    job.timestamp = session.started;
+    job.size = session.original_size;
+    job.flags = VERSION_FLAG_JOURNAL;
+    job.epoch = session.epoch;
+    return true;
+}
+
+// Caller holds session.lock
+static void save_blocks(JournalSession& session, uint64_t first, uint64_t last) {
+    uint64_t bs = journal_block_size;
+    vector<char> buf(bs);
+
+    for (uint64_t block = first; block <= last; block++) {
+        off_t start = block * bs;
+        if (start >= session.original_size) break;       // Beyond the original end: nothing to keep
+        if (!session.saved.insert(block).second) continue;  // Already saved this session
+
+        size_t want = min<off_t>(bs, session.original_size - start);
+        ssize_t n = pread(session.src_fd, buf.data(), want, start);
+        if (n < 0) n = 0;
+
+        JournalEntry entry;
+        entry.block = block;
+        entry.length = n;
+        if (pwrite(session.journal_fd, &entry, sizeof(entry), session.journal_end) != (ssize_t)sizeof(entry) ||
+            pwrite(session.journal_fd, buf.data(), n, session.journal_end + sizeof(entry)) != n) {
+            cerr << "[VFS] ✗ Write journal failed for block " << block << endl;
+            continue;
+        }
+        session.journal_end += sizeof(entry) + n;
+    }
+}
+
+static shared_ptr<JournalSession> find_session(const string& backend_path) {
+    lock_guard<mutex> guard(sessions_mutex);
+    auto it = sessions.find(backend_path);
+    return it != sessions.end() ? it->second : nullptr;
+}
+
+void WriteJournal::begin(const string& backend_path) {
+    lock_guard<mutex> guard(sessions_mutex);
+    shared_ptr<JournalSession>& session = sessions[backend_path];
+    if (!session) session = make_shared<JournalSession>();
+
+    lock_guard<mutex> session_guard(session->lock);
+    if (session->writers++ > 0) return;
+
+    session->src_fd = open(backend_path.c_str(), O_RDONLY);
+    if (session->src_fd == -1 || fstat(session->src_fd, &session->src_st) != 0 || !open_journal(*session)) {
+        cerr << "[VFS] ✗ Cannot start write journal for " << backend_path << endl;
+    }
+}
+
+void WriteJournal::record_write(const string& backend_path, off_t offset, size_t size) {
+    shared_ptr<JournalSession> session = find_session(backend_path);
+    if (!session || size == 0) return;
+
+    lock_guard<mutex> guard(session->lock);
+    if (session->journal_fd == -1) return;
+    session->modified = true;
+    save_blocks(*session, offset / journal_block_size, (offset + size - 1) / journal_block_size);
+}
+
+bool WriteJournal::record_truncate(const string& backend_path, off_t new_size) {
+    shared_ptr<JournalSession> session = find_session(backend_path);
+    if (!session) return false;
+
+    lock_guard<mutex> guard(session->lock);
+    if (session->journal_fd == -1) return false;
+    session->modified = true;
+    if (new_size < session->original_size) {
+        save_blocks(*session, new_size / journal_block_size, (session->original_size - 1) / journal_block_size);
+    }
+    return true;
+}
+
+void WriteJournal::end(const string& backend_path) {
+    shared_ptr<JournalSession> session;
+    {
+        lock_guard<mutex> guard(sessions_mutex);
+        auto it = sessions.find(backend_path);
+        if (it == sessions.end()) return;
+        session = it->second;
+
+        lock_guard<mutex> session_guard(session->lock);
+        if (--session->writers > 0) return;
+        sessions.erase(it);
+    }
+
+    SnapshotJob job;
+    bool has_job;
+    {
+        lock_guard<mutex> guard(session->lock);
+
+        // A journal only makes sense against the file it was taken from; if
+        // the path was unlinked or renamed over, the final version was taken then
+        struct stat st;
+        if (stat(backend_path.c_str(), &st) != 0 ||
+            st.st_ino != session->src_st.st_ino || st.st_dev != session->src_st.st_dev) {
+            session->modified = false;
+        }
+
+        has_job = close_journal(*session, backend_path, job);
+        if (session->src_fd != -1) close(session->src_fd);
+        session->src_fd = -1;
+    }
+    if (has_job) SnapshotQueue::submit(job);
+}
+
+void WriteJournal::renamed(const string& from, const string& to, bool exchange) {
+    lock_guard<mutex> guard(sessions_mutex);
+    if (sessions.empty()) return;
+
+    unordered_map<string, shared_ptr<JournalSession>> moved;
+    for (auto& [path, session] : sessions) {
+        moved[renamed_path(path, from, to, exchange)] = session;
+    }
+    sessions.swap(moved);
+}
+
+void WriteJournal::cut(const string& backend_path) {
+    shared_ptr<JournalSession> session = find_session(backend_path);
+    if (!session) return;
+
+    SnapshotJob job;
+    bool has_job;
+    {
+        lock_guard<mutex> guard(session->lock);
+        if (session->src_fd == -1) return;
+        has_job = close_journal(*session, backend_path, job);
+        open_journal(*session);
+    }
+    // Submitted outside the session lock: a full queue must not stall writers
+    if (has_job) SnapshotQueue::submit(job);
+}
+
+bool WriteJournal::apply(const string& journal, string& content) {
+    JournalHeader header;
+    if (journal.size() < sizeof(header)) return false;
+    memcpy(&header, journal.data(), sizeof(header));
+    if (memcmp(header.magic, JOURNAL_MAGIC, sizeof(JOURNAL_MAGIC)) != 0 || header.block_size == 0) return false;
+
+    content.resize(header.original_size, '\0');
+
+    size_t pos = sizeof(header);
+    while (pos + sizeof(JournalEntry) <= journal.size()) {
+        JournalEntry entry;
+        memcpy(&entry, journal.data() + pos, sizeof(entry));
+        pos += sizeof(entry);
+        if (entry.length > journal.size() - pos) return false;
+
+        uint64_t start = entry.block * header.block_size;
+        if (start + entry.length > content.size()) return false;
+        memcpy(&content[start], journal.data() + pos, entry.length);
+        pos += entry.length;
+    }
+    return pos == journal.size();
+}
+
+bool WriteJournal::apply_file(int journal_fd, off_t journal_size, int fd) {
+    JournalHeader header;
+    if (journal_size < (off_t)sizeof(header) ||
+        pread(journal_fd, &header, sizeof(header), 0) != (ssize_t)sizeof(header)) return false;
+    if (memcmp(header.magic, JOURNAL_MAGIC, sizeof(JOURNAL_MAGIC)) != 0 || header.block_size == 0) return false;
+
+    if (ftruncate(fd, header.original_size) != 0) return false;
+
+    vector<char> block;
+    off_t pos = sizeof(header);
+    while (pos + (off_t)sizeof(JournalEntry) <= journal_size) {
+        JournalEntry entry;
+        if (pread(journal_fd, &entry, sizeof(entry), pos) != (ssize_t)sizeof(entry)) return false;
+        pos += sizeof(entry);
+        if (entry.length > journal_size - pos) return false;
+
+        uint64_t start = entry.block * header.block_size;
+        if (start + entry.length > header.original_size) return false;
+        block.resize(entry.length);
+        if (pread(journal_fd, block.data(), entry.length, pos) != (ssize_t)entry.length) return false;
+        if (pwrite(fd, block.data(), entry.length, start) != (ssize_t)entry.length) return false;
+        pos += entry.length;
+    }
+    return pos == journal_size;
+}
+
+void WriteJournal::overlay_active(const string& backend_path, int fd) {
+    shared_ptr<JournalSession> session = find_session(backend_path);
+    if (!session) return;
+
+    lock_guard<mutex> guard(session->lock);
+    if (session->journal_fd == -1 || !session->modified) return;
+    apply_file(session->journal_fd, session->journal_end, fd);
+}
+
+void WriteJournal::overlay_active(const string& backend_path, string& content) {
+    shared_ptr<JournalSession> session = find_session(backend_path);
+    if (!session) return;
+
+    lock_guard<mutex> guard(session->lock);
+    if (session->journal_fd == -1 || !session->modified) return;
+
+    string journal(session->journal_end, '\0');
+    if (pread(session->journal_fd, &journal[0], journal.size(), 0) == (ssize_t)journal.size()) {
+        apply(journal, content);
+    }
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <string>
+#include <sys/types.h>
+
+using namespace std;
+
+// Block-level write journal ("journal mode").
+//
+// Instead of copying a whole file before its first write, a write session
+// (all handles writing the file, from the first open to the last release)
+// saves the original content of each block the first time it is
+// overwritten. When the session ends the journal becomes a version: its
+// content is the file as it was after the session (the next version, or the
+// live file) with the saved blocks put back and cut to the original size.
+//
+// Journal file layout: a header (magic, block size, original size) followed
+// by entries of [block number][length][original bytes].
+class WriteJournal {
+public:
+    static void set_enabled(bool enabled, size_t block_size);
+    static bool enabled();
+
+    // Start (or join) the write session of a file
+    static void begin(const string& backend_path);
+
+    // Save the pre-image of the blocks a write is about to overwrite
+    static void record_write(const string& backend_path, off_t offset, size_t size);
+
+    // Save the pre-image of everything a truncation is about to drop
+    // Returns false if the file has no open session
+    static bool record_truncate(const string& backend_path, off_t new_size);
+
+    // Leave the session; the last writer turns the journal into a version
+    // (unless the file was empty, or was unlinked or replaced meanwhile)
+    static void end(const string& backend_path);
+
+    // Move the sessions of files on (or below) `from` to their new paths
+    // after a rename, or an exchange with `to`
+    static void renamed(const string& from, const string& to, bool exchange);
+
+    // Commit what the session has captured so far and start a fresh journal.
+    // Called before any other kind of version is taken of the file, so that
+    // every journal's "after" state is exactly the version that follows it.
+    static void cut(const string& backend_path);
+
+    // Put a journal's saved blocks back into `content` (the post-session state)
+    static bool apply(const string& journal, string& content);
+
+    // Same, for a journal of `journal_size` bytes read from journal_fd and
+    // content kept in the file behind fd; only one entry is in memory at a time
+    static bool apply_file(int journal_fd, off_t journal_size, int fd);
+
+    // Undo the still-open session's writes in `content` (the live file),
+    // giving the state the newest committed version is based on
+    static void overlay_active(const string& backend_path, string& content);
+    static void overlay_active(const string& backend_path, int fd);
+};
@@ -1,5 +1,6 @@
 #include "tui_manager.h"
 #include "../fuse/version_manager.h"
+#include "../fuse/tree_snapshots.h"
 #include <iostream>
 #include <cstdlib>
 
@@ -26,7 +27,8 @@ int main(int argc, char* argv[]) {
     string versions_dir = project_root + "/versions";
     string meta_dir = project_root + "/meta";
     
-    VersionManager::init(versions_dir, meta_dir);
+    VersionManager::init(versions_dir, meta_dir, backend_root);
+    TreeSnapshots::init(meta_dir + "/snapshots", backend_root);
     
     try {
         TUIManager tui;
@@ -2,8 +2,10 @@
 #include "../fuse/version_manager.h"
 #include <dirent.h>
 #include <sys/stat.h>
+#include <unistd.h>
 #include <ctime>
 #include <fstream>
+#include <cstdlib>
 #include <algorithm>
 
 using namespace std;
@@ -62,6 +64,9 @@ void TUIManager::load_files() {
 
 void TUIManager::load_versions_for_file(const string& filename) {
     versions = VersionManager::get_versions(backend_root + "/" + filename);
+    // Records that the file did not exist (kept for tree snapshots) are not versions of it
+    versions.erase(remove_if(versions.begin(), versions.end(),
+        [](const FileVersion& v) { return v.flags & VERSION_FLAG_ABSENT; }), versions.end());
     sort(versions.begin(), versions.end(), [](const FileVersion& a, const FileVersion& b) {
         return a.version_number > b.version_number;
     });
@@ -157,6 +162,11 @@ void TUIManager::draw_versions() {
             sel ? '>' : ' ', versions[i].version_number, time_str, 
             format_size(versions[i].size).c_str());
         
+        // Share of the logical size actually kept on disk (older logs lack it)
+        if (versions[i].stored_size > 0 && versions[i].size > 0) {
+            wprintw(versions_win, " %3d%%", (int)(versions[i].stored_size * 100 / versions[i].size));
+        }
+        
         if (sel) wattroff(versions_win, COLOR_PAIR(2) | A_BOLD);
     }
     wnoutrefresh(versions_win);
@@ -239,17 +249,24 @@ void TUIManager::view_version_content() {
     wattron(view, COLOR_PAIR(1) | A_BOLD);
     mvwprintw(view, 0, 2, " v%d - %s ", ver.version_number, current_file.c_str());
     wattroff(view, COLOR_PAIR(1) | A_BOLD);
-    ifstream file(ver.version_path);
     int line = 2;
-    if (file) {
+    // The version is rebuilt into a scratch file and only the lines that fit
+    // are read back, so viewing a large version does not load it into memory
+    const char* tmp_dir = getenv("TMPDIR");
+    string tmp_path = string(tmp_dir ? tmp_dir : "/tmp") + "/vfs-view.XXXXXX";
+    int fd = mkstemp(&tmp_path[0]);
+    if (fd != -1) close(fd);
+    if (fd != -1 && VersionManager::export_version(get_full_path(current_file), ver.version_number, tmp_path)) {
+        ifstream file(tmp_path, ios::binary);
         string content;
-        while (getline(file, content) && line < h - 2) {
+        while (line < h - 2 && getline(file, content)) {
             if (content.length() > (size_t)(w - 4)) content = content.substr(0, w - 7) + "...";
             mvwprintw(view, line++, 2, "%s", content.c_str());
         }
     } else {
         mvwprintw(view, h/2, (w-15)/2, "Cannot read file");
     }
+    if (fd != -1) unlink(tmp_path.c_str());
     mvwprintw(view, h - 1, (w - 16) / 2, "Press any key");
     wrefresh(view);
     nodelay(stdscr, FALSE); getch(); nodelay(stdscr, TRUE);
@@ -0,0 +1,135 @@
+// Histories across renames, driven through the version hooks without a mount
+#include "fuse/version_hooks.h"
+#include "fuse/version_manager.h"
+#include "fuse/meta_wal.h"
+#include "fuse/object_store.h"
+#include "fuse/snapshot_queue.h"
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+static int failures = 0;
+
+#define CHECK(cond)                                                         \
+    do {                                                                    \
+        if (!(cond)) {                                                      \
+            cerr << __FILE__ << ":" << __LINE__ << ": CHECK(" #cond ") failed" << endl; \
+            failures++;                                                     \
+        }                                                                   \
+    } while (0)
+
+static string root;
+
+static string backend(const string& name) {
+    return root + "/data/" + name;
+}
+
+static void write_file(const string& path, const string& content) {
+    FILE* f = fopen(path.c_str(), "w");
+    fputs(content.c_str(), f);
+    fclose(f);
+}
+
+// Contents of every version of a file, oldest first
+static vector<string> history(const string& path) {
+    SnapshotQueue::flush();
+    vector<string> contents;
+    for (const FileVersion& v : VersionManager::get_versions(path)) {
+        string content;
+        VersionManager::read_version_content(path, v.version_number, content);
+        contents.push_back(content);
+    }
+    return contents;
+}
+
+// What an editor does: create a temporary file, write it, close it
+static void write_through_hooks(const string& path, const string& content) {
+    VersionHooks::before_create(path);
+    int fd = open(path.c_str(), O_CREAT | O_WRONLY | O_TRUNC, 0644);
+    VersionHooks::created(fd, path);
+    VersionHooks::before_write(fd, 0, content.size());
+    if (write(fd, content.data(), content.size()) != (ssize_t)content.size()) failures++;
+    VersionHooks::before_release(fd);
+    close(fd);
+}
+
+static bool rename_through_hooks(const string& from, const string& to) {
+    RenamePlan plan = VersionHooks::before_rename(from, to, 0);
+    if (rename(from.c_str(), to.c_str()) != 0) {
+        VersionHooks::rename_failed(plan);
+        return false;
+    }
+    VersionHooks::renamed(from, to, 0, plan);
+    return true;
+}
+
+// An atomic save over a file with history keeps that history at the file's path
+static void test_save_over_file_with_history() {
+    string target = backend("config.yml");
+    string tmp = backend(".config.yml.swp");
+    write_file(target, "one");
+    VersionManager::create_version(target);
+    write_file(target, "two");
+
+    write_through_hooks(tmp, "three");
+    CHECK(history(tmp) == vector<string>{"three"});
+    CHECK(rename_through_hooks(tmp, target));
+
+    vector<string> versions = history(target);
+    CHECK(!versions.empty() && versions.front() == "one");
+    CHECK(!versions.empty() && versions.back() == "three");
+    CHECK(history(tmp).empty());
+    CHECK(VersionManager::get_version_count(tmp) == 0);
+}
+
+// The content an atomic save replaces becomes a version of the target,
+// stored from a hard link of the old file rather than a copy
+static void test_save_keeps_replaced_content() {
+    string target = backend("notes.txt");
+    string tmp = backend("notes.txt.tmp");
+    write_file(target, "draft");
+    VersionManager::create_version(target);
+    write_file(target, "final");
+    struct stat old_st;
+    stat(target.c_str(), &old_st);
+
+    write_through_hooks(tmp, "edited");
+    CHECK(rename_through_hooks(tmp, target));
+
+    vector<string> versions = history(target);
+    CHECK((versions == vector<string>{"draft", "final", "edited"}));
+
+    vector<FileVersion> records = VersionManager::get_versions(target);
+    struct stat object_st;
+    CHECK(records.size() == 3 &&
+          stat(ObjectStore::object_path(records[1].object_id).c_str(), &object_st) == 0 &&
+          object_st.st_ino == old_st.st_ino);
+}
+
+int main() {
+    char dir[] = "/tmp/rename_history_test_XXXXXX";
+    if (!mkdtemp(dir)) return 1;
+    root = dir;
+    for (const char* sub : {"/data", "/meta", "/versions"}) mkdir((root + sub).c_str(), 0755);
+
+    VersionManager::init(root + "/versions", root + "/meta", root + "/data");
+    MetaWal::start(root + "/meta", root + "/versions/objects", Durability::STRICT, 10);
+    SnapshotQueue::start(2, 8);
+
+    test_save_over_file_with_history();
+    test_save_keeps_replaced_content();
+
+    SnapshotQueue::stop();
+    MetaWal::stop();
+    if (system(("rm -rf " + root).c_str()) != 0) failures++;
+
+    if (failures) cerr << failures << " check(s) failed" << endl;
+    return failures ? 1 : 0;
+}